@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "harness.h"
+
+/** The parameters every input runs with. */
+static const Parameters_t fuzzParams = {20.0f, 20.0f};
+
+/**
+ * @brief libFuzzer entry point. Runs the input as a sequence of steps,
+ * and aborts on the first broken invariant so that the input is saved.
+ *
+ * @param data The input.
+ * @param size Size of the input, in bytes.
+ * @return int Always 0.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    FsmHarness harness(fuzzParams);
+    FuzzViolation_e violation = harness.run(data, size);
+
+    if (violation != FUZZ_OK) {
+        fprintf(stderr, "Invariant broken: %s.\n", FsmHarness::getViolationName(violation));
+        abort();
+    }
+
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include <string.h>
+
+#include "harness.h"
+
+/** Deadline of the harness cycles. Long enough that real cycles never miss it, even under sanitizers. */
+#define FUZZ_DEADLINE_US 1000000
+
+/**
+ * @brief Builds the watchdog parameters. The safe output image disables the pump and the fan.
+ *
+ * @return WatchdogConfig_t The parameters.
+ */
+static WatchdogConfig_t makeWatchdogConfig() {
+    WatchdogConfig_t config = {};
+
+    config.deadlineUs = FUZZ_DEADLINE_US;
+    config.maxConsecutiveOverruns = FUZZ_MAX_CONSECUTIVE_OVERRUNS;
+    config.safeOutputs.displayState.coolantStatus = DRY;
+
+    return config;
+}
+
+/**
+ * @brief Constructor. Boots the state machine.
+ *
+ * @param params The state machine parameters.
+ */
+FsmHarness::FsmHarness(Parameters_t params)
+    : params(params), hal(), controller(params.temperatureSetpoint), watchdog(&hal, makeWatchdogConfig()),
+      fsm(params, &hal, &controller, nullptr, &watchdog) {
+    fsm.initialize();
+    fsm.handleCurrentState();
+}
+
+/**
+ * @brief Runs every step in the data, stopping at the first violation.
+ *
+ * @param data The steps.
+ * @param size Size of the data, in bytes.
+ * @return FuzzViolation_e The first violation, or FUZZ_OK.
+ */
+FuzzViolation_e FsmHarness::run(const uint8_t *data, size_t size) {
+    FuzzViolation_e violation = FUZZ_OK;
+
+    for (size_t offset = 0; offset + FUZZ_STEP_SIZE <= size && violation == FUZZ_OK; offset += FUZZ_STEP_SIZE) {
+        violation = step(&data[offset]);
+    }
+
+    return violation;
+}
+
+/**
+ * @brief Runs a single step.
+ *
+ * @param step The step, FUZZ_STEP_SIZE bytes.
+ * @return FuzzViolation_e The violation, or FUZZ_OK.
+ */
+FuzzViolation_e FsmHarness::step(const uint8_t *step) {
+    PlcInputs_t inputs = {};
+    PlcOutputs_t outputs = {};
+    CanFrame_t frame = {};
+    FsmStates_e previous = fsm.getState();
+
+    decodeInputs(step, inputs);
+    hal.setInputs(inputs);
+
+    if (step[0] & FUZZ_FLAG_CAN_FRAME) {
+        decodeCanFrame(step, frame);
+        hal.queueReceivedCanFrame(frame);
+    }
+
+    if ((step[0] & FUZZ_FLAG_STALL) == FUZZ_FLAG_STALL) {
+        stall();
+    } else {
+        fsm.handleCurrentState();
+    }
+
+    /** Stand in for the CAN driver, so that the transmission queue never fills up. */
+    while (hal.popTransmitCanFrame(frame)) {}
+
+    /** Check the invariants. A supply voltage that can't be compared counts as insufficient. */
+    if (previous == STATE_FATAL_ERROR && fsm.getState() != STATE_FATAL_ERROR) {
+        return FUZZ_LEFT_FATAL_ERROR;
+    }
+
+    hal.retrieveOutputs(outputs);
+    if ((inputs.supplyVoltage >= params.minVoltage) == false || inputs.levelSwitchClosed == false) {
+        if (outputs.pumpEnable) {
+            return FUZZ_PUMP_ENABLED_UNSAFE;
+        }
+        if (outputs.fanEnable) {
+            return FUZZ_FAN_ENABLED_UNSAFE;
+        }
+    }
+
+    return FUZZ_OK;
+}
+
+/**
+ * @brief Retrieves the current state.
+ *
+ * @return FsmStates_e The current state.
+ */
+FsmStates_e FsmHarness::getState() {
+    return fsm.getState();
+}
+
+/**
+ * @brief Retrieves the name of a violation.
+ *
+ * @param violation The violation.
+ * @return const char* The name.
+ */
+const char *FsmHarness::getViolationName(FuzzViolation_e violation) {
+    switch (violation) {
+        case FUZZ_OK:
+            return "ok";
+        case FUZZ_PUMP_ENABLED_UNSAFE:
+            return "pump enabled with insufficient supply voltage or coolant";
+        case FUZZ_FAN_ENABLED_UNSAFE:
+            return "fan enabled with insufficient supply voltage or coolant";
+        case FUZZ_LEFT_FATAL_ERROR:
+            return "left the fatal error state";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * @brief Decodes the PLC inputs of a step.
+ *
+ * @param step The step.
+ * @param inputs Overwritten with the inputs.
+ */
+void FsmHarness::decodeInputs(const uint8_t *step, PlcInputs_t &inputs) {
+    uint32_t voltage = (uint32_t)step[1] | ((uint32_t)step[2] << 8) | ((uint32_t)step[3] << 16) |
+                       ((uint32_t)step[4] << 24);
+    int16_t temperature = (int16_t)((uint16_t)step[5] | ((uint16_t)step[6] << 8));
+
+    inputs.ignitionClosed = (step[0] & FUZZ_FLAG_IGNITION) != 0;
+    inputs.levelSwitchClosed = (step[0] & FUZZ_FLAG_LEVEL) != 0;
+    if (step[0] & FUZZ_FLAG_RAW_VOLTAGE) {
+        /** Lets the fuzzer reach NaN, infinities and denormals. */
+        memcpy(&inputs.supplyVoltage, &step[1], sizeof(inputs.supplyVoltage));
+    } else {
+        inputs.supplyVoltage = (float)(voltage % 40001) * (FUZZ_MAX_VOLTAGE / 40000.0f);
+    }
+    inputs.temperature = temperature / 100.0f;
+}
+
+/**
+ * @brief Decodes the CAN frame of a step.
+ *
+ * @param step The step.
+ * @param frame Overwritten with the frame.
+ */
+void FsmHarness::decodeCanFrame(const uint8_t *step, CanFrame_t &frame) {
+    frame.id = (uint32_t)step[7] | ((uint32_t)step[8] << 8) | ((uint32_t)step[9] << 16) | ((uint32_t)step[10] << 24);
+    frame.dlc = step[11];
+    memcpy(frame.data, &step[12], CAN_MESSAGE_LEN);
+}
+
+/**
+ * @brief Runs a cycle that stalls past its deadline, as the supervisor thread would see it.
+ */
+void FsmHarness::stall() {
+    watchdog.beginCycle();
+    watchdog.supervise(std::chrono::steady_clock::now() + std::chrono::microseconds(2 * FUZZ_DEADLINE_US));
+    watchdog.endCycle();
+}
@@ -0,0 +1,131 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "fsm.h"
+#include "hal.h"
+#include "controller.h"
+#include "watchdog.h"
+
+/** Number of input bytes consumed by each step. */
+#define FUZZ_STEP_SIZE 20
+
+/** Flags in the first byte of a step. */
+#define FUZZ_FLAG_IGNITION 0x01
+#define FUZZ_FLAG_LEVEL 0x02
+#define FUZZ_FLAG_CAN_FRAME 0x04
+#define FUZZ_FLAG_RAW_VOLTAGE 0x08
+/** All three bits must be set, so that stalls stay rare in random input. */
+#define FUZZ_FLAG_STALL 0x70
+
+/** Supply voltages generated from scaled bytes span 0 V up to this. */
+#define FUZZ_MAX_VOLTAGE 40.0f
+
+/** Deadline misses in a row that trip the watchdog. */
+#define FUZZ_MAX_CONSECUTIVE_OVERRUNS 3
+
+/**
+ * @brief Describes the invariants the harness checks after each step.
+ */
+typedef enum FuzzViolation_e {
+    /** All invariants hold. */
+    FUZZ_OK,
+    /** The pump is enabled although the supply voltage or coolant level is insufficient. */
+    FUZZ_PUMP_ENABLED_UNSAFE,
+    /** The fan is enabled although the supply voltage or coolant level is insufficient. */
+    FUZZ_FAN_ENABLED_UNSAFE,
+    /** The state machine left STATE_FATAL_ERROR. */
+    FUZZ_LEFT_FATAL_ERROR,
+
+    FUZZ_VIOLATION_MAX
+} FuzzViolation_e;
+
+/**
+ * @brief Runs the state machine on steps decoded from arbitrary bytes,
+ * and checks its safety invariants after every step.
+ *
+ * Each step is FUZZ_STEP_SIZE bytes:
+ *  - [0] flags: ignition, level switch, CAN frame, raw voltage, stall.
+ *  - [1..4] supply voltage: raw float bits if FUZZ_FLAG_RAW_VOLTAGE is set,
+ *    otherwise a little-endian integer scaled to 0 V .. FUZZ_MAX_VOLTAGE.
+ *  - [5..6] temperature in hundredths of a degree, signed little-endian.
+ *  - [7..10] CAN ID, all 32 bits, little-endian, so IDs wider than 29 bits are reached.
+ *  - [11] CAN data length code, unreduced, so lengths over 8 bytes are reached.
+ *  - [12..19] CAN data.
+ *
+ * A stall step runs a cycle that the watchdog catches past its deadline,
+ * instead of a state machine cycle. Trailing bytes that don't fill a step are ignored.
+ */
+class FsmHarness {
+public:
+    /**
+     * @brief Constructor. Boots the state machine.
+     *
+     * @param params The state machine parameters.
+     */
+    FsmHarness(Parameters_t params);
+
+    /**
+     * @brief Runs every step in the data, stopping at the first violation.
+     *
+     * @param data The steps.
+     * @param size Size of the data, in bytes.
+     * @return FuzzViolation_e The first violation, or FUZZ_OK.
+     */
+    FuzzViolation_e run(const uint8_t *data, size_t size);
+
+    /**
+     * @brief Runs a single step.
+     *
+     * @param step The step, FUZZ_STEP_SIZE bytes.
+     * @return FuzzViolation_e The violation, or FUZZ_OK.
+     */
+    FuzzViolation_e step(const uint8_t *step);
+
+    /**
+     * @brief Retrieves the current state.
+     *
+     * @return FsmStates_e The current state.
+     */
+    FsmStates_e getState();
+
+    /**
+     * @brief Retrieves the name of a violation.
+     *
+     * @param violation The violation.
+     * @return const char* The name.
+     */
+    static const char *getViolationName(FuzzViolation_e violation);
+
+private:
+    Parameters_t params;
+    HardwareManager hal;
+    ControlManager controller;
+    WatchdogManager watchdog;
+    StateManager fsm;
+
+    /**
+     * @brief Decodes the PLC inputs of a step.
+     *
+     * @param step The step.
+     * @param inputs Overwritten with the inputs.
+     */
+    static void decodeInputs(const uint8_t *step, PlcInputs_t &inputs);
+
+    /**
+     * @brief Decodes the CAN frame of a step.
+     *
+     * @param step The step.
+     * @param frame Overwritten with the frame.
+     */
+    static void decodeCanFrame(const uint8_t *step, CanFrame_t &frame);
+
+    /**
+     * @brief Runs a cycle that stalls past its deadline, as the supervisor thread would see it.
+     */
+    void stall();
+};
+
+#endif
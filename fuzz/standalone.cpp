@@ -0,0 +1,104 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "harness.h"
+
+/** Default number of random inputs. */
+#define DEFAULT_RUNS 10000
+
+/** Default number of steps in each random input. */
+#define DEFAULT_STEPS 1000
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+/**
+ * @brief Prints the command line usage.
+ *
+ * @param program The name of the executable.
+ */
+static void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options] [INPUT...]" << std::endl;
+    std::cerr << "Replays the given inputs, or runs random inputs if none are given." << std::endl;
+    std::cerr << "  --runs <N>   Number of random inputs. Default: " << DEFAULT_RUNS << std::endl;
+    std::cerr << "  --steps <N>  Steps in each random input. Default: " << DEFAULT_STEPS << std::endl;
+    std::cerr << "  --seed <N>   Seed of the random inputs. Default: the current time." << std::endl;
+}
+
+/**
+ * @brief Runs the fuzz target without libFuzzer, for compilers that don't provide it.
+ * Inputs saved by libFuzzer can be replayed with it too.
+ */
+int main(int argc, char *argv[]) {
+    static const struct option longOptions[] = {
+        {"runs", required_argument, nullptr, 'r'},
+        {"steps", required_argument, nullptr, 's'},
+        {"seed", required_argument, nullptr, 'S'},
+        {nullptr, 0, nullptr, 0},
+    };
+    long runs = DEFAULT_RUNS;
+    long steps = DEFAULT_STEPS;
+    uint64_t seed = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    int option = 0;
+
+    /** Parse the options. */
+    while ((option = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (option) {
+            case 'r':
+                runs = atol(optarg);
+                break;
+            case 's':
+                steps = atol(optarg);
+                break;
+            case 'S':
+                seed = strtoull(optarg, nullptr, 0);
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (runs <= 0 || steps <= 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    /** Replay the given inputs. */
+    if (optind < argc) {
+        for (int i = optind; i < argc; i++) {
+            std::ifstream file(argv[i], std::ios::binary);
+            std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+            std::cout << "Running " << argv[i] << std::endl;
+            LLVMFuzzerTestOneInput(input.data(), input.size());
+        }
+        return 0;
+    }
+
+    /** Run random inputs. The target aborts on the first broken invariant. */
+    std::mt19937_64 generator(seed);
+    std::vector<uint8_t> input(steps * FUZZ_STEP_SIZE);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::cout << "Seed: " << seed << std::endl;
+    for (long run = 0; run < runs; run++) {
+        for (size_t i = 0; i < input.size(); i += sizeof(uint64_t)) {
+            uint64_t bytes = generator();
+            for (size_t j = 0; j < sizeof(uint64_t) && i + j < input.size(); j++) {
+                input[i + j] = (uint8_t)(bytes >> (8 * j));
+            }
+        }
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Ran " << runs * steps << " steps in " << seconds << " s ("
+              << (long)(runs * steps / seconds) << " steps/s)." << std::endl;
+
+    return 0;
+}
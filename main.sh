@@ -1,14 +1,15 @@
 #!/bin/bash
 
 # Exit if the arguments aren't provided.
-if [ "$#" -ne 2 ]; then
-    echo "Usage: $0 <MIN_VOLTAGE> <TEMP_SETPOINT>"
+if [ "$#" -lt 2 ]; then
+    echo "Usage: $0 <MIN_VOLTAGE> <TEMP_SETPOINT> [options]"
     exit 1
 fi
 
-# Get the arguments
+# Get the arguments. Any remaining options are passed through to the executable.
 MIN_VOLTAGE=$1
 TEMP_SETPOINT=$2
+shift 2
 
 if [ ! -d "build" ]; then
     mkdir build
@@ -19,4 +20,4 @@ cmake  ..
 cmake --build .
 
 # Run the code
-./src/eae-firmware $MIN_VOLTAGE $TEMP_SETPOINT
\ No newline at end of file
+./src/eae-firmware $MIN_VOLTAGE $TEMP_SETPOINT "$@"
\ No newline at end of file
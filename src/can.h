@@ -0,0 +1,24 @@
+#ifndef CAN_H
+#define CAN_H
+
+#include <cstdint>
+
+/** Eight bytes is the size of the data in a CAN frame. */
+#define CAN_MESSAGE_LEN 8
+
+/** Highest ID of a CAN frame, with the 29-bit extended format. */
+#define CAN_MAX_EXTENDED_ID 0x1FFFFFFFU
+
+/**
+ * @brief A CAN frame, as queued for reception or transmission.
+ */
+typedef struct CanFrame_t {
+    /** The ID of the frame. */
+    uint32_t id;
+    /** The data length code. */
+    uint8_t dlc;
+    /** The data. Only the first dlc bytes are used. */
+    uint8_t data[CAN_MESSAGE_LEN];
+} CanFrame_t;
+
+#endif
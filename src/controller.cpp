@@ -1,28 +1,405 @@
+#include <cmath>
+
 #include "controller.h"
+#include "radiator.h"
 
 /**
  * @brief Constructor.
+ *
+ * @param temperatureSetpoint The setpoint temperature.
+ * @param gains The gains of the PID loop.
+ * @param periodS The period between two calls to process(), in seconds.
+ * @param allocation How the cooling demand is split between the fan and the pump.
+ * @param predictive Optional settings of the predictive mode, used instead of the PID loop. May be nullptr.
+ * The PID loop is used if the settings are rejected by validatePredictiveConfig().
  */
-ControlManager::ControlManager(float temperatureSetpoint) {
-    temperatureSetpoint = temperatureSetpoint;
+ControlManager::ControlManager(float temperatureSetpoint, PidGains_t gains, float periodS, AllocationMode_e allocation,
+                               const PredictiveConfig_t *predictive)
+    : temperatureSetpoint(temperatureSetpoint), gains(gains), periodS(periodS),
+      integral(0.0f), lastTemperature(0.0f), hasLastTemperature(false), lastAgreeingMask(0),
+      allocation(allocation), fanTable(), pumpTable(),
+      predictive(predictive != nullptr && validatePredictiveConfig(*predictive)), stepResponse(), tailRatio(0.0f),
+      horizonGains(), horizonGainSum(0.0f), samplePeriods(1), sampleCountdown(0), prediction(),
+      hasPrediction(false), heldDemand(0.0f) {
+    buildAllocationTables();
+    if (this->predictive) {
+        buildHorizonGains(*predictive);
+    }
 }
 
 /**
  * @brief Begins the controller.
  */
-void ControlManager::initialize() {}
+void ControlManager::initialize() {
+    reset();
+}
+
+/**
+ * @brief Clears the integrator and derivative history,
+ * so that the next process() call starts from scratch.
+ */
+void ControlManager::reset() {
+    integral = 0.0f;
+    lastTemperature = 0.0f;
+    hasLastTemperature = false;
+    lastAgreeingMask = 0;
+    hasPrediction = false;
+    sampleCountdown = 0;
+    heldDemand = 0.0f;
+}
 
 /**
  * @brief Updates the control signals with the new temperature.
- * 
+ *
  * @param temperature The current temperature.
  * @param fanPowerPercent Overwritten with the new fan control signal.
  * @param pumpPowerPercent Overwritten with the new pump control signal.
  */
 void ControlManager::process(float temperature, int &fanPowerPercent, int &pumpPowerPercent) {
-    /** Placeholder for real PID logic. */
-    /** In a real application, would call an underlying PID library to run the feedback. */
-    fanPowerPercent = 80;
-    pumpPowerPercent = 80;
+    /** Without a usable reading, cool as hard as possible. */
+    if (std::isfinite(temperature) == false) {
+        fanPowerPercent = (int)CONTROLLER_MAX_OUTPUT;
+        pumpPowerPercent = (int)CONTROLLER_MAX_OUTPUT;
+        return;
+    }
+
+    float output = predictive ? updatePredictive(temperature) : updatePid(temperature);
+
+    if (output > CONTROLLER_MAX_OUTPUT) {
+        output = CONTROLLER_MAX_OUTPUT;
+    } else if (output < CONTROLLER_MIN_OUTPUT) {
+        output = CONTROLLER_MIN_OUTPUT;
+    }
+
+    /** The output is the cooling demand, split between the pump and the fan. */
+    int demand = (int)(output + 0.5f);
+    if (allocation == ALLOCATION_OPTIMAL) {
+        fanPowerPercent = fanTable[demand];
+        pumpPowerPercent = pumpTable[demand];
+    } else {
+        fanPowerPercent = demand;
+        pumpPowerPercent = demand;
+    }
     return;
 }
+
+/**
+ * @brief Updates the control signals with the temperature fused from several sensors.
+ *
+ * When a sensor drops out of or rejoins the vote, the fused temperature steps by the
+ * sensor's offset from the others. The derivative history is dropped, so that the step
+ * doesn't kick the outputs. Without any usable sensor, the temperature is NaN, so the
+ * equipment cools as hard as possible.
+ *
+ * @param temperature The fused temperature and the health of its sensors.
+ * @param fanPowerPercent Overwritten with the new fan control signal.
+ * @param pumpPowerPercent Overwritten with the new pump control signal.
+ */
+void ControlManager::process(const FusedTemperature_t &temperature, int &fanPowerPercent, int &pumpPowerPercent) {
+    if (temperature.agreeingMask != lastAgreeingMask) {
+        hasLastTemperature = false;
+        lastAgreeingMask = temperature.agreeingMask;
+    }
+
+    process(temperature.temperature, fanPowerPercent, pumpPowerPercent);
+}
+
+/**
+ * @brief Retrieves the gains of the PID loop.
+ *
+ * @return PidGains_t The gains.
+ */
+PidGains_t ControlManager::getGains() {
+    return gains;
+}
+
+/**
+ * @brief Retrieves the internal state of the PID loop.
+ *
+ * @param state Overwritten with the state.
+ */
+void ControlManager::saveState(ControllerState_t &state) {
+    state.integral = integral;
+    state.lastTemperature = lastTemperature;
+    state.hasLastTemperature = hasLastTemperature;
+}
+
+/**
+ * @brief Resumes the PID loop from a saved state.
+ * The predictive mode isn't saved, and starts from scratch.
+ *
+ * @param state The state.
+ */
+void ControlManager::restoreState(const ControllerState_t &state) {
+    integral = state.integral;
+    lastTemperature = state.lastTemperature;
+    hasLastTemperature = state.hasLastTemperature;
+    hasPrediction = false;
+    sampleCountdown = 0;
+    heldDemand = 0.0f;
+}
+
+/**
+ * @brief Computes the radiator's heat transfer with the pump and the fan, relative to full duty.
+ *
+ * @param fanPowerPercent The fan duty cycle.
+ * @param pumpPowerPercent The pump duty cycle.
+ * @return float The heat transfer, from 0 to 1.
+ */
+float ControlManager::getHeatTransfer(int fanPowerPercent, int pumpPowerPercent) {
+    return RadiatorModel::getHeatTransfer(fanPowerPercent / 100.0f, pumpPowerPercent / 100.0f);
+}
+
+/**
+ * @brief Computes the electrical power of the pump and the fan.
+ *
+ * @param fanPowerPercent The fan duty cycle.
+ * @param pumpPowerPercent The pump duty cycle.
+ * @return float The power, in W.
+ */
+float ControlManager::getElectricalPower(int fanPowerPercent, int pumpPowerPercent) {
+    return RadiatorModel::getElectricalPowerW(RADIATOR_FAN_RATED_W, RADIATOR_PUMP_RATED_W, fanPowerPercent / 100.0f,
+                                              pumpPowerPercent / 100.0f);
+}
+
+/**
+ * @brief Fills the step response of the predictive settings from a first order plus dead time model,
+ * at their sample period.
+ *
+ * @param model The model.
+ * @param config Its step response and gain are overwritten.
+ */
+void ControlManager::buildStepResponse(const PlantModel_t &model, PredictiveConfig_t &config) {
+    for (int k = 0; k < CONTROLLER_MODEL_LENGTH; k++) {
+        float elapsedS = (k + 1) * config.samplePeriodS - model.deadTimeS;
+        config.stepResponse[k] = elapsedS > 0.0f ?
+                                 model.gainCPerPercent * (1.0f - std::exp(-elapsedS / model.timeConstantS)) : 0.0f;
+    }
+    config.gainCPerPercent = model.gainCPerPercent;
+}
+
+/**
+ * @brief Checks the settings of the predictive mode. The step response must either be settled
+ * at its last entry, or still be heading towards the gain so that its tail can be extrapolated.
+ *
+ * A table that stops short of the gain, with a last change of zero or away from the gain,
+ * can't tell where the plant settles, so the prediction would drift away from the plant.
+ * The response must also have started within the horizon.
+ *
+ * @param config The settings.
+ * @return true If the settings can be used.
+ */
+bool ControlManager::validatePredictiveConfig(const PredictiveConfig_t &config) {
+    float last = config.stepResponse[CONTROLLER_MODEL_LENGTH - 1];
+    float change = last - config.stepResponse[CONTROLLER_MODEL_LENGTH - 2];
+    float remainder = config.gainCPerPercent - last;
+    float energy = 0.0f;
+
+    if ((config.samplePeriodS > 0.0f) == false || config.horizon < 1 || config.horizon > CONTROLLER_MODEL_LENGTH ||
+        (config.moveSuppression >= 0.0f) == false || config.gainCPerPercent == 0.0f ||
+        std::isfinite(config.gainCPerPercent) == false) {
+        return false;
+    }
+
+    /** A horizon within the dead time can't see the effect of a move. */
+    for (uint32_t i = 0; i < config.horizon; i++) {
+        energy += config.stepResponse[i] * config.stepResponse[i];
+    }
+    if ((energy > 0.0f) == false) {
+        return false;
+    }
+
+    if (std::fabs(remainder) <= CONTROLLER_SETTLED_TOLERANCE * std::fabs(config.gainCPerPercent)) {
+        return true;
+    }
+    return (remainder > 0.0f && change > 0.0f) || (remainder < 0.0f && change < 0.0f);
+}
+
+/**
+ * @brief Runs the PID loop.
+ *
+ * The derivative acts on the temperature rather than the error, so a setpoint
+ * change doesn't kick the outputs. The integrator stops winding up while the
+ * output is saturated in the direction of the error.
+ *
+ * @param temperature The current temperature.
+ * @return float The cooling demand, in percent, before saturation.
+ */
+float ControlManager::updatePid(float temperature) {
+    float error = temperature - temperatureSetpoint;
+    float derivative = hasLastTemperature ? (temperature - lastTemperature) / periodS : 0.0f;
+    float proportional = gains.kp * error;
+    float step = gains.ki * error * periodS;
+    float output = proportional + integral + step + gains.kd * derivative;
+
+    /** Conditional integration. */
+    if ((output < CONTROLLER_MAX_OUTPUT || step < 0.0f) && (output > CONTROLLER_MIN_OUTPUT || step > 0.0f)) {
+        integral += step;
+    }
+    lastTemperature = temperature;
+    hasLastTemperature = true;
+
+    return output;
+}
+
+/**
+ * @brief Runs the predictive controller, a dynamic matrix controller with a single move.
+ *
+ * Every sample period, the prediction is shifted by one sample and offset by the
+ * difference between the measured and the predicted temperature, which accounts for
+ * load changes and model errors. The demand change that brings the predicted samples
+ * over the horizon closest to the setpoint, in the least squares sense and penalized by
+ * the move suppression, is a fixed weighting of the predicted samples, precomputed in
+ * the constructor. The change is then added to the prediction through the step response.
+ *
+ * The loops run over the whole table, with the weights zeroed past the horizon,
+ * so that they have a fixed length and vectorize. The demand is held in between.
+ *
+ * @param temperature The current temperature.
+ * @return float The cooling demand, in percent.
+ */
+float ControlManager::updatePredictive(float temperature) {
+    float shifted[CONTROLLER_MODEL_LENGTH];
+    float sums[CONTROLLER_LANES] = {};
+
+    /** Start from a plant settled at the current temperature. */
+    if (hasPrediction == false) {
+        for (int i = 0; i < CONTROLLER_MODEL_LENGTH; i++) {
+            prediction[i] = temperature;
+        }
+        hasPrediction = true;
+        sampleCountdown = 0;
+    }
+
+    if (sampleCountdown > 0) {
+        sampleCountdown--;
+        return heldDemand;
+    }
+    sampleCountdown = samplePeriods - 1;
+
+    /**
+     * Free response: where the temperature goes without a new move, corrected by the measurement.
+     * Past the table, the last change of the prediction keeps shrinking by the tail ratio.
+     */
+    float correction = temperature - prediction[0];
+    for (int i = 0; i < CONTROLLER_MODEL_LENGTH - 1; i++) {
+        shifted[i] = prediction[i + 1] + correction;
+    }
+    shifted[CONTROLLER_MODEL_LENGTH - 1] = prediction[CONTROLLER_MODEL_LENGTH - 1] + correction +
+        tailRatio * (prediction[CONTROLLER_MODEL_LENGTH - 1] - prediction[CONTROLLER_MODEL_LENGTH - 2]);
+
+    /** The move is the weighted error of the free response, with one partial sum per lane. */
+    for (int i = 0; i < CONTROLLER_MODEL_LENGTH; i += CONTROLLER_LANES) {
+        for (int lane = 0; lane < CONTROLLER_LANES; lane++) {
+            sums[lane] += horizonGains[i + lane] * shifted[i + lane];
+        }
+    }
+    float weighted = 0.0f;
+    for (int lane = 0; lane < CONTROLLER_LANES; lane++) {
+        weighted += sums[lane];
+    }
+
+    /** Saturate the demand, and predict with the move that is actually applied. */
+    float next = heldDemand + horizonGainSum * temperatureSetpoint - weighted;
+    if (next > CONTROLLER_MAX_OUTPUT) {
+        next = CONTROLLER_MAX_OUTPUT;
+    } else if (next < CONTROLLER_MIN_OUTPUT) {
+        next = CONTROLLER_MIN_OUTPUT;
+    }
+    float move = next - heldDemand;
+    heldDemand = next;
+
+    for (int i = 0; i < CONTROLLER_MODEL_LENGTH; i++) {
+        prediction[i] = shifted[i] + stepResponse[i] * move;
+    }
+
+    return heldDemand;
+}
+
+/**
+ * @brief Precomputes the weights of the predicted samples, and the tail ratio.
+ *
+ * With a single move du and the free response f, the predicted samples are f + s du.
+ * Minimizing |r - f - s du|² + lambda du² over the horizon gives
+ * du = s·(r - f) / (s·s + lambda), so the weights are s / (s·s + lambda).
+ * The penalty lambda is the move suppression times s·s, so that it doesn't depend on
+ * the sample period or the plant's gain.
+ *
+ * @param config The settings of the predictive mode.
+ */
+void ControlManager::buildHorizonGains(const PredictiveConfig_t &config) {
+    uint32_t horizon = config.horizon < CONTROLLER_MODEL_LENGTH ? config.horizon : CONTROLLER_MODEL_LENGTH;
+    float energy = 0.0f;
+
+    for (int i = 0; i < CONTROLLER_MODEL_LENGTH; i++) {
+        stepResponse[i] = config.stepResponse[i];
+    }
+
+    /**
+     * A first order tail shrinks its changes by a constant ratio, and the changes left past the
+     * last entry add up to the remainder m. With the last change c, m = c q / (1 - q), so q = m / (m + c).
+     */
+    float last = stepResponse[CONTROLLER_MODEL_LENGTH - 1];
+    float remainder = config.gainCPerPercent - last;
+    float change = last - stepResponse[CONTROLLER_MODEL_LENGTH - 2];
+    bool settled = std::fabs(remainder) <= CONTROLLER_SETTLED_TOLERANCE * std::fabs(config.gainCPerPercent);
+    tailRatio = settled ? 0.0f : remainder / (remainder + change);
+
+    for (uint32_t i = 0; i < horizon; i++) {
+        energy += stepResponse[i] * stepResponse[i];
+    }
+    energy *= 1.0f + config.moveSuppression;
+
+    horizonGainSum = 0.0f;
+    for (uint32_t i = 0; i < CONTROLLER_MODEL_LENGTH; i++) {
+        horizonGains[i] = i < horizon && energy > 0.0f ? stepResponse[i] / energy : 0.0f;
+        horizonGainSum += horizonGains[i];
+    }
+
+    samplePeriods = (uint32_t)(config.samplePeriodS / periodS + 0.5f);
+    if (samplePeriods < 1) {
+        samplePeriods = 1;
+    }
+}
+
+/**
+ * @brief Fills the allocation tables.
+ *
+ * For each demand, every fan duty cycle is tried with the lowest pump duty cycle that
+ * rejects at least as much heat as running both at the demand, and the pair drawing the
+ * least power is kept. This runs once, so that process() is a table lookup.
+ */
+void ControlManager::buildAllocationTables() {
+    for (int demand = 0; demand < CONTROLLER_ALLOCATION_TABLE_SIZE; demand++) {
+        float required = getHeatTransfer(demand, demand);
+        float bestPower = getElectricalPower(demand, demand);
+        int bestFan = demand;
+        int bestPump = demand;
+
+        for (int fan = 0; fan <= 100; fan++) {
+            float flow = required / RadiatorModel::getAirflowFactor(fan / 100.0f);
+            if (flow > 1.0f) {
+                continue;
+            }
+
+            /** Invert the flow curve, then round up and step up until the rounding error is covered. */
+            int pump = (int)std::ceil(100.0f * RadiatorModel::getPumpDutyForFlow(flow));
+            while (pump < 100 && getHeatTransfer(fan, pump) < required) {
+                pump++;
+            }
+            if (pump > 100 || getHeatTransfer(fan, pump) < required) {
+                continue;
+            }
+
+            float power = getElectricalPower(fan, pump);
+            if (power < bestPower) {
+                bestPower = power;
+                bestFan = fan;
+                bestPump = pump;
+            }
+        }
+
+        fanTable[demand] = (uint8_t)bestFan;
+        pumpTable[demand] = (uint8_t)bestPump;
+    }
+}
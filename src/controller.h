@@ -1,33 +1,312 @@
 #ifndef CONTROLLER_H
 #define CONTROLLER_H
 
+#include <cstdint>
+
+#include "fusion.h"
+
+/** Default gains, in percent of duty cycle per degree above the setpoint. */
+#define CONTROLLER_DEFAULT_KP 8.0f
+#define CONTROLLER_DEFAULT_KI 0.4f
+#define CONTROLLER_DEFAULT_KD 0.0f
+
+/** Default period between two calls to process(), in seconds. */
+#define CONTROLLER_DEFAULT_PERIOD_S 0.01f
+
+/** Limits of the control signals, in percent. */
+#define CONTROLLER_MIN_OUTPUT 0.0f
+#define CONTROLLER_MAX_OUTPUT 100.0f
+
+/** One allocation table entry per percent of cooling demand, from 0% to 100%. */
+#define CONTROLLER_ALLOCATION_TABLE_SIZE 101
+
+/** Number of samples in the step-response table of the predictive mode. A multiple of CONTROLLER_LANES. */
+#define CONTROLLER_MODEL_LENGTH 64
+
+/**
+ * Largest distance between the last entry of a step-response table and the plant's gain, relative to the gain,
+ * for the table to be counted as settled. Past it, the response is extrapolated towards the gain.
+ */
+#define CONTROLLER_SETTLED_TOLERANCE 0.01f
+
+/** Number of independent sums the horizon math is split into, so that the compiler maps them onto SIMD lanes. */
+#define CONTROLLER_LANES 4
+
+/**
+ * Default model of the coolant loop's response to the cooling demand, identified around a 60 °C setpoint
+ * with a 3 kW load: one more percent of demand settles the temperature about one degree lower.
+ */
+#define CONTROLLER_DEFAULT_MODEL_GAIN_C_PER_PERCENT -0.9f
+#define CONTROLLER_DEFAULT_MODEL_TIME_CONSTANT_S 200.0f
+#define CONTROLLER_DEFAULT_MODEL_DEAD_TIME_S 2.0f
+
+/** Default settings of the predictive mode. */
+#define CONTROLLER_DEFAULT_SAMPLE_PERIOD_S 1.0f
+#define CONTROLLER_DEFAULT_HORIZON 4
+#define CONTROLLER_DEFAULT_MOVE_SUPPRESSION 0.5f
+
+/**
+ * @brief Describes how the cooling demand is split between the fan and the pump.
+ */
+typedef enum AllocationMode_e {
+    /** The fan and the pump run at the demand. */
+    ALLOCATION_EQUAL,
+    /** The fan and the pump run at the cheapest pair of duty cycles that rejects as much heat as ALLOCATION_EQUAL. */
+    ALLOCATION_OPTIMAL,
+
+    ALLOCATION_MODE_MAX
+} AllocationMode_e;
+
+/**
+ * @brief The gains of the PID loop. The error is the temperature above the setpoint,
+ * so a positive gain increases cooling as the temperature rises.
+ */
+typedef struct PidGains_t {
+    /** Proportional gain, in percent per degree. */
+    float kp;
+    /** Integral gain, in percent per degree per second. */
+    float ki;
+    /** Derivative gain, in percent per degree per second of rate of change. */
+    float kd;
+} PidGains_t;
+
+/**
+ * @brief A first order plus dead time model of the plant, from the cooling demand to the temperature.
+ */
+typedef struct PlantModel_t {
+    /** Change of the settled temperature per percent of demand, in degrees per percent. Negative. */
+    float gainCPerPercent;
+    /** Time constant of the response, in seconds. */
+    float timeConstantS;
+    /** Delay before the temperature starts to respond, in seconds. */
+    float deadTimeS;
+} PlantModel_t;
+
+/**
+ * @brief The settings of the predictive mode.
+ */
+typedef struct PredictiveConfig_t {
+    /**
+     * The step response of the plant: entry k is the temperature change k + 1 samples after
+     * a one percent step of the demand, in degrees.
+     */
+    float stepResponse[CONTROLLER_MODEL_LENGTH];
+    /**
+     * The settled temperature change per percent of demand, in degrees. If the table stops short of it,
+     * the response past the last entry is extrapolated towards it, as a first order response.
+     */
+    float gainCPerPercent;
+    /** The period between two predictive updates, in seconds. The demand is held in between. */
+    float samplePeriodS;
+    /** Number of samples over which the predicted temperature is brought to the setpoint, up to CONTROLLER_MODEL_LENGTH. */
+    uint32_t horizon;
+    /**
+     * Penalty on changes of the demand, as a fraction of the step response's energy over the horizon.
+     * 0 brings the prediction closest to the setpoint, and higher is gentler.
+     */
+    float moveSuppression;
+} PredictiveConfig_t;
+
+/**
+ * @brief The internal state of the PID loop, saved and restored across restarts.
+ */
+typedef struct ControllerState_t {
+    /** The integral term, in percent. */
+    float integral;
+    /** The temperature at the last call, for the derivative term. */
+    float lastTemperature;
+    bool hasLastTemperature;
+} ControllerState_t;
+
 /**
- * @brief Responsible for updating the pump and fan's control signals with a PID loop.
+ * @brief Responsible for updating the pump and fan's control signals with a PID loop,
+ * or with a predictive controller using a step-response model of the plant.
  */
 class ControlManager {
 public:
     /**
      * @brief Constructor.
+     *
+     * @param temperatureSetpoint The setpoint temperature.
+     * @param gains The gains of the PID loop.
+     * @param periodS The period between two calls to process(), in seconds.
+     * @param allocation How the cooling demand is split between the fan and the pump.
+     * @param predictive Optional settings of the predictive mode, used instead of the PID loop. May be nullptr.
+     * The PID loop is used if the settings are rejected by validatePredictiveConfig().
      */
-    ControlManager(float temperatureSetpoint);
+    ControlManager(float temperatureSetpoint,
+                   PidGains_t gains = {CONTROLLER_DEFAULT_KP, CONTROLLER_DEFAULT_KI, CONTROLLER_DEFAULT_KD},
+                   float periodS = CONTROLLER_DEFAULT_PERIOD_S, AllocationMode_e allocation = ALLOCATION_EQUAL,
+                   const PredictiveConfig_t *predictive = nullptr);
 
     /**
      * @brief Begins the controller.
      */
     void initialize();
 
+    /**
+     * @brief Clears the integrator and derivative history,
+     * so that the next process() call starts from scratch.
+     */
+    void reset();
+
     /**
      * @brief Updates the control signals given the current temperature.
-     * 
+     *
      * @param temperature The current temperature.
      * @param fanPowerPercent Overwritten with the new fan control signal.
      * @param pumpPowerPercent Overwritten with the new pump control signal.
      */
     void process(float temperature, int &fanPowerPercent, int &pumpPowerPercent);
 
+    /**
+     * @brief Updates the control signals given the temperature fused from several sensors.
+     *
+     * @param temperature The fused temperature and the health of its sensors.
+     * @param fanPowerPercent Overwritten with the new fan control signal.
+     * @param pumpPowerPercent Overwritten with the new pump control signal.
+     */
+    void process(const FusedTemperature_t &temperature, int &fanPowerPercent, int &pumpPowerPercent);
+
+    /**
+     * @brief Retrieves the gains of the PID loop.
+     *
+     * @return PidGains_t The gains.
+     */
+    PidGains_t getGains();
+
+    /**
+     * @brief Retrieves the internal state of the PID loop.
+     *
+     * @param state Overwritten with the state.
+     */
+    void saveState(ControllerState_t &state);
+
+    /**
+     * @brief Resumes the PID loop from a saved state.
+     * The predictive mode isn't saved, and starts from scratch.
+     *
+     * @param state The state.
+     */
+    void restoreState(const ControllerState_t &state);
+
+    /**
+     * @brief Computes the radiator's heat transfer with the pump and the fan, relative to full duty.
+     *
+     * @param fanPowerPercent The fan duty cycle.
+     * @param pumpPowerPercent The pump duty cycle.
+     * @return float The heat transfer, from 0 to 1.
+     */
+    static float getHeatTransfer(int fanPowerPercent, int pumpPowerPercent);
+
+    /**
+     * @brief Computes the electrical power of the pump and the fan.
+     *
+     * @param fanPowerPercent The fan duty cycle.
+     * @param pumpPowerPercent The pump duty cycle.
+     * @return float The power, in W.
+     */
+    static float getElectricalPower(int fanPowerPercent, int pumpPowerPercent);
+
+    /**
+     * @brief Fills the step response of the predictive settings from a first order plus dead time model,
+     * at their sample period.
+     *
+     * @param model The model.
+     * @param config Its step response and gain are overwritten.
+     */
+    static void buildStepResponse(const PlantModel_t &model, PredictiveConfig_t &config);
+
+    /**
+     * @brief Checks the settings of the predictive mode. The step response must either be settled
+     * at its last entry, or still be heading towards the gain so that its tail can be extrapolated.
+     *
+     * @param config The settings.
+     * @return true If the settings can be used.
+     */
+    static bool validatePredictiveConfig(const PredictiveConfig_t &config);
+
 private:
     /** The setpoint temperature to be returned by the temp sensor. */
     float temperatureSetpoint;
+
+    /** The gains of the PID loop. */
+    PidGains_t gains;
+
+    /** The period between two calls to process(), in seconds. */
+    float periodS;
+
+    /** The integral term, in percent. */
+    float integral;
+
+    /** The temperature at the last call, for the derivative term. */
+    float lastTemperature;
+    bool hasLastTemperature;
+
+    /** The sensors the fused temperature was computed from at the last call. */
+    uint16_t lastAgreeingMask;
+
+    /** How the cooling demand is split between the fan and the pump. */
+    AllocationMode_e allocation;
+
+    /** The fan and pump duty cycles for each percent of cooling demand, in ALLOCATION_OPTIMAL. */
+    uint8_t fanTable[CONTROLLER_ALLOCATION_TABLE_SIZE];
+    uint8_t pumpTable[CONTROLLER_ALLOCATION_TABLE_SIZE];
+
+    /** Whether the predictive mode is used instead of the PID loop. */
+    bool predictive;
+
+    /** The step response of the plant, in degrees per percent of demand. */
+    float stepResponse[CONTROLLER_MODEL_LENGTH];
+
+    /**
+     * Ratio between two consecutive changes of the step response past the last entry,
+     * from 0 for a settled table to just under 1 for a slow plant.
+     */
+    float tailRatio;
+
+    /** Weight of each predicted sample in the demand change, zero past the horizon, and their sum. */
+    float horizonGains[CONTROLLER_MODEL_LENGTH];
+    float horizonGainSum;
+
+    /** Number of process() calls per predictive update, and the calls left until the next one. */
+    uint32_t samplePeriods;
+    uint32_t sampleCountdown;
+
+    /** The predicted temperature over the next samples, from the demand changes so far. Entry 0 is the next sample. */
+    float prediction[CONTROLLER_MODEL_LENGTH];
+    bool hasPrediction;
+
+    /** The demand held between predictive updates, in percent. */
+    float heldDemand;
+
+    /**
+     * @brief Fills the allocation tables.
+     */
+    void buildAllocationTables();
+
+    /**
+     * @brief Precomputes the weights of the predicted samples, and the tail ratio.
+     *
+     * @param config The settings of the predictive mode.
+     */
+    void buildHorizonGains(const PredictiveConfig_t &config);
+
+    /**
+     * @brief Runs the PID loop.
+     *
+     * @param temperature The current temperature.
+     * @return float The cooling demand, in percent, before saturation.
+     */
+    float updatePid(float temperature);
+
+    /**
+     * @brief Runs the predictive controller.
+     *
+     * @param temperature The current temperature.
+     * @return float The cooling demand, in percent.
+     */
+    float updatePredictive(float temperature);
 };
 
 #endif
@@ -0,0 +1,119 @@
+#include <string.h>
+
+#include "display.h"
+
+/** Sending time that one frame costs from the token bucket. */
+#define DISPLAY_FRAME_COST_NS (1000000000LL / DISPLAY_FRAMES_PER_SECOND)
+
+/** ISO-TP protocol control information, in the high nibble of the first byte. */
+#define ISOTP_SINGLE_FRAME 0x00
+#define ISOTP_FIRST_FRAME 0x10
+#define ISOTP_CONSECUTIVE_FRAME 0x20
+
+/** Payload bytes carried by each kind of frame. */
+#define ISOTP_SINGLE_FRAME_DATA 7
+#define ISOTP_FIRST_FRAME_DATA 6
+#define ISOTP_CONSECUTIVE_FRAME_DATA 7
+
+/** The interned text of each message. */
+static const char *messageTexts[DISPLAY_MESSAGE_MAX] = {
+    "",
+    "Ready for ignition.",
+    "Coolant refill required.",
+};
+
+/**
+ * @brief Constructor.
+ */
+DisplayManager::DisplayManager()
+    : lastState{DRY, DISPLAY_MESSAGE_NONE}, hasLastState(false), payload(), length(0), offset(0), sequence(0),
+      tokensNs(0), lastRefill() {}
+
+/**
+ * @brief Starts a new transfer if the display state changed since the last one.
+ * A transfer that is still in progress is abandoned, since its state is stale.
+ *
+ * @param state The display state.
+ */
+void DisplayManager::update(const DisplayState_t &state) {
+    if (hasLastState && state.coolantStatus == lastState.coolantStatus && state.messageId == lastState.messageId) {
+        return;
+    }
+
+    const char *text = getMessageText(state.messageId);
+    size_t textLength = strnlen(text, DISPLAY_TEXT_SIZE);
+
+    payload[0] = (uint8_t)state.coolantStatus;
+    payload[1] = (uint8_t)state.messageId;
+    memcpy(&payload[2], text, textLength);
+    length = (uint16_t)(2 + textLength);
+    offset = 0;
+    sequence = 0;
+
+    lastState = state;
+    hasLastState = true;
+}
+
+/**
+ * @brief Retrieves the next frame of the current transfer, if the rate limit allows.
+ *
+ * @param frame Overwritten with the frame.
+ * @param now The current time.
+ * @return true If a frame must be sent.
+ */
+bool DisplayManager::nextFrame(CanFrame_t &frame, std::chrono::steady_clock::time_point now) {
+    if (isTransferring() == false) {
+        return false;
+    }
+
+    /** Refill the bucket with the time that passed, up to the burst size. */
+    tokensNs += std::chrono::duration_cast<std::chrono::nanoseconds>(now - lastRefill).count();
+    lastRefill = now;
+    if (tokensNs > DISPLAY_FRAME_BURST * DISPLAY_FRAME_COST_NS) {
+        tokensNs = DISPLAY_FRAME_BURST * DISPLAY_FRAME_COST_NS;
+    }
+    if (tokensNs < DISPLAY_FRAME_COST_NS) {
+        return false;
+    }
+    tokensNs -= DISPLAY_FRAME_COST_NS;
+
+    uint16_t remaining = length - offset;
+    uint16_t count = 0;
+
+    frame.id = DISPLAY_CAN_ID;
+    if (offset == 0 && length <= ISOTP_SINGLE_FRAME_DATA) {
+        count = length;
+        frame.data[0] = ISOTP_SINGLE_FRAME | (uint8_t)length;
+        memcpy(&frame.data[1], payload, count);
+        frame.dlc = (uint8_t)(1 + count);
+    } else if (offset == 0) {
+        count = ISOTP_FIRST_FRAME_DATA;
+        frame.data[0] = ISOTP_FIRST_FRAME | (uint8_t)((length >> 8) & 0x0F);
+        frame.data[1] = (uint8_t)(length & 0xFF);
+        memcpy(&frame.data[2], payload, count);
+        frame.dlc = CAN_MESSAGE_LEN;
+        sequence = 1;
+    } else {
+        count = remaining < ISOTP_CONSECUTIVE_FRAME_DATA ? remaining : ISOTP_CONSECUTIVE_FRAME_DATA;
+        frame.data[0] = ISOTP_CONSECUTIVE_FRAME | (sequence & 0x0F);
+        memcpy(&frame.data[1], &payload[offset], count);
+        frame.dlc = (uint8_t)(1 + count);
+        sequence++;
+    }
+
+    offset += count;
+    return true;
+}
+
+/**
+ * @brief Retrieves the interned text of a message.
+ *
+ * @param id The message ID.
+ * @return const char* The text.
+ */
+const char *DisplayManager::getMessageText(DisplayMessageId_e id) {
+    if (id < DISPLAY_MESSAGE_NONE || id >= DISPLAY_MESSAGE_MAX) {
+        return messageTexts[DISPLAY_MESSAGE_NONE];
+    }
+    return messageTexts[id];
+}
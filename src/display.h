@@ -0,0 +1,133 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <chrono>
+#include <cstdint>
+
+#include "can.h"
+
+/** The CAN ID the display listens on. */
+#define DISPLAY_CAN_ID 0x300
+
+/** Longest display message text, in bytes. */
+#define DISPLAY_TEXT_SIZE 32
+
+/** Size of a transfer: the coolant status, the message ID and the text. */
+#define DISPLAY_PAYLOAD_SIZE (2 + DISPLAY_TEXT_SIZE)
+
+/** Sustained rate of display frames. */
+#define DISPLAY_FRAMES_PER_SECOND 100
+
+/** Number of display frames that can be sent back to back after a quiet period. */
+#define DISPLAY_FRAME_BURST 4
+
+/**
+ * Number of free slots left in the CAN transmission queue for control frames.
+ * Display frames wait while the queue is fuller than this.
+ */
+#define DISPLAY_TX_RESERVE 16
+
+/**
+ * @brief Describes the current status of the coolant in the system,
+ * as read by the level sensor.
+ */
+typedef enum CoolantStatus_e {
+    /** There is enough coolant in the system to run. */
+    SUFFICIENT,
+    /** There is not enough coolant in the system to run. */
+    DRY
+} CoolantStatus_e;
+
+/**
+ * @brief Describes the messages that can be shown on the display.
+ * The text of each message is interned in the display manager.
+ */
+typedef enum DisplayMessageId_e {
+    /** No message. */
+    DISPLAY_MESSAGE_NONE,
+    /** The system is ready for ignition. */
+    DISPLAY_MESSAGE_READY_FOR_IGNITION,
+    /** The coolant needs to be refilled. */
+    DISPLAY_MESSAGE_COOLANT_REFILL_REQUIRED,
+
+    DISPLAY_MESSAGE_MAX
+} DisplayMessageId_e;
+
+/**
+ * @brief The information that is shown on the display.
+ */
+typedef struct DisplayState_t {
+    /** The coolant status. */
+    CoolantStatus_e coolantStatus;
+    /** Optional message. */
+    DisplayMessageId_e messageId;
+} DisplayState_t;
+
+/**
+ * @brief Turns display state changes into CAN frames for the display.
+ *
+ * A transfer is only started when the display state changes. Its payload is the
+ * coolant status, the message ID and the message text, segmented like ISO-TP
+ * (ISO 15765-2): a single frame if it fits in 7 bytes, otherwise a first frame
+ * carrying the length followed by numbered consecutive frames. The display isn't
+ * expected to send flow control; instead, frames are released by a token bucket
+ * so that display traffic never exceeds DISPLAY_FRAMES_PER_SECOND.
+ */
+class DisplayManager {
+public:
+    /**
+     * @brief Constructor.
+     */
+    DisplayManager();
+
+    /**
+     * @brief Starts a new transfer if the display state changed since the last one.
+     * A transfer that is still in progress is abandoned, since its state is stale.
+     *
+     * @param state The display state.
+     */
+    void update(const DisplayState_t &state);
+
+    /**
+     * @brief Retrieves the next frame of the current transfer, if the rate limit allows.
+     *
+     * @param frame Overwritten with the frame.
+     * @param now The current time.
+     * @return true If a frame must be sent.
+     */
+    bool nextFrame(CanFrame_t &frame, std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Whether a transfer is in progress.
+     *
+     * @return true If there are frames left to send.
+     */
+    bool isTransferring() {
+        return offset < length;
+    }
+
+    /**
+     * @brief Retrieves the interned text of a message.
+     *
+     * @param id The message ID.
+     * @return const char* The text.
+     */
+    static const char *getMessageText(DisplayMessageId_e id);
+
+private:
+    /** The state sent by the current or last transfer. */
+    DisplayState_t lastState;
+    bool hasLastState;
+
+    /** The current transfer. */
+    uint8_t payload[DISPLAY_PAYLOAD_SIZE];
+    uint16_t length;
+    uint16_t offset;
+    uint8_t sequence;
+
+    /** Token bucket, counted in nanoseconds of sending time. Each frame costs one frame period. */
+    int64_t tokensNs;
+    std::chrono::steady_clock::time_point lastRefill;
+};
+
+#endif
@@ -0,0 +1,340 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "dtc.h"
+#include "log.h"
+
+/** Marks the start of a file entry. Changed whenever the entry layout changes, so that old entries are dropped. */
+#define DTC_ENTRY_MAGIC 0x44544332U
+
+/** How often the writer thread checks whether it must stop. */
+#define DTC_POLL_PERIOD_MS 10
+
+/** Suffix of the file written while compacting. */
+#define DTC_COMPACT_SUFFIX ".tmp"
+
+/**
+ * @brief Computes the CRC-32 (IEEE 802.3) of a buffer. Only called by the writer thread
+ * and on load, so it doesn't need a table.
+ *
+ * @param data The buffer.
+ * @param size Size of the buffer, in bytes.
+ * @return uint32_t The CRC.
+ */
+static uint32_t crc32(const uint8_t *data, size_t size) {
+    uint32_t crc = 0xFFFFFFFFU;
+
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+        }
+    }
+
+    return ~crc;
+}
+
+/**
+ * @brief Constructor.
+ *
+ * @param path The file the records are persisted to, or nullptr to keep them in memory only.
+ */
+DiagnosticManager::DiagnosticManager(const char *path)
+    : path(path), table(), dropped(0), stored(), dirty(), fileEntries(0), running(false) {}
+
+/**
+ * @brief Destructor. Stops the writer thread if it is running.
+ */
+DiagnosticManager::~DiagnosticManager() {
+    stop();
+}
+
+/**
+ * @brief Restores the records from the file. Must be called before start().
+ *
+ * Entries with a bad magic, code or CRC are skipped. If any were found, or the file
+ * ends with a partial entry, it is compacted so that new entries stay aligned.
+ *
+ * @return true If the file was read, false if it doesn't exist or can't be read.
+ */
+bool DiagnosticManager::load() {
+    DtcEntry_t entry = {};
+    bool damaged = false;
+    ssize_t size = 0;
+
+    if (path == nullptr) {
+        return false;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    fileEntries = 0;
+    while ((size = read(fd, &entry, sizeof(entry))) == (ssize_t)sizeof(entry)) {
+        uint32_t crc = entry.crc;
+        entry.crc = 0;
+        if (entry.magic != DTC_ENTRY_MAGIC || entry.code >= DTC_MAX ||
+            crc32((const uint8_t *)&entry, sizeof(entry)) != crc) {
+            damaged = true;
+            continue;
+        }
+
+        table[entry.code] = entry.record;
+        stored[entry.code] = entry.record;
+        fileEntries++;
+    }
+    close(fd);
+
+    if (size != 0 || damaged) {
+        LogManager::log(LOG_WARNING, "Diagnostic file was damaged, compacting it.");
+        compact();
+    }
+
+    return true;
+}
+
+/**
+ * @brief Raises a code. Called by the control thread.
+ *
+ * @param code The code.
+ * @param state The current state.
+ * @param inputs The current inputs, kept as the freeze frame on the first occurrence.
+ */
+void DiagnosticManager::raise(DtcCode_e code, FsmStates_e state, const PlcInputs_t &inputs) {
+    uint64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    if (code < 0 || code >= DTC_MAX) {
+        return;
+    }
+
+    DtcRecord_t &record = table[code];
+    if (record.occurrences == 0) {
+        record.firstSeenMs = nowMs;
+        record.freezeFrameState = state;
+        record.freezeFrame = inputs;
+    }
+    record.occurrences++;
+    record.lastSeenMs = nowMs;
+
+    DtcEvent_t event = {code, record};
+    if (events.push(event) == false) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Retrieves the record of a code. Called by the control thread.
+ *
+ * @param code The code.
+ * @param record Overwritten with the record.
+ * @return true If the code was ever raised.
+ */
+bool DiagnosticManager::getRecord(DtcCode_e code, DtcRecord_t &record) {
+    if (code < 0 || code >= DTC_MAX) {
+        return false;
+    }
+
+    record = table[code];
+    return record.occurrences > 0;
+}
+
+/**
+ * @brief Appends the records that changed since the last call to the file.
+ * Called by the writer thread.
+ *
+ * The entries are written with a single append and synced together.
+ *
+ * @return size_t The number of entries appended.
+ */
+size_t DiagnosticManager::flush() {
+    DtcEvent_t event = {};
+    DtcEntry_t entries[DTC_MAX];
+    size_t count = 0;
+
+    /** Coalesce the queued records, keeping the latest of each code. */
+    while (events.pop(event)) {
+        stored[event.code] = event.record;
+        dirty[event.code] = true;
+    }
+
+    for (int code = 0; code < DTC_MAX; code++) {
+        if (dirty[code]) {
+            makeEntry((DtcCode_e)code, stored[code], entries[count]);
+            count++;
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+    if (path == nullptr) {
+        for (bool &flag : dirty) {
+            flag = false;
+        }
+        return 0;
+    }
+
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LogManager::log(LOG_ERROR, "Failed to open the diagnostic file.");
+        return 0;
+    }
+    bool written = write(fd, entries, count * sizeof(DtcEntry_t)) == (ssize_t)(count * sizeof(DtcEntry_t));
+    written = fdatasync(fd) == 0 && written;
+    close(fd);
+
+    if (written == false) {
+        /** Keep the records dirty, and rewrite the file in case the entry was torn. */
+        LogManager::log(LOG_ERROR, "Failed to append to the diagnostic file.");
+        compact();
+        return 0;
+    }
+
+    for (bool &flag : dirty) {
+        flag = false;
+    }
+    fileEntries += count;
+    if (fileEntries >= DTC_COMPACT_ENTRIES) {
+        compact();
+    }
+
+    return count;
+}
+
+/**
+ * @brief Starts the writer thread, which calls flush() every DTC_FLUSH_PERIOD_MS.
+ */
+void DiagnosticManager::start() {
+    if (running) {
+        return;
+    }
+
+    running = true;
+    writerThread = std::thread(&DiagnosticManager::run, this);
+}
+
+/**
+ * @brief Stops the writer thread and appends the remaining records.
+ */
+void DiagnosticManager::stop() {
+    if (running == false) {
+        return;
+    }
+
+    running = false;
+    writerThread.join();
+    flush();
+}
+
+/**
+ * @brief Retrieves the name of a code.
+ *
+ * @param code The code.
+ * @return const char* The name.
+ */
+const char *DiagnosticManager::getCodeName(DtcCode_e code) {
+    switch (code) {
+        case DTC_UNDERVOLTAGE:
+            return "undervoltage";
+        case DTC_COOLANT_DRY:
+            return "coolant_dry";
+        case DTC_DEADLINE_MISSED:
+            return "deadline_missed";
+        case DTC_WATCHDOG_TRIPPED:
+            return "watchdog_tripped";
+        case DTC_SENSOR_DEGRADED:
+            return "sensor_degraded";
+        case DTC_SENSOR_FAILED:
+            return "sensor_failed";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * @brief Fills a file entry, including its CRC.
+ * The entry is zeroed first, so that the padding doesn't change the CRC.
+ *
+ * @param code The code.
+ * @param record The record.
+ * @param entry Overwritten with the entry.
+ */
+void DiagnosticManager::makeEntry(DtcCode_e code, const DtcRecord_t &record, DtcEntry_t &entry) {
+    memset(&entry, 0, sizeof(entry));
+    entry.magic = DTC_ENTRY_MAGIC;
+    entry.code = (uint32_t)code;
+    entry.record.occurrences = record.occurrences;
+    entry.record.firstSeenMs = record.firstSeenMs;
+    entry.record.lastSeenMs = record.lastSeenMs;
+    entry.record.freezeFrameState = record.freezeFrameState;
+    entry.record.freezeFrame.supplyVoltage = record.freezeFrame.supplyVoltage;
+    entry.record.freezeFrame.ignitionClosed = record.freezeFrame.ignitionClosed;
+    entry.record.freezeFrame.levelSwitchClosed = record.freezeFrame.levelSwitchClosed;
+    entry.record.freezeFrame.temperature = record.freezeFrame.temperature;
+    for (int i = 0; i < HAL_REDUNDANT_TEMP_INPUTS; i++) {
+        entry.record.freezeFrame.redundantTemperatures[i] = record.freezeFrame.redundantTemperatures[i];
+    }
+    entry.crc = crc32((const uint8_t *)&entry, sizeof(entry));
+}
+
+/**
+ * @brief Rewrites the file with one entry per raised code, replacing it atomically.
+ *
+ * @return true If the file was rewritten.
+ */
+bool DiagnosticManager::compact() {
+    DtcEntry_t entries[DTC_MAX];
+    char temporaryPath[256];
+    size_t count = 0;
+
+    if (path == nullptr ||
+        snprintf(temporaryPath, sizeof(temporaryPath), "%s" DTC_COMPACT_SUFFIX, path) >= (int)sizeof(temporaryPath)) {
+        return false;
+    }
+
+    for (int code = 0; code < DTC_MAX; code++) {
+        if (stored[code].occurrences > 0) {
+            makeEntry((DtcCode_e)code, stored[code], entries[count]);
+            count++;
+        }
+    }
+
+    int fd = open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool written = write(fd, entries, count * sizeof(DtcEntry_t)) == (ssize_t)(count * sizeof(DtcEntry_t));
+    written = fsync(fd) == 0 && written;
+    close(fd);
+
+    if (written == false || rename(temporaryPath, path) != 0) {
+        unlink(temporaryPath);
+        return false;
+    }
+
+    fileEntries = count;
+    return true;
+}
+
+/**
+ * @brief Calls flush() every DTC_FLUSH_PERIOD_MS until stop() is called.
+ */
+void DiagnosticManager::run() {
+    std::chrono::steady_clock::time_point nextFlush =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(DTC_FLUSH_PERIOD_MS);
+
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(DTC_POLL_PERIOD_MS));
+        if (std::chrono::steady_clock::now() >= nextFlush) {
+            flush();
+            nextFlush += std::chrono::milliseconds(DTC_FLUSH_PERIOD_MS);
+        }
+    }
+}
@@ -0,0 +1,208 @@
+#ifndef DTC_H
+#define DTC_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "fsm.h"
+#include "queue.h"
+
+/** Number of occurrences that can wait for the writer thread before new ones are dropped. */
+#define DTC_QUEUE_SIZE 32
+
+/** How often the writer thread appends the changed records to the file. */
+#define DTC_FLUSH_PERIOD_MS 1000
+
+/** Number of entries the file can grow to before it is compacted to one entry per code. */
+#define DTC_COMPACT_ENTRIES 1024
+
+/**
+ * @brief Describes the diagnostic trouble codes.
+ */
+typedef enum DtcCode_e {
+    /** The supply voltage was below the minimum while starting or running. */
+    DTC_UNDERVOLTAGE,
+    /** The coolant was dry while starting or running. */
+    DTC_COOLANT_DRY,
+    /** A cycle missed its deadline and the safe outputs were forced. */
+    DTC_DEADLINE_MISSED,
+    /** Too many cycles in a row missed their deadline. */
+    DTC_WATCHDOG_TRIPPED,
+    /** A temperature sensor was left out of the vote while running. */
+    DTC_SENSOR_DEGRADED,
+    /** The temperature sensors disagreed with no majority, or none was usable, while running. */
+    DTC_SENSOR_FAILED,
+
+    DTC_MAX
+} DtcCode_e;
+
+/**
+ * @brief The history of a diagnostic trouble code.
+ */
+typedef struct DtcRecord_t {
+    /** Number of times the code was raised. 0 if it never was. */
+    uint32_t occurrences;
+    /** When the code was first and last raised, in milliseconds since the Unix epoch. */
+    uint64_t firstSeenMs;
+    uint64_t lastSeenMs;
+    /** The state the code was first raised in. */
+    FsmStates_e freezeFrameState;
+    /** The inputs when the code was first raised. */
+    PlcInputs_t freezeFrame;
+} DtcRecord_t;
+
+/**
+ * @brief Records diagnostic trouble codes, and persists them without blocking the control loop.
+ *
+ * The records live in a fixed table, one per code, which only the control thread touches.
+ * Raising a code updates the table and queues a copy of the record. A writer thread
+ * coalesces the queued copies, and once per DTC_FLUSH_PERIOD_MS appends the records that
+ * changed to the file, so a code raised every cycle costs one entry per period.
+ *
+ * The file is append-only: each entry holds a whole record and a CRC, and the last valid
+ * entry of each code wins on load. It is only rewritten, compacted to one entry per code,
+ * once it reaches DTC_COMPACT_ENTRIES or when a torn write is found on load.
+ */
+class DiagnosticManager {
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param path The file the records are persisted to, or nullptr to keep them in memory only.
+     */
+    DiagnosticManager(const char *path = nullptr);
+
+    /**
+     * @brief Destructor. Stops the writer thread if it is running.
+     */
+    ~DiagnosticManager();
+
+    DiagnosticManager(const DiagnosticManager &) = delete;
+    DiagnosticManager &operator=(const DiagnosticManager &) = delete;
+
+    /**
+     * @brief Restores the records from the file. Must be called before start().
+     *
+     * @return true If the file was read, false if it doesn't exist or can't be read.
+     */
+    bool load();
+
+    /**
+     * @brief Raises a code. Called by the control thread.
+     *
+     * @param code The code.
+     * @param state The current state.
+     * @param inputs The current inputs, kept as the freeze frame on the first occurrence.
+     */
+    void raise(DtcCode_e code, FsmStates_e state, const PlcInputs_t &inputs);
+
+    /**
+     * @brief Retrieves the record of a code. Called by the control thread.
+     *
+     * @param code The code.
+     * @param record Overwritten with the record.
+     * @return true If the code was ever raised.
+     */
+    bool getRecord(DtcCode_e code, DtcRecord_t &record);
+
+    /**
+     * @brief Appends the records that changed since the last call to the file.
+     * Called by the writer thread.
+     *
+     * @return size_t The number of entries appended.
+     */
+    size_t flush();
+
+    /**
+     * @brief Starts the writer thread, which calls flush() every DTC_FLUSH_PERIOD_MS.
+     */
+    void start();
+
+    /**
+     * @brief Stops the writer thread and appends the remaining records.
+     */
+    void stop();
+
+    /**
+     * @brief Retrieves the number of occurrences that weren't queued for the writer thread.
+     * The next occurrence of the same code carries the whole record, so only the gap is lost.
+     *
+     * @return uint64_t The number of dropped occurrences.
+     */
+    uint64_t getDropCount() {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Retrieves the native handle of the writer thread, so it can be pinned and prioritized.
+     *
+     * @return std::thread::native_handle_type The handle. Only valid while the thread is running.
+     */
+    std::thread::native_handle_type getThreadHandle() {
+        return writerThread.native_handle();
+    }
+
+    /**
+     * @brief Retrieves the name of a code.
+     *
+     * @param code The code.
+     * @return const char* The name.
+     */
+    static const char *getCodeName(DtcCode_e code);
+
+private:
+    /** A record on its way to the writer thread. */
+    typedef struct DtcEvent_t {
+        DtcCode_e code;
+        DtcRecord_t record;
+    } DtcEvent_t;
+
+    /** A record as stored in the file. */
+    typedef struct DtcEntry_t {
+        uint32_t magic;
+        uint32_t code;
+        DtcRecord_t record;
+        uint32_t crc;
+    } DtcEntry_t;
+
+    const char *path;
+
+    /** The records, owned by the control thread. */
+    DtcRecord_t table[DTC_MAX];
+
+    BoundedQueue<DtcEvent_t, DTC_QUEUE_SIZE> events;
+    std::atomic<uint64_t> dropped;
+
+    /** The latest records seen by the writer thread, and whether they are yet to be appended. */
+    DtcRecord_t stored[DTC_MAX];
+    bool dirty[DTC_MAX];
+    size_t fileEntries;
+
+    /** Writer thread state. */
+    std::thread writerThread;
+    std::atomic<bool> running;
+
+    /**
+     * @brief Fills a file entry, including its CRC.
+     *
+     * @param code The code.
+     * @param record The record.
+     * @param entry Overwritten with the entry.
+     */
+    static void makeEntry(DtcCode_e code, const DtcRecord_t &record, DtcEntry_t &entry);
+
+    /**
+     * @brief Rewrites the file with one entry per raised code, replacing it atomically.
+     *
+     * @return true If the file was rewritten.
+     */
+    bool compact();
+
+    /**
+     * @brief Calls flush() until stop() is called.
+     */
+    void run();
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include <chrono>
+
+#include "fsm.h"
+#include "hal.h"
+#include "controller.h"
+#include "log.h"
+
+/**
+ * Parameters of the embedded build, fixed at compile time since there is no command line.
+ * Can be overridden with -D.
+ */
+#ifndef EMBEDDED_MIN_VOLTAGE
+#define EMBEDDED_MIN_VOLTAGE 20.0f
+#endif
+#ifndef EMBEDDED_TEMPERATURE_SETPOINT
+#define EMBEDDED_TEMPERATURE_SETPOINT 25.0f
+#endif
+#ifndef EMBEDDED_CYCLE_PERIOD_MS
+#define EMBEDDED_CYCLE_PERIOD_MS 10
+#endif
+
+/**
+ * @brief Entry point of the embedded build. Runs the state machine in a single-threaded super loop,
+ * with the CAN transmission and the log written out between cycles.
+ */
+int main() {
+    Parameters_t params = {EMBEDDED_MIN_VOLTAGE, EMBEDDED_TEMPERATURE_SETPOINT};
+    HardwareManager hal = HardwareManager();
+    ControlManager controller = ControlManager(params.temperatureSetpoint,
+        {CONTROLLER_DEFAULT_KP, CONTROLLER_DEFAULT_KI, CONTROLLER_DEFAULT_KD}, EMBEDDED_CYCLE_PERIOD_MS / 1000.0f);
+    StateManager fsm = StateManager(params, &hal, &controller);
+
+    const std::chrono::milliseconds period(EMBEDDED_CYCLE_PERIOD_MS);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + period;
+    CanFrame_t frame = {};
+
+    fsm.initialize();
+
+    while (true) {
+        fsm.handleCurrentState();
+
+        /** Hand the queued frames to the CAN driver. */
+        while (hal.popTransmitCanFrame(frame)) {
+            /** Call the underlying CAN driver to transmit the frame. */
+        }
+
+        LogManager::flush();
+
+        /** Wait for the next period. On a microcontroller, this would sleep until the timer interrupt. */
+        while (std::chrono::steady_clock::now() < deadline) {
+        }
+        deadline += period;
+    }
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <iostream>
+
+#include "events.h"
+
+/**
+ * @brief Constructor.
+ */
+EventManager::EventManager() : epollFd(-1), canRxFd(-1), inputChangeFd(-1), timerFd(-1), sampleFd(-1) {}
+
+/**
+ * @brief Destructor. Closes the file descriptors.
+ */
+EventManager::~EventManager() {
+    for (int fd : {epollFd, canRxFd, inputChangeFd, timerFd, sampleFd}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+/**
+ * @brief Creates the file descriptors.
+ *
+ * The epoll data of each file descriptor is the EventSource_e it reports.
+ *
+ * @return true If the event loop is ready.
+ */
+bool EventManager::initialize() {
+    struct epoll_event event = {};
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    canRxFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    inputChangeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    sampleFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (epollFd < 0 || canRxFd < 0 || inputChangeFd < 0 || timerFd < 0 || sampleFd < 0) {
+        std::cerr << "Failed to create the event loop: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    event.events = EPOLLIN;
+    event.data.u32 = EVENT_CAN_RX;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, canRxFd, &event);
+    event.data.u32 = EVENT_INPUT_CHANGE;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, inputChangeFd, &event);
+    event.data.u32 = EVENT_TIMEOUT;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &event);
+    event.data.u32 = EVENT_INPUT_SAMPLE;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, sampleFd, &event);
+
+    return true;
+}
+
+/**
+ * @brief Wakes up the main loop. Safe to call from any thread.
+ *
+ * @param source The source of the event. Must be EVENT_CAN_RX or EVENT_INPUT_CHANGE.
+ */
+void EventManager::signal(EventSource_e source) {
+    uint64_t value = 1;
+    int fd = source == EVENT_CAN_RX ? canRxFd : inputChangeFd;
+
+    if (fd >= 0) {
+        (void)write(fd, &value, sizeof(value));
+    }
+}
+
+/**
+ * @brief Starts waking up the loop with EVENT_INPUT_SAMPLE every sample period.
+ * The timer keeps running between waits, so samples don't drift with the loop.
+ *
+ * @param period The sample period.
+ */
+void EventManager::startSampling(std::chrono::microseconds period) {
+    struct itimerspec timer = {};
+    int64_t periodNs = std::chrono::duration_cast<std::chrono::nanoseconds>(period).count();
+
+    if (sampleFd < 0 || periodNs <= 0) {
+        return;
+    }
+
+    timer.it_value.tv_sec = periodNs / 1000000000;
+    timer.it_value.tv_nsec = periodNs % 1000000000;
+    timer.it_interval = timer.it_value;
+    timerfd_settime(sampleFd, 0, &timer, nullptr);
+}
+
+/**
+ * @brief Blocks until an event is signalled or the deadline expires.
+ *
+ * The timer is armed with an absolute CLOCK_MONOTONIC time, which is
+ * the clock behind std::chrono::steady_clock.
+ *
+ * @param deadline The time to wake up at, at the latest.
+ * @return uint32_t The EventSource_e flags that woke up the loop.
+ */
+uint32_t EventManager::waitUntil(std::chrono::steady_clock::time_point deadline) {
+    struct epoll_event events[4];
+    struct itimerspec timer = {};
+    uint32_t sources = EVENT_NONE;
+    int64_t deadlineNs = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+
+    if (epollFd < 0) {
+        return EVENT_TIMEOUT;
+    }
+
+    /** An absolute time of zero would disarm the timer, so expire it one nanosecond in. */
+    if (deadlineNs <= 0) {
+        deadlineNs = 1;
+    }
+    timer.it_value.tv_sec = deadlineNs / 1000000000;
+    timer.it_value.tv_nsec = deadlineNs % 1000000000;
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &timer, nullptr);
+
+    int count = -1;
+    do {
+        count = epoll_wait(epollFd, events, 4, -1);
+    } while (count < 0 && errno == EINTR);
+
+    for (int i = 0; i < count; i++) {
+        sources |= events[i].data.u32;
+    }
+
+    /** Reset whatever fired, so that the next wait blocks again. */
+    if (sources & EVENT_CAN_RX) {
+        drain(canRxFd);
+    }
+    if (sources & EVENT_INPUT_CHANGE) {
+        drain(inputChangeFd);
+    }
+    if (sources & EVENT_TIMEOUT) {
+        drain(timerFd);
+    }
+    if (sources & EVENT_INPUT_SAMPLE) {
+        drain(sampleFd);
+    }
+
+    return sources;
+}
+
+/**
+ * @brief Reads an eventfd or timerfd to reset it.
+ *
+ * @param fd The file descriptor.
+ */
+void EventManager::drain(int fd) {
+    uint64_t value = 0;
+    (void)read(fd, &value, sizeof(value));
+}
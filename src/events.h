@@ -0,0 +1,92 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief Describes the sources that can wake up the main loop.
+ * Values are bit flags, so several can be reported at once.
+ */
+typedef enum EventSource_e {
+    EVENT_NONE = 0,
+    /** A CAN frame was pushed onto the reception queue. */
+    EVENT_CAN_RX = 1 << 0,
+    /** A switch input changed. */
+    EVENT_INPUT_CHANGE = 1 << 1,
+    /** The wait deadline expired. */
+    EVENT_TIMEOUT = 1 << 2,
+    /** The inputs are due to be sampled. */
+    EVENT_INPUT_SAMPLE = 1 << 3
+} EventSource_e;
+
+/**
+ * @brief Lets the main loop sleep until something happens, instead of running every tick.
+ *
+ * Each source is an eventfd that producers signal from any thread, and the deadline
+ * is a timerfd. All of them are waited on together with epoll.
+ *
+ * The switch inputs are read from the PLC registers, which can't wake anything up, so
+ * another timerfd wakes the loop periodically to sample them. Sampling is much cheaper
+ * than a state machine cycle, and bounds the latency of a switch change to a sample period.
+ */
+class EventManager {
+public:
+    /**
+     * @brief Constructor.
+     */
+    EventManager();
+
+    /**
+     * @brief Destructor. Closes the file descriptors.
+     */
+    ~EventManager();
+
+    EventManager(const EventManager &) = delete;
+    EventManager &operator=(const EventManager &) = delete;
+
+    /**
+     * @brief Creates the file descriptors.
+     *
+     * @return true If the event loop is ready.
+     */
+    bool initialize();
+
+    /**
+     * @brief Wakes up the main loop. Safe to call from any thread.
+     *
+     * @param source The source of the event. Must be EVENT_CAN_RX or EVENT_INPUT_CHANGE.
+     */
+    void signal(EventSource_e source);
+
+    /**
+     * @brief Starts waking up the loop with EVENT_INPUT_SAMPLE every sample period.
+     *
+     * @param period The sample period.
+     */
+    void startSampling(std::chrono::microseconds period);
+
+    /**
+     * @brief Blocks until an event is signalled or the deadline expires.
+     *
+     * @param deadline The time to wake up at, at the latest.
+     * @return uint32_t The EventSource_e flags that woke up the loop.
+     */
+    uint32_t waitUntil(std::chrono::steady_clock::time_point deadline);
+
+private:
+    int epollFd;
+    int canRxFd;
+    int inputChangeFd;
+    int timerFd;
+    int sampleFd;
+
+    /**
+     * @brief Reads an eventfd or timerfd to reset it.
+     *
+     * @param fd The file descriptor.
+     */
+    static void drain(int fd);
+};
+
+#endif
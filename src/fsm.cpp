@@ -1,22 +1,52 @@
-#include <iostream>
-#include <stdio.h>
-
 #include "fsm.h"
+#include "log.h"
+#include "tripwire.h"
+
+/** The embedded build leaves out the collaborators that need an operating system. */
+#ifndef EAE_EMBEDDED
+#include "metrics.h"
+#include "watchdog.h"
+#include "dtc.h"
+#include "snapshot.h"
+#include "tasks.h"
+#endif
 
 /**
- * @brief Initializes the finite state machine.
+ * @brief Initializes the finite state machine, resuming from the last snapshot if there is a recent one.
  */
 void StateManager::initialize() {
     hal->initialize();
     controller->initialize();
 
     state = STATE_BOOT;
+#ifndef EAE_EMBEDDED
+    if (snapshots != nullptr && warmStart()) {
+        LogManager::log(LOG_INFO, "Resuming from snapshot.");
+    }
+#endif
 }
 
 /**
  * @brief Executes the current state.
  */
 void StateManager::handleCurrentState() {
+    /** Nothing in the cycle may allocate. */
+    AllocationTripwire::arm();
+
+#ifndef EAE_EMBEDDED
+    if (metrics != nullptr) {
+        metrics->count(METRIC_CYCLES);
+    }
+
+    /** When the tasks are split, the watchdog times the control task instead. */
+    if (watchdog != nullptr) {
+        if (tasks == nullptr) {
+            watchdog->beginCycle();
+        }
+        checkWatchdog();
+    }
+#endif
+
     switch (state) {
         case STATE_BOOT:
             boot();
@@ -34,10 +64,27 @@ void StateManager::handleCurrentState() {
             active();
             break;
         default:
-            std::cout << "State machine set to invalid state." << std::endl;
-            state = STATE_FATAL_ERROR;
+            LogManager::log(LOG_ERROR, "State machine set to invalid state.");
+            transition(STATE_FATAL_ERROR);
             break;
     }
+
+#ifndef EAE_EMBEDDED
+    /** When the tasks are split, the background task takes the snapshots. */
+    if (tasks != nullptr) {
+        tasks->publishState(state, activation);
+    } else if (snapshots != nullptr) {
+        takeSnapshot();
+    }
+#endif
+
+    AllocationTripwire::disarm();
+
+#ifndef EAE_EMBEDDED
+    if (watchdog != nullptr && tasks == nullptr) {
+        watchdog->endCycle();
+    }
+#endif
 }
 
 /**
@@ -49,6 +96,194 @@ FsmStates_e StateManager::getState() {
     return state;
 }
 
+/**
+ * @brief Whether the current state must run on a fixed period, or only
+ * needs to run when an input changes or a CAN frame arrives.
+ * 
+ * The idle state only reacts to the switches and CAN frames, and nothing
+ * leaves the fatal error state. Every other state runs the control loop
+ * or moves on by itself.
+ * 
+ * @return true If the current state runs on a fixed period.
+ */
+bool StateManager::needsPeriodicExecution() {
+    return state != STATE_IDLE && state != STATE_FATAL_ERROR;
+}
+
+#ifndef EAE_EMBEDDED
+/**
+ * @brief Resumes from the last snapshot.
+ *
+ * Only the idle, ignition and active states are resumed. The boot state hasn't done
+ * anything worth keeping, and a fatal error is what the restart is meant to recover from.
+ * The resumed state's guards run on the first cycle, so stale outputs last one cycle at most.
+ *
+ * @return true If there was a snapshot to resume from.
+ */
+bool StateManager::warmStart() {
+    Snapshot_t snapshot = {};
+
+    if (snapshots->restore(snapshot) == false ||
+        (snapshot.state != STATE_IDLE && snapshot.state != STATE_IGNITION && snapshot.state != STATE_ACTIVE)) {
+        return false;
+    }
+
+    controller->restoreState(snapshot.controller);
+    hal->setOutputs(snapshot.outputs);
+    hal->flushOutputs();
+    state = snapshot.state;
+
+    return true;
+}
+
+/**
+ * @brief Hands the current state, controller internals and outputs to the snapshot writer.
+ */
+void StateManager::takeSnapshot() {
+    Snapshot_t snapshot = {};
+
+    snapshot.state = state;
+    controller->saveState(snapshot.controller);
+    hal->retrieveOutputs(snapshot.outputs);
+    snapshots->post(snapshot);
+}
+#endif
+
+/**
+ * @brief Moves to a new state, counting the transition.
+ *
+ * @param next The state to enter.
+ */
+void StateManager::transition(FsmStates_e next) {
+#ifndef EAE_EMBEDDED
+    if (metrics != nullptr && state > STATE_MIN && state < STATE_MAX) {
+        metrics->countTransition(state, next);
+    }
+#endif
+    state = next;
+}
+
+#ifndef EAE_EMBEDDED
+/**
+ * @brief Reacts to the watchdog before a cycle runs.
+ *
+ * Too many consecutive deadline misses are unrecoverable. A single stalled cycle
+ * only disables the equipment, so the ignition sequence is restarted to enable it again.
+ */
+void StateManager::checkWatchdog() {
+    PlcInputs_t inputs = {};
+
+    if (watchdog->isTripped()) {
+        if (state != STATE_FATAL_ERROR) {
+            LogManager::log(LOG_ERROR, "Watchdog tripped, entering fatal error state.");
+            if (diagnostics != nullptr) {
+                hal->retrieveInputs(inputs);
+                diagnostics->raise(DTC_WATCHDOG_TRIPPED, state, inputs);
+            }
+            /** The watchdog keeps the safe outputs forced for good, but left the display to this thread. */
+            hal->setOutputs(watchdog->getConfig().safeOutputs);
+            hal->flushOutputs();
+            transition(STATE_FATAL_ERROR);
+        }
+        return;
+    }
+
+    if (watchdog->consumeForcedOutputs() && (state == STATE_IGNITION || state == STATE_ACTIVE)) {
+        /** Take the safe outputs over from the watchdog, which forced them without the display. */
+        hal->setOutputs(watchdog->getConfig().safeOutputs);
+        hal->releaseSafeOutputs();
+        hal->flushOutputs();
+
+        if (diagnostics != nullptr) {
+            hal->retrieveInputs(inputs);
+            diagnostics->raise(DTC_DEADLINE_MISSED, state, inputs);
+        }
+
+        LogManager::log(LOG_WARNING, "Deadline missed, entering idle state.");
+        transition(STATE_IDLE);
+    }
+}
+
+/**
+ * @brief Counts the cycles run on degraded or failed temperature sensors, and raises
+ * their trouble code when the health gets worse.
+ *
+ * The health values are ordered by severity. A sensor that stays out of the vote only
+ * raises its code once, and no majority or no usable sensor share a code.
+ *
+ * @param health The fusion health of the cycle.
+ * @param inputs The inputs of the cycle.
+ */
+void StateManager::checkFusionHealth(FusionHealth_e health, const PlcInputs_t &inputs) {
+    if (metrics != nullptr && health == FUSION_DEGRADED) {
+        metrics->count(METRIC_FUSION_DEGRADED);
+    } else if (metrics != nullptr && health >= FUSION_NO_MAJORITY) {
+        metrics->count(METRIC_FUSION_FAILED);
+    }
+
+    if (health > fusionHealth && health == FUSION_DEGRADED) {
+        LogManager::log(LOG_WARNING, "Temperature sensor left out of the vote.");
+        if (diagnostics != nullptr) {
+            diagnostics->raise(DTC_SENSOR_DEGRADED, state, inputs);
+        }
+    } else if (health > fusionHealth && fusionHealth < FUSION_NO_MAJORITY) {
+        LogManager::log(LOG_ERROR, "Temperature sensors have no majority, or none is usable.");
+        if (diagnostics != nullptr) {
+            diagnostics->raise(DTC_SENSOR_FAILED, state, inputs);
+        }
+    }
+
+    fusionHealth = health;
+}
+#endif
+
+/**
+ * @brief Counts a failed guard in the current state, and raises its trouble code.
+ * An open ignition switch is a normal shutdown, so it doesn't raise a code.
+ *
+ * @param reason The reason the guard failed.
+ * @param inputs The inputs the guard failed on.
+ */
+void StateManager::guardFailed(GuardFailure_e reason, const PlcInputs_t &inputs) {
+#ifndef EAE_EMBEDDED
+    if (metrics != nullptr) {
+        metrics->countGuardFailure(state, reason);
+    }
+
+    if (diagnostics != nullptr) {
+        if (reason == GUARD_UNDERVOLTAGE) {
+            diagnostics->raise(DTC_UNDERVOLTAGE, state, inputs);
+        } else if (reason == GUARD_COOLANT_DRY) {
+            diagnostics->raise(DTC_COOLANT_DRY, state, inputs);
+        }
+    }
+#else
+    (void)reason;
+    (void)inputs;
+#endif
+}
+
+/**
+ * @brief Handles a received CAN frame.
+ *
+ * Frames that can't be valid, ie. with more than CAN_MESSAGE_LEN bytes or an ID wider
+ * than 29 bits, are rejected. No received message is defined yet, so every valid frame
+ * has an unknown ID and is ignored. Both are counted.
+ *
+ * @param frame The frame.
+ */
+void StateManager::handleCanFrame(const CanFrame_t &frame) {
+#ifndef EAE_EMBEDDED
+    bool malformed = frame.dlc > CAN_MESSAGE_LEN || frame.id > CAN_MAX_EXTENDED_ID;
+
+    if (metrics != nullptr) {
+        metrics->count(malformed ? METRIC_CAN_RX_MALFORMED : METRIC_CAN_RX_UNKNOWN);
+    }
+#else
+    (void)frame;
+#endif
+}
+
 /**
  * @brief Handler for state STATE_BOOT.
  */
@@ -58,14 +293,14 @@ void StateManager::boot() {
     /** Perform any self-tests, checks, etc. */
     selfTestsOk = true;
     if (selfTestsOk == false) {
-        std::cout << "Self-tests failed." << std::endl;
-        state = STATE_FATAL_ERROR;
+        LogManager::log(LOG_ERROR, "Self-tests failed.");
+        transition(STATE_FATAL_ERROR);
         return;
     }
 
     /** Go to idle state. */
-    state = STATE_IDLE;
-    std::cout << "Entering idle state." << std::endl;
+    transition(STATE_IDLE);
+    LogManager::log(LOG_INFO, "Entering idle state.");
     return;
 }
 
@@ -82,35 +317,32 @@ void StateManager::fatalError() {
 void StateManager::idle() {
     PlcInputs_t inputs = {};
     PlcOutputs_t outputs = {};
-    char *canMessage = nullptr;
+    CanFrame_t canFrame = {};
 
     /** Retrieve PLC inputs and outputs. */
     hal->retrieveInputs(inputs);
     hal->retrieveOutputs(outputs);
 
     /** Handle new received CAN messages. */
-    hal->receiveNextCanMessage(canMessage);
-    while (canMessage != nullptr) {
-        /** Handle message. */
-
-        hal->receiveNextCanMessage(canMessage);
+    while (hal->receiveCanFrame(canFrame)) {
+        handleCanFrame(canFrame);
     }
 
     /** Enter ignition state upon ignition. */
     if (inputs.ignitionClosed == true) {
-        std::cout << "Entering ignition state." << std::endl;
-        state = STATE_IGNITION;
+        LogManager::log(LOG_INFO, "Entering ignition state.");
+        transition(STATE_IGNITION);
         return;
     }
 
     /** Update display state. */
     if (inputs.levelSwitchClosed == true) {
         outputs.displayState.coolantStatus = SUFFICIENT;
-        snprintf(outputs.displayState.message, DISPLAY_MESSAGE_SIZE, "Ready for ignition.");
+        outputs.displayState.messageId = DISPLAY_MESSAGE_READY_FOR_IGNITION;
         
     } else {
         outputs.displayState.coolantStatus = DRY;
-        snprintf(outputs.displayState.message, DISPLAY_MESSAGE_SIZE, "Coolant refill required.");
+        outputs.displayState.messageId = DISPLAY_MESSAGE_COOLANT_REFILL_REQUIRED;
     }
 
     /** Set outputs. */
@@ -130,21 +362,24 @@ void StateManager::ignition() {
     hal->retrieveOutputs(outputs);
 
     /** Pre-ignition guards. */
-    /** Under-voltage. */
-    if (inputs.supplyVoltage < params.minVoltage) {
-        std::cout << "Supply voltage is less than the minimum of: " << params.minVoltage << std::endl;
+    /** Under-voltage. A reading that can't be compared, ie. NaN, fails too. */
+    if ((inputs.supplyVoltage >= params.minVoltage) == false) {
+        LogManager::log(LOG_WARNING, "Supply voltage is less than the minimum of: ", params.minVoltage);
+        guardFailed(GUARD_UNDERVOLTAGE, inputs);
         goto exit;
     }
 
     /** Coolant level. */
     if (inputs.levelSwitchClosed == false) {
-        std::cout << "Coolant levels are not sufficient." << std::endl;
+        LogManager::log(LOG_WARNING, "Coolant levels are not sufficient.");
+        guardFailed(GUARD_COOLANT_DRY, inputs);
         goto exit;
     }
 
     /** Ignition switch. */
     if (inputs.ignitionClosed == false) {
-        std::cout << "Ignition disabled." << std::endl;
+        LogManager::log(LOG_WARNING, "Ignition disabled.");
+        guardFailed(GUARD_IGNITION_OFF, inputs);
         goto exit;
     }
 
@@ -166,19 +401,35 @@ void StateManager::ignition() {
     hal->setOutputs(outputs);
     hal->flushOutputs();
 
-    std::cout << "Entering active state." << std::endl;
-    state = STATE_ACTIVE;
+    /**
+     * Start the PID loop and the fusion from scratch, the last run's integrator and readings are stale.
+     * When the tasks are split, the control task resets it on the new activation.
+     */
+    activation++;
+    fusionHealth = FUSION_HEALTHY;
+    if (tasks == nullptr) {
+        controller->reset();
+        if (fusion != nullptr) {
+            fusion->reset();
+        }
+    }
+
+    LogManager::log(LOG_INFO, "Entering active state.");
+    transition(STATE_ACTIVE);
     return;
 
 exit:
     /** Disable the equipment. */
+    outputs.fanEnable = false;
     outputs.fanPowerPercent = 0;
+    outputs.pumpEnable = false;
+    outputs.pumpIgnition = false;
     outputs.pumpPowerPercent = 0;
     hal->setOutputs(outputs);
     hal->flushOutputs();
 
-    std::cout << "Entering idle state." << std::endl;
-    state = STATE_IDLE;
+    LogManager::log(LOG_INFO, "Entering idle state.");
+    transition(STATE_IDLE);
     return;
 }
 
@@ -188,57 +439,77 @@ exit:
 void StateManager::active() {
     PlcInputs_t inputs = {};
     PlcOutputs_t outputs = {};
-    char *canMessage = nullptr;
+    CanFrame_t canFrame = {};
+    FusedTemperature_t fused = {};
 
     /** Retrieve PLC inputs and outputs. */
     hal->retrieveInputs(inputs);
     hal->retrieveOutputs(outputs);
 
     /** Handle new received CAN messages. */
-    hal->receiveNextCanMessage(canMessage);
-    while (canMessage != nullptr) {
-        /** Handle message. */
-
-        hal->receiveNextCanMessage(canMessage);
+    while (hal->receiveCanFrame(canFrame)) {
+        handleCanFrame(canFrame);
     }
 
     /** Guards. */
     /** Under-voltage. */
-    if (inputs.supplyVoltage < params.minVoltage) {
-        std::cout << "Supply voltage is less than the minimum of: " << params.minVoltage << std::endl;
+    if ((inputs.supplyVoltage >= params.minVoltage) == false) {
+        LogManager::log(LOG_WARNING, "Supply voltage is less than the minimum of: ", params.minVoltage);
+        guardFailed(GUARD_UNDERVOLTAGE, inputs);
         goto exit;
     }
 
     /** Coolant level. */
     if (inputs.levelSwitchClosed == false) {
-        std::cout << "Coolant levels are not sufficient." << std::endl;
+        LogManager::log(LOG_WARNING, "Coolant levels are not sufficient.");
         outputs.displayState.coolantStatus = DRY;
+        guardFailed(GUARD_COOLANT_DRY, inputs);
         goto exit;
     }
 
     /** Ignition switch. */
     if (inputs.ignitionClosed == false) {
-        std::cout << "Ignition disabled." << std::endl;
+        LogManager::log(LOG_WARNING, "Ignition disabled.");
+        guardFailed(GUARD_IGNITION_OFF, inputs);
         goto exit;
     }
 
-    /** Update the controller. */
-    controller->process(inputs.temperature, outputs.fanPowerPercent, outputs.pumpPowerPercent);
+    /** Update the controller, unless the control task runs it at its own rate. */
+    if (tasks == nullptr) {
+        if (fusion != nullptr) {
+            fusion->fuse(inputs, fused);
+            controller->process(fused, outputs.fanPowerPercent, outputs.pumpPowerPercent);
+        } else {
+            controller->process(inputs.temperature, outputs.fanPowerPercent, outputs.pumpPowerPercent);
+        }
+        hal->setOutputs(outputs);
+    }
+
+#ifndef EAE_EMBEDDED
+    /** When the tasks are split, the control task keeps the worst health since the last cycle. */
+    if (tasks != nullptr) {
+        checkFusionHealth(tasks->consumeFusionHealth(), inputs);
+    } else if (fusion != nullptr) {
+        checkFusionHealth(fused.health, inputs);
+    }
+#endif
 
     /** Update the outputs. */
-    hal->setOutputs(outputs);
     hal->flushOutputs();
     
     return;
 
 exit:
     /** Disable the equipment. */
+    outputs.fanEnable = false;
     outputs.fanPowerPercent = 0;
+    outputs.pumpEnable = false;
+    outputs.pumpIgnition = false;
     outputs.pumpPowerPercent = 0;
     hal->setOutputs(outputs);
     hal->flushOutputs();
 
-    std::cout << "Entering idle state." << std::endl;
-    state = STATE_IDLE;
+    LogManager::log(LOG_INFO, "Entering idle state.");
+    transition(STATE_IDLE);
     return;
 }
\ No newline at end of file
@@ -4,6 +4,12 @@
 #include "hal.h"
 #include "controller.h"
 
+class MetricsManager;
+class WatchdogManager;
+class DiagnosticManager;
+class SnapshotManager;
+class TaskManager;
+
 /**
  * @brief Describes possible finite-state-machine states.
 */
@@ -24,6 +30,20 @@ typedef enum FsmStates_e {
     STATE_MAX
 } FsmStates_e;
 
+/**
+ * @brief Describes the reasons a state guard can fail.
+ */
+typedef enum GuardFailure_e {
+    /** The supply voltage is below the minimum. */
+    GUARD_UNDERVOLTAGE,
+    /** The level switch reports that the coolant is dry. */
+    GUARD_COOLANT_DRY,
+    /** The ignition switch is open. */
+    GUARD_IGNITION_OFF,
+
+    GUARD_MAX
+} GuardFailure_e;
+
 /**
  * @brief The parameters passed into the program via command line.
  */
@@ -42,11 +62,15 @@ public:
     /**
      * @brief Constructor.
      */
-    StateManager(Parameters_t params, HardwareManager *hal, ControlManager *controller)
-        : params(params), hal(hal), controller(controller) {}
+    StateManager(Parameters_t params, HardwareManager *hal, ControlManager *controller,
+                 MetricsManager *metrics = nullptr, WatchdogManager *watchdog = nullptr,
+                 DiagnosticManager *diagnostics = nullptr, SnapshotManager *snapshots = nullptr)
+        : params(params), hal(hal), controller(controller), metrics(metrics), watchdog(watchdog),
+          diagnostics(diagnostics), snapshots(snapshots), tasks(nullptr), fusion(nullptr),
+          activation(0), fusionHealth(FUSION_HEALTHY) {}
 
     /**
-     * @brief Begins the finite state machine.
+     * @brief Begins the finite state machine, resuming from the last snapshot if there is a recent one.
      */
     void initialize();
 
@@ -61,6 +85,35 @@ public:
      * @return FsmStates_e The current state.
      */
     FsmStates_e getState();
+
+    /**
+     * @brief Whether the current state must run on a fixed period, or only
+     * needs to run when an input changes or a CAN frame arrives.
+     * 
+     * @return true If the current state runs on a fixed period.
+     */
+    bool needsPeriodicExecution();
+
+    /**
+     * @brief Hands the control loop over to a control task running at its own rate.
+     * The state machine keeps the guards, transitions and display, and publishes its state
+     * to the tasks at the end of each cycle. Must be called before initialize().
+     *
+     * @param tasks The tasks.
+     */
+    void attachTasks(TaskManager *tasks) {
+        this->tasks = tasks;
+    }
+
+    /**
+     * @brief Feeds the controller with the temperature fused from several sensors,
+     * rather than the main temperature input alone. Must be called before initialize().
+     *
+     * @param fusion The fusion.
+     */
+    void attachFusion(FusionManager *fusion) {
+        this->fusion = fusion;
+    }
     
 private:
     Parameters_t params;
@@ -72,6 +125,78 @@ private:
     HardwareManager *hal;
     ControlManager *controller;
 
+    /** Optional counters, may be nullptr. */
+    MetricsManager *metrics;
+
+    /** Optional cycle deadline supervisor, may be nullptr. */
+    WatchdogManager *watchdog;
+
+    /** Optional diagnostic trouble code store, may be nullptr. */
+    DiagnosticManager *diagnostics;
+
+    /** Optional snapshot store for warm restarts, may be nullptr. */
+    SnapshotManager *snapshots;
+
+    /** Optional tasks running the control loop, may be nullptr. */
+    TaskManager *tasks;
+
+    /** Optional fusion of several temperature sensors, may be nullptr. */
+    FusionManager *fusion;
+
+    /** Number of times the equipment was started. */
+    uint32_t activation;
+
+    /** The fusion health of the last active cycle, so that a code is only raised when it gets worse. */
+    FusionHealth_e fusionHealth;
+
+    /**
+     * @brief Reacts to the watchdog before a cycle runs.
+     */
+    void checkWatchdog();
+
+    /**
+     * @brief Counts the cycles run on degraded or failed temperature sensors, and raises
+     * their trouble code when the health gets worse.
+     *
+     * @param health The fusion health of the cycle.
+     * @param inputs The inputs of the cycle.
+     */
+    void checkFusionHealth(FusionHealth_e health, const PlcInputs_t &inputs);
+
+    /**
+     * @brief Handles a received CAN frame.
+     *
+     * @param frame The frame.
+     */
+    void handleCanFrame(const CanFrame_t &frame);
+
+    /**
+     * @brief Resumes from the last snapshot.
+     *
+     * @return true If there was a snapshot to resume from.
+     */
+    bool warmStart();
+
+    /**
+     * @brief Hands the current state, controller internals and outputs to the snapshot writer.
+     */
+    void takeSnapshot();
+
+    /**
+     * @brief Moves to a new state, counting the transition.
+     *
+     * @param next The state to enter.
+     */
+    void transition(FsmStates_e next);
+
+    /**
+     * @brief Counts a failed guard in the current state, and raises its trouble code.
+     *
+     * @param reason The reason the guard failed.
+     * @param inputs The inputs the guard failed on.
+     */
+    void guardFailed(GuardFailure_e reason, const PlcInputs_t &inputs);
+
     /**
      * @brief Handler for state STATE_BOOT.
      */
@@ -0,0 +1,124 @@
+#include <cmath>
+
+#include "fusion.h"
+
+/**
+ * @brief Constructor.
+ *
+ * @param config The parameters of the fusion.
+ */
+FusionManager::FusionManager(FusionConfig_t config)
+    : config(config), lastReadings(), hasLastReading(), frozenCycles(), lastFused(NAN) {
+    if (this->config.sensorCount < 1) {
+        this->config.sensorCount = 1;
+    } else if (this->config.sensorCount > FUSION_MAX_SENSORS) {
+        this->config.sensorCount = FUSION_MAX_SENSORS;
+    }
+}
+
+/**
+ * @brief Forgets the previous readings, so that the next fuse() call starts from scratch.
+ */
+void FusionManager::reset() {
+    for (int i = 0; i < FUSION_MAX_SENSORS; i++) {
+        lastReadings[i] = 0.0f;
+        hasLastReading[i] = 0;
+        frozenCycles[i] = 0;
+    }
+    lastFused = NAN;
+}
+
+/**
+ * @brief Fuses the temperature readings of a cycle.
+ *
+ * The per-sensor checks combine comparisons arithmetically instead of branching on them,
+ * and the median is taken with a sorting network of min/max, with the rejected readings
+ * sorted to the end as +infinity.
+ *
+ * @param inputs The inputs of the cycle.
+ * @param fused Overwritten with the fused temperature.
+ */
+void FusionManager::fuse(const PlcInputs_t &inputs, FusedTemperature_t &fused) {
+    float readings[FUSION_MAX_SENSORS];
+    float sorted[FUSION_MAX_SENSORS];
+    uint8_t usable[FUSION_MAX_SENSORS];
+    uint8_t frozen[FUSION_MAX_SENSORS];
+    float maxStep = config.maxRateCPerS * config.periodS;
+    uint32_t staleCycles = config.staleCycles > 0 ? config.staleCycles : UINT32_MAX;
+    int usableCount = 0;
+
+    readings[0] = inputs.temperature;
+    for (int i = 1; i < FUSION_MAX_SENSORS; i++) {
+        readings[i] = inputs.redundantTemperatures[i - 1];
+    }
+
+    /** Reject the readings that are out of range, too fast or frozen. NaN fails every comparison. */
+    for (int i = 0; i < FUSION_MAX_SENSORS; i++) {
+        float reading = readings[i];
+        uint8_t fitted = i < config.sensorCount;
+        uint8_t inRange = (reading >= FUSION_MIN_VALID_C) & (reading <= FUSION_MAX_VALID_C);
+        uint8_t plausible = (hasLastReading[i] == 0) | (std::fabs(reading - lastReadings[i]) <= maxStep);
+        uint8_t fresh = frozenCycles[i] < staleCycles;
+
+        usable[i] = fitted & inRange & plausible & fresh;
+        frozen[i] = hasLastReading[i] & (reading == lastReadings[i]);
+        fused.flags[i] = (uint8_t)(fitted * ((inRange ^ 1U) * FUSION_FLAG_INVALID |
+                                             (inRange & (plausible ^ 1U)) * FUSION_FLAG_RATE |
+                                             (fresh ^ 1U) * FUSION_FLAG_STALE));
+        sorted[i] = usable[i] ? reading : INFINITY;
+        usableCount += usable[i];
+
+        /** Keep following a sensor that jumped, so that a genuine fast change is only rejected once. */
+        lastReadings[i] = inRange ? reading : lastReadings[i];
+        hasLastReading[i] |= inRange;
+    }
+
+    /** Odd-even transposition sort. */
+    for (int pass = 0; pass < FUSION_MAX_SENSORS; pass++) {
+        for (int i = pass & 1; i + 1 < FUSION_MAX_SENSORS; i += 2) {
+            float low = std::fmin(sorted[i], sorted[i + 1]);
+            float high = std::fmax(sorted[i], sorted[i + 1]);
+            sorted[i] = low;
+            sorted[i + 1] = high;
+        }
+    }
+
+    /** Vote: the readings close to the median agree. */
+    int lower = usableCount > 0 ? (usableCount - 1) / 2 : 0;
+    float median = 0.5f * (sorted[lower] + sorted[usableCount / 2]);
+    float sum = 0.0f;
+    int agreeingCount = 0;
+
+    fused.agreeingMask = 0;
+    for (int i = 0; i < FUSION_MAX_SENSORS; i++) {
+        uint8_t agrees = usable[i] & (std::fabs(readings[i] - median) <= config.voteToleranceC);
+
+        sum += agrees ? readings[i] : 0.0f;
+        agreeingCount += agrees;
+        fused.agreeingMask |= (uint16_t)(agrees << i);
+        fused.flags[i] |= (uint8_t)((usable[i] & (agrees ^ 1U)) * FUSION_FLAG_OUTVOTED);
+    }
+
+    /** Without a majority, there is no telling which sensors are right, so cool for the hottest one. */
+    if (usableCount == 0) {
+        fused.temperature = NAN;
+        fused.health = FUSION_FAILED;
+    } else if (agreeingCount * 2 > usableCount) {
+        fused.temperature = sum / agreeingCount;
+        fused.health = agreeingCount == config.sensorCount ? FUSION_HEALTHY : FUSION_DEGRADED;
+    } else {
+        fused.temperature = sorted[usableCount - 1];
+        fused.health = FUSION_NO_MAJORITY;
+    }
+
+    /**
+     * A reading is only counted as frozen while the fused temperature moves,
+     * since a steady plant can legitimately read the same value cycle after cycle.
+     */
+    uint32_t moved = std::isfinite(lastFused) & std::isfinite(fused.temperature) &
+                     (fused.temperature != lastFused);
+    for (int i = 0; i < FUSION_MAX_SENSORS; i++) {
+        frozenCycles[i] = frozen[i] ? frozenCycles[i] + moved : 0;
+    }
+    lastFused = fused.temperature;
+}
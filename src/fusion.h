@@ -0,0 +1,122 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include <cstdint>
+
+#include "hal.h"
+
+/** The main temperature input, IN_2, followed by the spare inputs. */
+#define FUSION_MAX_SENSORS (1 + HAL_REDUNDANT_TEMP_INPUTS)
+
+/** Readings outside of this range can't come from a working sensor, in °C. */
+#define FUSION_MIN_VALID_C -40.0f
+#define FUSION_MAX_VALID_C 150.0f
+
+/** Default fastest plausible rate of change of a reading, in °C per second. */
+#define FUSION_DEFAULT_MAX_RATE_C_PER_S 5.0f
+
+/** Default largest distance to the median for a reading to be counted as agreeing, in °C. */
+#define FUSION_DEFAULT_VOTE_TOLERANCE_C 3.0f
+
+/** Default number of cycles a reading may stay frozen while the fused temperature moves. */
+#define FUSION_DEFAULT_STALE_CYCLES 100
+
+/** Why a sensor was left out of the fused temperature. */
+#define FUSION_FLAG_INVALID 0x1U
+#define FUSION_FLAG_RATE 0x2U
+#define FUSION_FLAG_STALE 0x4U
+#define FUSION_FLAG_OUTVOTED 0x8U
+
+/**
+ * @brief Describes how much the fused temperature can be trusted.
+ */
+typedef enum FusionHealth_e {
+    /** Every sensor agrees. */
+    FUSION_HEALTHY,
+    /** A majority of the usable sensors agrees, but some sensors were left out. */
+    FUSION_DEGRADED,
+    /** The usable sensors disagree, so the hottest reading is used. */
+    FUSION_NO_MAJORITY,
+    /** No sensor is usable. */
+    FUSION_FAILED,
+
+    FUSION_HEALTH_MAX
+} FusionHealth_e;
+
+/**
+ * @brief The parameters of the fusion.
+ */
+typedef struct FusionConfig_t {
+    /** Number of sensors fitted, from 1 to FUSION_MAX_SENSORS. Sensor 0 is IN_2, sensor i is IN_(3 + i). */
+    uint8_t sensorCount;
+    /** The period between two calls to fuse(), in seconds. */
+    float periodS;
+    /** Fastest plausible rate of change of a reading, in °C per second. */
+    float maxRateCPerS;
+    /** Largest distance to the median for a reading to be counted as agreeing, in °C. */
+    float voteToleranceC;
+    /** Number of cycles a reading may stay frozen while the fused temperature moves. 0 disables the check. */
+    uint32_t staleCycles;
+} FusionConfig_t;
+
+/**
+ * @brief The fused temperature and the health of the sensors behind it.
+ */
+typedef struct FusedTemperature_t {
+    /** The mean of the agreeing readings, or NaN if no sensor is usable. */
+    float temperature;
+    FusionHealth_e health;
+    /** Bit i is set if sensor i agreed with the median. */
+    uint16_t agreeingMask;
+    /** Why each sensor was left out, as FUSION_FLAG_* bits. 0 if it agreed. */
+    uint8_t flags[FUSION_MAX_SENSORS];
+} FusedTemperature_t;
+
+/**
+ * @brief Fuses the readings of several temperature sensors into one temperature,
+ * so that a single failed sensor doesn't blind the controller.
+ *
+ * Each cycle, a reading is rejected if it is out of range, jumped faster than the
+ * plant can change, or stayed frozen while the other sensors moved. The median of the
+ * remaining readings is taken, and the readings close to it are averaged.
+ *
+ * The sensors are processed over fixed arrays, with the rejected readings masked out
+ * rather than skipped, so a cycle costs the same whichever sensors fail.
+ */
+class FusionManager {
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param config The parameters of the fusion.
+     */
+    FusionManager(FusionConfig_t config);
+
+    /**
+     * @brief Forgets the previous readings, so that the next fuse() call starts from scratch.
+     */
+    void reset();
+
+    /**
+     * @brief Fuses the temperature readings of a cycle.
+     *
+     * @param inputs The inputs of the cycle.
+     * @param fused Overwritten with the fused temperature.
+     */
+    void fuse(const PlcInputs_t &inputs, FusedTemperature_t &fused);
+
+private:
+    FusionConfig_t config;
+
+    /** The last in-range reading of each sensor. */
+    float lastReadings[FUSION_MAX_SENSORS];
+    uint8_t hasLastReading[FUSION_MAX_SENSORS];
+
+    /** Number of cycles each reading stayed frozen while the fused temperature moved. */
+    uint32_t frozenCycles[FUSION_MAX_SENSORS];
+
+    /** The fused temperature of the last cycle. */
+    float lastFused;
+};
+
+#endif
@@ -1,13 +1,20 @@
 #include <stdio.h>
-#include <iostream>
+#include <string.h>
 
 #include "hal.h"
 
+/** The embedded build leaves out the collaborators that need an operating system. */
+#ifndef EAE_EMBEDDED
+#include "metrics.h"
+#include "events.h"
+#endif
+
 /** Input pins. */
 #define IGNITION_INPUT IN_0
 #define LEVEL_INPUT IN_1
 #define TEMP_INPUT IN_2
 #define SUPPLY_VOLTAGE_INPUT IN_3
+#define REDUNDANT_TEMP_FIRST_INPUT IN_4
 
 /** Output pins. */
 #define PUMP_ENABLE_OUTPUT OUT_0
@@ -18,38 +25,95 @@
 
 /**
  * @brief Constructor
+ * 
+ * @param metrics Optional counters, may be nullptr.
+ * @param events Optional event loop, woken up by received CAN frames
+ * and switch input changes. May be nullptr.
  */
-HardwareManager::HardwareManager() {
+HardwareManager::HardwareManager(MetricsManager *metrics, EventManager *events)
+    : _safeOutputs(),
+      _inputsLock(new HalLock_t()),
+      _outputsLock(new HalLock_t()),
+      _displayLock(new HalLock_t()),
+      _canRxQueue(new BoundedQueue<CanFrame_t, CAN_RX_QUEUE_SIZE>()),
+      _canTxQueue(new BoundedQueue<CanFrame_t, CAN_TX_QUEUE_SIZE>()),
+      _safeOverride(new std::atomic<bool>(false)),
+      _controlInputs(new Mailbox<PlcInputs_t>()),
+      _powerOutputs(new Mailbox<PowerOutputs_t>()),
+      _metrics(metrics), _events(events) {
     _inputs.supplyVoltage = 0.0f;
     _inputs.ignitionClosed = false;
     _inputs.levelSwitchClosed = false;
     _inputs.temperature = 0.0f;
+    for (int i = 0; i < HAL_REDUNDANT_TEMP_INPUTS; i++) {
+        _inputs.redundantTemperatures[i] = 0.0f;
+    }
 
     _outputs.fanEnable = false;
     _outputs.fanPowerPercent = 0;
     _outputs.pumpEnable = false;
     _outputs.pumpIgnition = false;
     _outputs.pumpPowerPercent = 0;
-    _outputs.displayState = {DRY, ""};
+    _outputs.displayState = {DRY, DISPLAY_MESSAGE_NONE};
 }
 
 /**
  * @brief Initializes the finite state machine.
  */
 void HardwareManager::initialize() {
+    HalLockGuard_t lock(*_inputsLock);
     readPlcRegisters();
+    _controlInputs->post(_inputs);
 }
 
 /**
  * @brief Retrieves the current status of the PLC inputs.
+ * Safe to call from several threads.
  * 
  * @param inputs Overwritten with the current PLC input status.
  */
 void HardwareManager::retrieveInputs(PlcInputs_t &inputs) {
+    HalLockGuard_t lock(*_inputsLock);
     readPlcRegisters();
+    _controlInputs->post(_inputs);
     inputs = _inputs;
 }
 
+/**
+ * @brief Reads the PLC input registers, and wakes up the event loop if a switch changed.
+ * Called while the event loop sleeps, since the registers can't wake it up themselves.
+ *
+ * @return true If a switch changed.
+ */
+bool HardwareManager::sampleInputs() {
+    HalLockGuard_t lock(*_inputsLock);
+    bool ignitionClosed = _inputs.ignitionClosed;
+    bool levelSwitchClosed = _inputs.levelSwitchClosed;
+
+    readPlcRegisters();
+    _controlInputs->post(_inputs);
+
+    bool switchesChanged = _inputs.ignitionClosed != ignitionClosed ||
+                           _inputs.levelSwitchClosed != levelSwitchClosed;
+#ifndef EAE_EMBEDDED
+    if (_events != nullptr && switchesChanged) {
+        _events->signal(EVENT_INPUT_CHANGE);
+    }
+#endif
+    return switchesChanged;
+}
+
+/**
+ * @brief Fetches the inputs sampled since the last call, without taking a lock.
+ * Only called by the control task, which is the single reader.
+ *
+ * @param inputs Overwritten with the inputs, or left untouched if there is nothing new.
+ * @return true If new inputs were fetched.
+ */
+bool HardwareManager::fetchControlInputs(PlcInputs_t &inputs) {
+    return _controlInputs->fetch(inputs);
+}
+
 /**
  * @brief Set the given inputs to the internal variable
  * storing the PLC input registers
@@ -63,7 +127,21 @@ void HardwareManager::retrieveInputs(PlcInputs_t &inputs) {
  * @param inputs The inputs to set.
  */
 void HardwareManager::setInputs(PlcInputs_t inputs) {
+    HalLockGuard_t lock(*_inputsLock);
+#ifndef EAE_EMBEDDED
+    bool switchesChanged = inputs.ignitionClosed != _inputs.ignitionClosed ||
+                           inputs.levelSwitchClosed != _inputs.levelSwitchClosed;
+#endif
+
     _inputs = inputs;
+    _controlInputs->post(_inputs);
+
+    /** Only the switches can make the idle state do anything. */
+#ifndef EAE_EMBEDDED
+    if (_events != nullptr && switchesChanged) {
+        _events->signal(EVENT_INPUT_CHANGE);
+    }
+#endif
 }
 
 /**
@@ -72,7 +150,9 @@ void HardwareManager::setInputs(PlcInputs_t inputs) {
  * @param inputs Overwritten with the current PLC output status.
  */
 void HardwareManager::retrieveOutputs(PlcOutputs_t &outputs) {
-    outputs = _outputs;
+    HalLockGuard_t lock(*_outputsLock);
+    foldPowerOutputs();
+    outputs = _safeOverride->load(std::memory_order_acquire) ? _safeOutputs : _outputs;
 }
 
 /**
@@ -81,29 +161,204 @@ void HardwareManager::retrieveOutputs(PlcOutputs_t &outputs) {
  * @param outputs The outputs to set.
  */
 void HardwareManager::setOutputs(PlcOutputs_t outputs) {
+    HalLockGuard_t lock(*_outputsLock);
     _outputs = outputs;
-    writePlcRegisters();
+    writePlcRegisters(_safeOverride->load(std::memory_order_acquire) ? _safeOutputs : _outputs);
+}
+
+/**
+ * @brief Sets the fan and pump duty cycles, leaving the rest of the outputs untouched.
+ * Takes no lock, so that the control task never waits for the other threads.
+ * Only called by the control task, which is the single writer.
+ *
+ * The duty cycles are written to the registers by the thread owning them, the next time
+ * it takes the outputs lock. A duty cycle is only applied while its equipment is enabled,
+ * so that it can't undo the equipment being disabled from another thread.
+ *
+ * @param fanPowerPercent The fan duty cycle.
+ * @param pumpPowerPercent The pump duty cycle.
+ */
+void HardwareManager::setPowerOutputs(int fanPowerPercent, int pumpPowerPercent) {
+    PowerOutputs_t power = {fanPowerPercent, pumpPowerPercent};
+    _powerOutputs->post(power);
+}
+
+/**
+ * @brief Applies the latest duty cycles of the control task to the outputs of enabled equipment.
+ * Must be called with the outputs lock held.
+ */
+void HardwareManager::foldPowerOutputs() {
+    PowerOutputs_t power = {};
+
+    if (_powerOutputs->fetch(power) == false) {
+        return;
+    }
+    if (_outputs.fanEnable) {
+        _outputs.fanPowerPercent = power.fanPowerPercent;
+    }
+    if (_outputs.pumpEnable) {
+        _outputs.pumpPowerPercent = power.pumpPowerPercent;
+    }
+}
+
+/**
+ * @brief Sets the outputs that forceSafeOutputs() drives. Must be called before the threads start.
+ *
+ * @param outputs The safe outputs.
+ */
+void HardwareManager::setSafeOutputs(const PlcOutputs_t &outputs) {
+    _safeOutputs = outputs;
+}
+
+/**
+ * @brief Drives the safe outputs straight to the PLC, and keeps driving them instead of
+ * the outputs set afterwards, until releaseSafeOutputs() is called.
+ * Takes no lock, so that the watchdog can call it while a cycle is stalled inside the HAL.
+ *
+ * A cycle writing the registers at the same time finishes with its own outputs, but
+ * the next write of any thread is the safe outputs again.
+ */
+void HardwareManager::forceSafeOutputs() {
+    _safeOverride->store(true, std::memory_order_release);
+    writePlcRegisters(_safeOutputs);
+}
+
+/**
+ * @brief Stops driving the safe outputs, once the state machine has taken them over.
+ */
+void HardwareManager::releaseSafeOutputs() {
+    _safeOverride->store(false, std::memory_order_release);
 }
 
 /** 
  * @brief Forces the PLC to update the output signals
- * based on the current output registers.
+ * based on the current output registers, and sends
+ * any display state change to the display.
  */
 void HardwareManager::flushOutputs() {
-    /** Call the underlying PLC driver code to set the output registers. */
+    DisplayState_t displayState = {};
+
+    {
+        HalLockGuard_t lock(*_outputsLock);
+        foldPowerOutputs();
+
+        /** Call the underlying PLC driver code to set the output registers. */
+
+        displayState = _outputs.displayState;
+    }
+
+    HalLockGuard_t lock(*_displayLock);
+    _display.update(displayState);
+    transmitDisplayState();
+}
+
+/**
+ * @brief Pushes the display frames that are due onto the transmission queue, without
+ * checking for a display state change. Called while the state machine sleeps, since a
+ * transfer otherwise only advances when the outputs are flushed.
+ */
+void HardwareManager::flushDisplay() {
+    HalLockGuard_t lock(*_displayLock);
+    transmitDisplayState();
+}
+
+/**
+ * @brief Pushes the display frames that are due onto the transmission queue,
+ * leaving DISPLAY_TX_RESERVE slots free for control frames.
+ * Must be called with the display lock held.
+ */
+void HardwareManager::transmitDisplayState() {
+    CanFrame_t frame = {};
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    while (_display.isTransferring() && CAN_TX_QUEUE_SIZE - _canTxQueue->size() > DISPLAY_TX_RESERVE) {
+        if (_display.nextFrame(frame, now) == false) {
+            break;
+        }
+        sendCanFrame(frame);
+    }
+}
+
+/** 
+ * @brief Pops the next CAN frame from the reception queue.
+ * 
+ * A seperate thread receives all CAN frames and pushes them onto the queue
+ * with queueReceivedCanFrame(). This function is called on a loop until it returns false.
+ * 
+ * @param frame Overwritten with the frame.
+ * @return true If a frame was popped, false if the queue is empty.
+ */
+bool HardwareManager::receiveCanFrame(CanFrame_t &frame) {
+    if (_canRxQueue->pop(frame) == false) {
+        return false;
+    }
+
+#ifndef EAE_EMBEDDED
+    if (_metrics != nullptr) {
+        _metrics->count(METRIC_CAN_RX_FRAMES);
+    }
+#endif
+    return true;
 }
 
 /** 
- * @brief Receives a pointer to the next CAN message on the reception queue.
+ * @brief Pushes a received CAN frame onto the reception queue.
+ * Called by the thread receiving from the CAN driver.
  * 
- * In a real application, there would be a seperate thread receiving all CAN
- * messages and putting them in a queue to be popped by the main thread.
- * This function would be called on a loop until a nullptr is returned. 
+ * @param frame The frame.
+ * @return true If the frame was queued, false if it was dropped because the queue is full.
+ */
+bool HardwareManager::queueReceivedCanFrame(const CanFrame_t &frame) {
+    if (_canRxQueue->push(frame) == false) {
+#ifndef EAE_EMBEDDED
+        if (_metrics != nullptr) {
+            _metrics->count(METRIC_CAN_RX_DROPS);
+        }
+#endif
+        return false;
+    }
+
+#ifndef EAE_EMBEDDED
+    if (_events != nullptr) {
+        _events->signal(EVENT_CAN_RX);
+    }
+#endif
+    return true;
+}
+
+/**
+ * @brief Pushes a CAN frame onto the transmission queue.
  * 
- * @param message Overwritten with a pointer to the message.
+ * @param frame The frame.
+ * @return true If the frame was queued, false if it was dropped because the queue is full.
  */
-void HardwareManager::receiveNextCanMessage(char *&message) {
-    message = nullptr;
+bool HardwareManager::sendCanFrame(const CanFrame_t &frame) {
+    if (_canTxQueue->push(frame) == false) {
+#ifndef EAE_EMBEDDED
+        if (_metrics != nullptr) {
+            _metrics->count(METRIC_CAN_TX_DROPS);
+        }
+#endif
+        return false;
+    }
+
+#ifndef EAE_EMBEDDED
+    if (_metrics != nullptr) {
+        _metrics->count(METRIC_CAN_TX_FRAMES);
+    }
+#endif
+    return true;
+}
+
+/** 
+ * @brief Pops the next CAN frame from the transmission queue.
+ * Called by the thread transmitting to the CAN driver.
+ * 
+ * @param frame Overwritten with the frame.
+ * @return true If a frame was popped, false if the queue is empty.
+ */
+bool HardwareManager::popTransmitCanFrame(CanFrame_t &frame) {
+    return _canTxQueue->pop(frame);
 }
 
 /**
@@ -124,21 +379,27 @@ void HardwareManager::readPlcRegisters() {
      _inputs.ignitionClosed = readBooleanPlcRegister(IGNITION_INPUT);
      _inputs.levelSwitchClosed = readBooleanPlcRegister(LEVEL_INPUT);
      _inputs.temperature = readFloatPlcRegister(TEMP_INPUT);
+     for (int i = 0; i < HAL_REDUNDANT_TEMP_INPUTS; i++) {
+         _inputs.redundantTemperatures[i] = readFloatPlcRegister((PlcInputRegisters_e)(REDUNDANT_TEMP_FIRST_INPUT + i));
+     }
      */
 }
 
 /**
- * @brief Converts the outputs variable to values
+ * @brief Converts the outputs to values
  * expected by the underlying PLC driver and
  * populates the output registers.
+ *
+ * @param outputs The outputs to write.
  */
-void HardwareManager::writePlcRegisters() {
+void HardwareManager::writePlcRegisters(const PlcOutputs_t &outputs) {
     /** 
      * Define mock data to write to the register.
      * In a real application, this would be converted from the
-     * PlcOutputs_t variable into a type the PLC output expects.
+     * outputs into a type the PLC output expects.
      */
     char *mockData = nullptr;
+    (void)outputs;
 
     writePlcRegister(PUMP_ENABLE_OUTPUT, mockData);
     writePlcRegister(PUMP_IGNITION_OUTPUT, mockData);
@@ -197,6 +458,17 @@ void HardwareManager::writePlcRegister(PlcOutputRegisters_e address, char* value
  * @param message The message to send.
  */
 void HardwareManager::sendCanMessage(uint16_t id, uint8_t dlc, char message[CAN_MESSAGE_LEN]) {
-    /** Push the message onto a RTOS queue, to be sent in a seperate thread. */
+    CanFrame_t frame = {};
+
+    /** The mock register writes don't have any data to send. */
+    if (message == nullptr || dlc > CAN_MESSAGE_LEN) {
+        return;
+    }
+
+    /** Push the message onto the queue, to be sent in a seperate thread. */
+    frame.id = id;
+    frame.dlc = dlc;
+    memcpy(frame.data, message, dlc);
+    sendCanFrame(frame);
 }
 
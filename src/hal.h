@@ -1,34 +1,74 @@
 #ifndef HAL_H
 #define HAL_H
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#ifndef EAE_EMBEDDED
+#include <mutex>
+#include <pthread.h>
+#endif
 
-/** Maximum number of characters to support in a display message. */
-#define DISPLAY_MESSAGE_SIZE 255
+#include "queue.h"
+#include "mailbox.h"
+#include "can.h"
+#include "display.h"
 
-/** Eight bytes is the size of the data in a CAN frame. */
-#define CAN_MESSAGE_LEN 8
+/** Number of received CAN frames that can wait for the state machine. */
+#define CAN_RX_QUEUE_SIZE 64
 
-/**
- * @brief Describes the current status of the coolant in the system,
- * as read by the level sensor.
- */
-typedef enum CoolantStatus_e {
-    /** There is enough coolant in the system to run. */
-    SUFFICIENT,
-    /** There is not enough coolant in the system to run. */
-    DRY
-} CoolantStatus_e;
+/** Number of CAN frames that can wait for transmission. */
+#define CAN_TX_QUEUE_SIZE 64
+
+class MetricsManager;
+class EventManager;
 
+#ifdef EAE_EMBEDDED
+/** The embedded build runs on a single thread, so locking the outputs and the display does nothing. */
+typedef struct HalLock_t {
+    void lock() {}
+    void unlock() {}
+} HalLock_t;
+
+/** Holds a HalLock_t for a scope, without pulling in <mutex>. */
+typedef struct HalLockGuard_t {
+    explicit HalLockGuard_t(HalLock_t &) {}
+} HalLockGuard_t;
+#else
 /**
- * @brief The information that is shown on the display.
+ * A priority inheriting mutex. The real-time threads share the HAL locks on one CPU, so a lower
+ * priority thread holding a lock is boosted to the priority of the thread waiting for it,
+ * instead of being preempted by the threads in between.
  */
-typedef struct DisplayState_t {
-    /** The coolant status. */
-    CoolantStatus_e coolantStatus;
-    /** Optional message. */
-    char message[DISPLAY_MESSAGE_SIZE];
-} DisplayState_t;
+typedef struct HalLock_t {
+    HalLock_t() {
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setprotocol(&attributes, PTHREAD_PRIO_INHERIT);
+        pthread_mutex_init(&mutex, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+    }
+    ~HalLock_t() {
+        pthread_mutex_destroy(&mutex);
+    }
+    HalLock_t(const HalLock_t &) = delete;
+    HalLock_t &operator=(const HalLock_t &) = delete;
+
+    void lock() {
+        pthread_mutex_lock(&mutex);
+    }
+    void unlock() {
+        pthread_mutex_unlock(&mutex);
+    }
+
+    pthread_mutex_t mutex;
+} HalLock_t;
+
+typedef std::lock_guard<HalLock_t> HalLockGuard_t;
+#endif
+
+/** Number of spare input registers, IN_4 to IN_11, that can carry additional temperature sensors. */
+#define HAL_REDUNDANT_TEMP_INPUTS 8
 
 /**
  * @brief Stores the relevant information about the PLC input state
@@ -43,6 +83,8 @@ typedef struct PlcInputs_t {
     bool levelSwitchClosed;
     /** The temperature read by the temperature sensor connected to the PLC. */
     float temperature;
+    /** The temperatures read by the additional sensors on the spare inputs, if any are fitted. */
+    float redundantTemperatures[HAL_REDUNDANT_TEMP_INPUTS];
 } PlcInputs_t;
 
 /**
@@ -64,6 +106,16 @@ typedef struct PlcOutputs_t {
     DisplayState_t displayState;
 } PlcOutputs_t;
 
+/**
+ * @brief The duty cycles set by the control task.
+ */
+typedef struct PowerOutputs_t {
+    /** The percent of the fan's maximum power to target. */
+    int fanPowerPercent;
+    /** The percent of the pump's maximum power to target. */
+    int pumpPowerPercent;
+} PowerOutputs_t;
+
 /** 
  * @brief Describes the possible input registers in the PLC.
  */
@@ -107,8 +159,12 @@ class HardwareManager {
 public:
     /**
      * @brief Constructor.
+     * 
+     * @param metrics Optional counters, may be nullptr.
+     * @param events Optional event loop, woken up by received CAN frames
+     * and switch input changes. May be nullptr.
      */
-    HardwareManager();
+    HardwareManager(MetricsManager *metrics = nullptr, EventManager *events = nullptr);
 
     /**
      * @brief Begins the HAL.
@@ -117,11 +173,29 @@ public:
 
     /**
      * @brief Retrieves the current status of the PLC inputs.
+     * Safe to call from several threads.
      * 
      * @param inputs Overwritten with the current PLC input status.
      */
     void retrieveInputs(PlcInputs_t &inputs);
 
+    /**
+     * @brief Reads the PLC input registers, and wakes up the event loop if a switch changed.
+     * Called while the event loop sleeps, since the registers can't wake it up themselves.
+     *
+     * @return true If a switch changed.
+     */
+    bool sampleInputs();
+
+    /**
+     * @brief Fetches the inputs sampled since the last call, without taking a lock.
+     * Only called by the control task, which is the single reader.
+     *
+     * @param inputs Overwritten with the inputs, or left untouched if there is nothing new.
+     * @return true If new inputs were fetched.
+     */
+    bool fetchControlInputs(PlcInputs_t &inputs);
+
     /**
      * @brief Set the given inputs to the internal variable
      * storing the PLC input registers
@@ -134,6 +208,28 @@ public:
      */
     void setInputs(PlcInputs_t inputs);
 
+    /**
+     * @brief Retrieves the lock guarding the inputs.
+     *
+     * @note This function is only used for testing, to stall a thread inside the HAL.
+     *
+     * @return HalLock_t& The lock.
+     */
+    HalLock_t &getInputsLock() {
+        return *_inputsLock;
+    }
+
+    /**
+     * @brief Retrieves the lock guarding the outputs.
+     *
+     * @note This function is only used for testing, to stall a cycle inside the HAL.
+     *
+     * @return HalLock_t& The lock.
+     */
+    HalLock_t &getOutputsLock() {
+        return *_outputsLock;
+    }
+
     /**
      * @brief Retrieves the current status of the PLC outputs.
      * 
@@ -148,28 +244,133 @@ public:
      */
     void setOutputs(PlcOutputs_t outputs);
 
+    /**
+     * @brief Sets the fan and pump duty cycles, leaving the rest of the outputs untouched.
+     * Takes no lock, so that the control task never waits for the other threads.
+     * Only called by the control task, which is the single writer.
+     *
+     * A duty cycle is only applied while its equipment is enabled, so that it can't
+     * undo the equipment being disabled from another thread.
+     *
+     * @param fanPowerPercent The fan duty cycle.
+     * @param pumpPowerPercent The pump duty cycle.
+     */
+    void setPowerOutputs(int fanPowerPercent, int pumpPowerPercent);
+
+    /**
+     * @brief Sets the outputs that forceSafeOutputs() drives. Must be called before the threads start.
+     *
+     * @param outputs The safe outputs.
+     */
+    void setSafeOutputs(const PlcOutputs_t &outputs);
+
+    /**
+     * @brief Drives the safe outputs straight to the PLC, and keeps driving them instead of
+     * the outputs set afterwards, until releaseSafeOutputs() is called.
+     * Takes no lock, so that the watchdog can call it while a cycle is stalled inside the HAL.
+     */
+    void forceSafeOutputs();
+
+    /**
+     * @brief Stops driving the safe outputs, once the state machine has taken them over.
+     */
+    void releaseSafeOutputs();
+
     /** 
      * @brief Forces the PLC to update the output signals
-     * based on the current output registers.
+     * based on the current output registers, and sends
+     * any display state change to the display.
      */
     void flushOutputs();
 
+    /**
+     * @brief Pushes the display frames that are due onto the transmission queue, without
+     * checking for a display state change. Called while the state machine sleeps, since a
+     * transfer otherwise only advances when the outputs are flushed.
+     */
+    void flushDisplay();
+
+    /** 
+     * @brief Pops the next CAN frame from the reception queue.
+     * 
+     * A seperate thread receives all CAN frames and pushes them onto the queue
+     * with queueReceivedCanFrame(). This function is called on a loop until it returns false.
+     * 
+     * @param frame Overwritten with the frame.
+     * @return true If a frame was popped, false if the queue is empty.
+     */
+    bool receiveCanFrame(CanFrame_t &frame);
+
     /** 
-     * @brief Receives a pointer to the next CAN message on the reception queue.
+     * @brief Pushes a received CAN frame onto the reception queue.
+     * Called by the thread receiving from the CAN driver.
      * 
-     * In a real application, there would be a seperate thread receiving all CAN
-     * messages and putting them in a queue to be popped by the main thread.
-     * This function would be called on a loop until a nullptr is returned. 
+     * @param frame The frame.
+     * @return true If the frame was queued, false if it was dropped because the queue is full.
+     */
+    bool queueReceivedCanFrame(const CanFrame_t &frame);
+
+    /**
+     * @brief Pushes a CAN frame onto the transmission queue.
      * 
-     * @param message Overwritten with a pointer to the message.
+     * @param frame The frame.
+     * @return true If the frame was queued, false if it was dropped because the queue is full.
      */
-    void receiveNextCanMessage(char *&message);
+    bool sendCanFrame(const CanFrame_t &frame);
+
+    /** 
+     * @brief Pops the next CAN frame from the transmission queue.
+     * Called by the thread transmitting to the CAN driver.
+     * 
+     * @param frame Overwritten with the frame.
+     * @return true If a frame was popped, false if the queue is empty.
+     */
+    bool popTransmitCanFrame(CanFrame_t &frame);
     
 private:
     /** Current state. */
     PlcInputs_t _inputs;
     PlcOutputs_t _outputs;
 
+    /** Segments display state changes into CAN frames. Guarded by the display lock. */
+    DisplayManager _display;
+
+    /** The outputs that forceSafeOutputs() drives. */
+    PlcOutputs_t _safeOutputs;
+
+    /** The locks, queues, flags and mailboxes shared between threads are heap allocated, so that the manager stays movable. */
+
+    /** Guards the inputs, which the state machine task and the input sampling read from their own threads. */
+    std::unique_ptr<HalLock_t> _inputsLock;
+
+    /** Guards the outputs, which the state machine and the background tasks use from their own threads. */
+    std::unique_ptr<HalLock_t> _outputsLock;
+
+    /** Guards the display, so that segmenting a display update doesn't hold the outputs lock. */
+    std::unique_ptr<HalLock_t> _displayLock;
+
+    /** CAN queues. The storage is fixed when the manager is constructed. */
+    std::unique_ptr<BoundedQueue<CanFrame_t, CAN_RX_QUEUE_SIZE>> _canRxQueue;
+    std::unique_ptr<BoundedQueue<CanFrame_t, CAN_TX_QUEUE_SIZE>> _canTxQueue;
+
+    /** Set while the safe outputs are forced, which the registers are then written from. Written by the watchdog. */
+    std::unique_ptr<std::atomic<bool>> _safeOverride;
+
+    /**
+     * From the HAL to the control task, and back. The control task never takes a lock: it is handed
+     * the sampled inputs, and its duty cycles are folded into the outputs by the next thread that
+     * takes the outputs lock. The inputs are posted with the inputs lock held, and the duty cycles
+     * fetched with the outputs lock held, so each mailbox still has a single writer and reader.
+     */
+    std::unique_ptr<Mailbox<PlcInputs_t>> _controlInputs;
+    std::unique_ptr<Mailbox<PowerOutputs_t>> _powerOutputs;
+
+    /** Optional counters, may be nullptr. */
+    MetricsManager *_metrics;
+
+    /** Optional event loop, may be nullptr. */
+    EventManager *_events;
+
     /**
      * @brief Reads the input register values from the 
      * underlying PLC driver, convers the values to the 
@@ -178,11 +379,19 @@ private:
     void readPlcRegisters();
 
     /**
-     * @brief Converts the outputs variable to values
+     * @brief Applies the latest duty cycles of the control task to the outputs of enabled equipment.
+     * Must be called with the outputs lock held.
+     */
+    void foldPowerOutputs();
+
+    /**
+     * @brief Converts the outputs to values
      * expected by the underlying PLC driver and
      * populates the output registers.
+     *
+     * @param outputs The outputs to write.
      */
-    void writePlcRegisters();
+    void writePlcRegisters(const PlcOutputs_t &outputs);
 
     /**
      * @brief Reads an input register via the underlying PLC driver. 
@@ -210,6 +419,13 @@ private:
      */
     void writePlcRegister(PlcOutputRegisters_e address, char* value);
 
+    /**
+     * @brief Pushes the display frames that are due onto the transmission queue,
+     * leaving DISPLAY_TX_RESERVE slots free for control frames.
+     * Must be called with the display lock held.
+     */
+    void transmitDisplayState();
+
     /**
      * @brief Pushes a CAN message to the outgoing message queue.
      * 
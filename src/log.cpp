@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <chrono>
+
+#include "log.h"
+
+BoundedQueue<LogRecord_t, LOG_QUEUE_SIZE> LogManager::records;
+std::atomic<uint64_t> LogManager::dropped(0);
+#ifndef EAE_EMBEDDED
+std::thread LogManager::loggerThread;
+std::atomic<bool> LogManager::running(false);
+#endif
+
+/**
+ * @brief Queues a message.
+ *
+ * @param level The severity.
+ * @param message The message. Must outlive the record, like a string literal.
+ */
+void LogManager::log(LogLevel_e level, const char *message) {
+    LogRecord_t record = {level, message, false, 0.0f};
+    push(record);
+}
+
+/**
+ * @brief Queues a message followed by a value.
+ *
+ * @param level The severity.
+ * @param message The message. Must outlive the record, like a string literal.
+ * @param value The value.
+ */
+void LogManager::log(LogLevel_e level, const char *message, float value) {
+    LogRecord_t record = {level, message, true, value};
+    push(record);
+}
+
+/**
+ * @brief Formats and writes out all the pending records.
+ * Info goes to stdout, warnings and errors to stderr.
+ *
+ * @return size_t The number of records written.
+ */
+size_t LogManager::flush() {
+    LogRecord_t record = {};
+    size_t count = 0;
+
+    while (records.pop(record)) {
+        FILE *stream = record.level == LOG_INFO ? stdout : stderr;
+        if (record.hasValue) {
+            fprintf(stream, "%s%g\n", record.message, record.value);
+        } else {
+            fprintf(stream, "%s\n", record.message);
+        }
+        count++;
+    }
+
+    if (count > 0) {
+        fflush(stdout);
+        fflush(stderr);
+    }
+    return count;
+}
+
+#ifndef EAE_EMBEDDED
+/**
+ * @brief Starts the logger thread, which calls flush() every LOG_FLUSH_PERIOD_MS.
+ */
+void LogManager::start() {
+    if (running) {
+        return;
+    }
+
+    running = true;
+    loggerThread = std::thread(&LogManager::run);
+}
+
+/**
+ * @brief Stops the logger thread and writes out the remaining records.
+ */
+void LogManager::stop() {
+    if (running == false) {
+        return;
+    }
+
+    running = false;
+    loggerThread.join();
+    flush();
+}
+#endif
+
+/**
+ * @brief Queues a record, counting it if it is dropped.
+ *
+ * @param record The record.
+ */
+void LogManager::push(const LogRecord_t &record) {
+    if (records.push(record) == false) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+#ifndef EAE_EMBEDDED
+/**
+ * @brief Calls flush() until stop() is called.
+ */
+void LogManager::run() {
+    while (running) {
+        flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_PERIOD_MS));
+    }
+}
+#endif
@@ -0,0 +1,134 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstdint>
+#ifndef EAE_EMBEDDED
+#include <thread>
+#endif
+
+#include "queue.h"
+
+/** Number of log records that can be pending before new ones are dropped. */
+#define LOG_QUEUE_SIZE 256
+
+/** How often the logger thread writes out the pending records. */
+#define LOG_FLUSH_PERIOD_MS 10
+
+/**
+ * @brief Describes the severity of a log record.
+ */
+typedef enum LogLevel_e {
+    LOG_INFO,
+    LOG_WARNING,
+    LOG_ERROR
+} LogLevel_e;
+
+/**
+ * @brief A pending log record.
+ *
+ * Records are formatted by the logger thread, so the message must point to
+ * storage that outlives the record, like a string literal.
+ */
+typedef struct LogRecord_t {
+    /** The severity. */
+    LogLevel_e level;
+    /** The message. */
+    const char *message;
+    /** If true, the value is printed after the message. */
+    bool hasValue;
+    /** An optional value. */
+    float value;
+} LogRecord_t;
+
+/**
+ * @brief Moves console output off the control path.
+ *
+ * Logging copies a small record into a fixed-capacity queue, which a background
+ * thread formats and writes out. Nothing is allocated or written to the console
+ * by the caller, and records are dropped if the queue is full.
+ */
+class LogManager {
+public:
+    /**
+     * @brief Queues a message.
+     *
+     * @param level The severity.
+     * @param message The message. Must outlive the record, like a string literal.
+     */
+    static void log(LogLevel_e level, const char *message);
+
+    /**
+     * @brief Queues a message followed by a value.
+     *
+     * @param level The severity.
+     * @param message The message. Must outlive the record, like a string literal.
+     * @param value The value.
+     */
+    static void log(LogLevel_e level, const char *message, float value);
+
+    /**
+     * @brief Formats and writes out all the pending records.
+     * Info goes to stdout, warnings and errors to stderr.
+     *
+     * @return size_t The number of records written.
+     */
+    static size_t flush();
+
+    /** The embedded build has no logger thread, its main loop calls flush() instead. */
+#ifndef EAE_EMBEDDED
+    /**
+     * @brief Starts the logger thread, which calls flush() every LOG_FLUSH_PERIOD_MS.
+     */
+    static void start();
+
+    /**
+     * @brief Stops the logger thread and writes out the remaining records.
+     */
+    static void stop();
+
+    /**
+     * @brief Retrieves the number of records dropped because the queue was full.
+     *
+     * @return uint64_t The number of dropped records.
+     */
+    static uint64_t getDropCount() {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Retrieves the native handle of the logger thread, so it can be pinned and prioritized.
+     *
+     * @return std::thread::native_handle_type The handle. Only valid while the thread is running.
+     */
+    static std::thread::native_handle_type getThreadHandle() {
+        return loggerThread.native_handle();
+    }
+#endif
+
+private:
+    static BoundedQueue<LogRecord_t, LOG_QUEUE_SIZE> records;
+    static std::atomic<uint64_t> dropped;
+
+#ifndef EAE_EMBEDDED
+    /** Logger thread state. */
+    static std::thread loggerThread;
+    static std::atomic<bool> running;
+#endif
+
+    /**
+     * @brief Queues a record, counting it if it is dropped.
+     *
+     * @param record The record.
+     */
+    static void push(const LogRecord_t &record);
+
+#ifndef EAE_EMBEDDED
+    /**
+     * @brief Calls flush() until stop() is called.
+     */
+    static void run();
+#endif
+};
+
+#endif
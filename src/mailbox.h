@@ -0,0 +1,73 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <atomic>
+#include <cstdint>
+
+/** The shared index is tagged with this bit when it holds an item the reader hasn't fetched. */
+#define MAILBOX_FRESH 0x4U
+#define MAILBOX_INDEX 0x3U
+
+/**
+ * @brief A lock-free, single-producer single-consumer mailbox holding the latest posted item.
+ *
+ * Tasks running at different rates exchange their latest state through mailboxes rather than
+ * queues: a slow reader only wants the newest item, and a fast writer must never wait for it.
+ *
+ * The mailbox is a triple buffer. The writer owns one buffer and the reader another, and the
+ * third is shared. Posting fills the writer's buffer and swaps it with the shared one, and
+ * fetching swaps the shared buffer with the reader's if it holds a newer item. Neither side
+ * ever waits, and an item is never torn.
+ *
+ * @tparam T The item type. Copied in and out of the mailbox.
+ */
+template <typename T>
+class Mailbox {
+public:
+    /**
+     * @brief Constructor.
+     */
+    Mailbox() : buffers(), shared(1), writing(0), reading(2) {}
+
+    Mailbox(const Mailbox &) = delete;
+    Mailbox &operator=(const Mailbox &) = delete;
+
+    /**
+     * @brief Posts an item, replacing the one the reader hasn't fetched yet, if any.
+     * Called by the writer.
+     *
+     * @param item The item.
+     */
+    void post(const T &item) {
+        buffers[writing] = item;
+        writing = shared.exchange((uint8_t)(writing | MAILBOX_FRESH), std::memory_order_acq_rel) & MAILBOX_INDEX;
+    }
+
+    /**
+     * @brief Fetches the latest item, if it wasn't fetched yet. Called by the reader.
+     *
+     * @param item Overwritten with the item, or left untouched if there is nothing new.
+     * @return true If a new item was fetched.
+     */
+    bool fetch(T &item) {
+        if ((shared.load(std::memory_order_relaxed) & MAILBOX_FRESH) == 0) {
+            return false;
+        }
+
+        reading = shared.exchange(reading, std::memory_order_acq_rel) & MAILBOX_INDEX;
+        item = buffers[reading];
+        return true;
+    }
+
+private:
+    T buffers[3];
+
+    /** Index of the shared buffer, and whether it is fresh. */
+    std::atomic<uint8_t> shared;
+
+    /** Index of the buffer owned by the writer, and by the reader. */
+    uint8_t writing;
+    uint8_t reading;
+};
+
+#endif
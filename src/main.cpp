@@ -1,40 +1,436 @@
+#include <chrono>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <getopt.h>
 #include <iostream>
+#include <thread>
 
 #include "fsm.h"
 #include "hal.h"
 #include "controller.h"
+#include "fusion.h"
+#include "metrics.h"
+#include "watchdog.h"
+#include "realtime.h"
+#include "log.h"
+#include "tripwire.h"
+#include "events.h"
+#include "dtc.h"
+#include "snapshot.h"
+#include "tasks.h"
+
+/** Default period of the main loop. */
+#define DEFAULT_CYCLE_PERIOD_MS 10
+
+/** Default number of consecutive deadline misses before entering the fatal error state. */
+#define DEFAULT_WATCHDOG_OVERRUNS 3
+
+/** Default SCHED_FIFO priority of the control thread. The supervisor runs just above it. */
+#define DEFAULT_RT_PRIORITY 80
+
+/** Default longest time the event-driven loop sleeps without an event. */
+#define DEFAULT_MAX_INTERVAL_MS 1000
+
+/** Number of cycles measured at startup to verify the real-time setup. */
+#define RT_VERIFY_CYCLES 100
 
 extern "C" {
     extern float MIN_VOLTAGE;
     extern float TEMP_SETPOINT;
 }
 
+/**
+ * @brief Prints the command line usage.
+ *
+ * @param program The name of the executable.
+ */
+static void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " <MIN_VOLTAGE> <TEMP_SETPOINT> [options]" << std::endl;
+    std::cerr << "  --period-ms <MS>       Period of the main loop. Default: " << DEFAULT_CYCLE_PERIOD_MS << std::endl;
+    std::cerr << "  --metrics-port <PORT>  Serve Prometheus metrics on 127.0.0.1:<PORT>/metrics." << std::endl;
+    std::cerr << "  --deadline-ms <MS>     Deadline of each cycle. Default: the period." << std::endl;
+    std::cerr << "  --max-overruns <N>     Consecutive deadline misses before the fatal error state. Default: "
+              << DEFAULT_WATCHDOG_OVERRUNS << std::endl;
+    std::cerr << "  --rt                   Lock memory, pin threads and run them with SCHED_FIFO." << std::endl;
+    std::cerr << "  --rt-priority <N>      SCHED_FIFO priority of the control thread. Default: "
+              << DEFAULT_RT_PRIORITY << std::endl;
+    std::cerr << "  --control-cpu <CPU>    CPU the control and supervisor threads are pinned to." << std::endl;
+    std::cerr << "  --aux-cpu <CPU>        CPU the metrics and logging threads are pinned to." << std::endl;
+    std::cerr << "  --event-driven         Only run the idle and fatal error states on input changes and CAN frames.\n"
+              << "                         The inputs are still sampled every period."
+              << std::endl;
+    std::cerr << "  --max-interval-ms <MS> Longest sleep of the event-driven loop. Default: "
+              << DEFAULT_MAX_INTERVAL_MS << std::endl;
+    std::cerr << "  --kp <GAIN>            Proportional gain, in % per degree. Default: " << CONTROLLER_DEFAULT_KP
+              << std::endl;
+    std::cerr << "  --ki <GAIN>            Integral gain, in % per degree second. Default: " << CONTROLLER_DEFAULT_KI
+              << std::endl;
+    std::cerr << "  --kd <GAIN>            Derivative gain, in % per degree per second. Default: "
+              << CONTROLLER_DEFAULT_KD << std::endl;
+    std::cerr << "  --allocation <MODE>    How cooling is split between the fan and the pump: equal or optimal. "
+              << "Default: equal" << std::endl;
+    std::cerr << "  --controller <MODE>    Control loop: pid, or predictive from a step-response model of the plant. "
+              << "Default: pid. predictive is not compatible with --kp, --ki and --kd." << std::endl;
+    std::cerr << "  --dtc-file <PATH>      Persist the diagnostic trouble codes to a file." << std::endl;
+    std::cerr << "  --snapshot-file <PATH> Snapshot the control loop to a file, and resume from it on restart."
+              << std::endl;
+    std::cerr << "  --state-divisor <N>    Run the control loop alone every period, and the state machine every N periods "
+              << "on its own thread. Not compatible with --event-driven." << std::endl;
+    std::cerr << "  --temp-sensors <N>     Fuse N temperature sensors, on IN_2 then IN_4 to IN_11. Default: 1, unfused"
+              << std::endl;
+    std::cerr << "  --alloc-tripwire <MODE> What to do when a cycle allocates memory: count or abort. Default: count"
+              << std::endl;
+}
+
 int main(int argc, char* argv[]) {
+    static const struct option longOptions[] = {
+        {"period-ms", required_argument, nullptr, 'p'},
+        {"metrics-port", required_argument, nullptr, 'm'},
+        {"deadline-ms", required_argument, nullptr, 'd'},
+        {"max-overruns", required_argument, nullptr, 'o'},
+        {"rt", no_argument, nullptr, 'r'},
+        {"rt-priority", required_argument, nullptr, 'P'},
+        {"control-cpu", required_argument, nullptr, 'c'},
+        {"aux-cpu", required_argument, nullptr, 'a'},
+        {"alloc-tripwire", required_argument, nullptr, 't'},
+        {"event-driven", no_argument, nullptr, 'e'},
+        {"max-interval-ms", required_argument, nullptr, 'i'},
+        {"kp", required_argument, nullptr, 'K'},
+        {"ki", required_argument, nullptr, 'I'},
+        {"kd", required_argument, nullptr, 'D'},
+        {"allocation", required_argument, nullptr, 'A'},
+        {"dtc-file", required_argument, nullptr, 'f'},
+        {"snapshot-file", required_argument, nullptr, 's'},
+        {"state-divisor", required_argument, nullptr, 'S'},
+        {"temp-sensors", required_argument, nullptr, 'T'},
+        {"controller", required_argument, nullptr, 'C'},
+        {nullptr, 0, nullptr, 0},
+    };
+    int periodMs = DEFAULT_CYCLE_PERIOD_MS;
+    int metricsPort = 0;
+    int deadlineMs = 0;
+    int maxOverruns = DEFAULT_WATCHDOG_OVERRUNS;
+    bool realtime = false;
+    int rtPriority = DEFAULT_RT_PRIORITY;
+    int controlCpu = -1;
+    int auxCpu = -1;
+    TripwireMode_e tripwireMode = TRIPWIRE_COUNT;
+    bool eventDriven = false;
+    int maxIntervalMs = DEFAULT_MAX_INTERVAL_MS;
+    PidGains_t gains = {CONTROLLER_DEFAULT_KP, CONTROLLER_DEFAULT_KI, CONTROLLER_DEFAULT_KD};
+    AllocationMode_e allocation = ALLOCATION_EQUAL;
+    bool predictiveControl = false;
+    bool customGains = false;
+    const char *dtcPath = nullptr;
+    const char *snapshotPath = nullptr;
+    int stateDivisor = 0;
+    int tempSensors = 1;
+    int option = 0;
+
+    /** Parse the options. */
+    while ((option = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (option) {
+            case 'p':
+                periodMs = atoi(optarg);
+                break;
+            case 'm':
+                metricsPort = atoi(optarg);
+                break;
+            case 'd':
+                deadlineMs = atoi(optarg);
+                break;
+            case 'o':
+                maxOverruns = atoi(optarg);
+                break;
+            case 'r':
+                realtime = true;
+                break;
+            case 'P':
+                rtPriority = atoi(optarg);
+                break;
+            case 'c':
+                controlCpu = atoi(optarg);
+                break;
+            case 'a':
+                auxCpu = atoi(optarg);
+                break;
+            case 'e':
+                eventDriven = true;
+                break;
+            case 'i':
+                maxIntervalMs = atoi(optarg);
+                break;
+            case 'K':
+                gains.kp = atof(optarg);
+                customGains = true;
+                break;
+            case 'I':
+                gains.ki = atof(optarg);
+                customGains = true;
+                break;
+            case 'D':
+                gains.kd = atof(optarg);
+                customGains = true;
+                break;
+            case 'f':
+                dtcPath = optarg;
+                break;
+            case 's':
+                snapshotPath = optarg;
+                break;
+            case 'S':
+                stateDivisor = atoi(optarg);
+                break;
+            case 'T':
+                tempSensors = atoi(optarg);
+                break;
+            case 'A':
+                if (strcmp(optarg, "optimal") == 0) {
+                    allocation = ALLOCATION_OPTIMAL;
+                } else if (strcmp(optarg, "equal") != 0) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'C':
+                if (strcmp(optarg, "predictive") == 0) {
+                    predictiveControl = true;
+                } else if (strcmp(optarg, "pid") != 0) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 't':
+                if (strcmp(optarg, "abort") == 0) {
+                    tripwireMode = TRIPWIRE_ABORT;
+                } else if (strcmp(optarg, "count") != 0) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    /** The watchdog times are held in 32 bit microseconds, so they are computed in 64 bits to reject the ones that don't fit. */
+    uint64_t deadlineUs = (uint64_t)(deadlineMs > 0 ? deadlineMs : periodMs) * 1000U;
+    uint64_t heartbeatTimeoutUs = (uint64_t)stateDivisor * (uint64_t)periodMs * 1000U * TASK_STATE_HEARTBEAT_PERIODS;
+
     /** Ensure the arguments were supplied. */
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <MIN_VOLTAGE> <TEMP_SETPOINT>" << std::endl;
+    if (argc - optind != 2 || periodMs <= 0 || deadlineMs < 0 || maxOverruns <= 0 ||
+        rtPriority < 1 || rtPriority > 98 || maxIntervalMs <= 0 || stateDivisor < 0 ||
+        (eventDriven && stateDivisor > 0) || tempSensors < 1 || tempSensors > FUSION_MAX_SENSORS ||
+        (predictiveControl && customGains) || (uint64_t)periodMs * 1000U > UINT32_MAX || deadlineUs > UINT32_MAX ||
+        heartbeatTimeoutUs > UINT32_MAX) {
+        printUsage(argv[0]);
         return 1;
     }
 
     /** Convert arguments to correct variable. */
-    float minVoltage = atof(argv[1]);
-    float tempSetpoint = atof(argv[2]);
+    float minVoltage = atof(argv[optind]);
+    float tempSetpoint = atof(argv[optind + 1]);
 
     std::cout << "Minimum Voltage: " << minVoltage << std::endl;
     std::cout << "Temperature Setpoint: " << tempSetpoint << std::endl;
 
     /** Initialize classes. */
     Parameters_t params = {minVoltage, tempSetpoint};
-    HardwareManager hal = HardwareManager();
-    ControlManager controller = ControlManager(tempSetpoint);
-    StateManager fsm = StateManager(params, &hal, &controller);
+    MetricsManager metrics;
+    EventManager events;
+    if (eventDriven) {
+        if (events.initialize() == false) {
+            return 1;
+        }
+        events.startSampling(std::chrono::milliseconds(periodMs));
+    }
+    HardwareManager hal = HardwareManager(&metrics, eventDriven ? &events : nullptr);
+
+    /** The predictive controller uses the default model of the coolant loop. */
+    PredictiveConfig_t predictive = {};
+    PlantModel_t plantModel = {CONTROLLER_DEFAULT_MODEL_GAIN_C_PER_PERCENT, CONTROLLER_DEFAULT_MODEL_TIME_CONSTANT_S,
+                               CONTROLLER_DEFAULT_MODEL_DEAD_TIME_S};
+    predictive.samplePeriodS = CONTROLLER_DEFAULT_SAMPLE_PERIOD_S;
+    predictive.horizon = CONTROLLER_DEFAULT_HORIZON;
+    predictive.moveSuppression = CONTROLLER_DEFAULT_MOVE_SUPPRESSION;
+    ControlManager::buildStepResponse(plantModel, predictive);
+    if (predictiveControl && ControlManager::validatePredictiveConfig(predictive) == false) {
+        std::cerr << "The model of the predictive controller is rejected." << std::endl;
+        return 1;
+    }
+    ControlManager controller = ControlManager(tempSetpoint, gains, periodMs / 1000.0f, allocation,
+                                               predictiveControl ? &predictive : nullptr);
+
+    /** The safe output image disables the pump and the fan. */
+    WatchdogConfig_t watchdogConfig = {};
+    watchdogConfig.deadlineUs = (uint32_t)deadlineUs;
+    watchdogConfig.maxConsecutiveOverruns = (uint32_t)maxOverruns;
+    watchdogConfig.safeOutputs.displayState.coolantStatus = DRY;
+    watchdogConfig.heartbeatTimeoutUs = (uint32_t)heartbeatTimeoutUs;
+    WatchdogManager watchdog(&hal, watchdogConfig);
+
+    DiagnosticManager diagnostics(dtcPath);
+    SnapshotManager snapshots(snapshotPath);
+    if (snapshotPath != nullptr && snapshots.open() == false) {
+        return 1;
+    }
+    StateManager fsm = StateManager(params, &hal, &controller, &metrics, &watchdog, &diagnostics,
+                                    snapshotPath != nullptr ? &snapshots : nullptr);
+
+    /** With several temperature sensors, the controller is fed their fused temperature. */
+    FusionConfig_t fusionConfig = {(uint8_t)tempSensors, periodMs / 1000.0f, FUSION_DEFAULT_MAX_RATE_C_PER_S,
+                                   FUSION_DEFAULT_VOTE_TOLERANCE_C, FUSION_DEFAULT_STALE_CYCLES};
+    FusionManager fusion(fusionConfig);
+    if (tempSensors > 1) {
+        fsm.attachFusion(&fusion);
+    }
+
+    /** Optionally split the control loop from the state machine, each at its own rate. */
+    TaskConfig_t taskConfig = {(uint32_t)periodMs * 1000U, (uint32_t)stateDivisor, TASK_DEFAULT_BACKGROUND_PERIOD_MS};
+    TaskManager tasks(&hal, &controller, taskConfig, &watchdog, snapshotPath != nullptr ? &snapshots : nullptr,
+                      tempSensors > 1 ? &fusion : nullptr);
+    if (stateDivisor > 0) {
+        fsm.attachTasks(&tasks);
+    }
+    metrics.attachWatchdog(&watchdog);
+
+    /** The supervisor must be able to preempt a stalled control thread. */
+    RealtimeConfig_t rtConfig = {};
+    rtConfig.cpu[REALTIME_THREAD_CONTROL] = controlCpu;
+    rtConfig.cpu[REALTIME_THREAD_STATE] = controlCpu;
+    rtConfig.cpu[REALTIME_THREAD_SUPERVISOR] = controlCpu;
+    rtConfig.cpu[REALTIME_THREAD_AUX] = auxCpu;
+    rtConfig.priority[REALTIME_THREAD_CONTROL] = realtime ? rtPriority : 0;
+    rtConfig.priority[REALTIME_THREAD_STATE] = realtime && rtPriority > 1 ? rtPriority - 1 : 0;
+    rtConfig.priority[REALTIME_THREAD_SUPERVISOR] = realtime ? rtPriority + 1 : 0;
+    rtConfig.priority[REALTIME_THREAD_AUX] = 0;
+    RealtimeManager rt(rtConfig);
+
+    /** Memory must be locked before any thread is started. */
+    if (realtime) {
+        rt.initialize();
+    }
+
+    AllocationTripwire::setMode(tripwireMode);
+
+    /** Console output is written by the logger thread, off the control path. */
+    LogManager::start();
+    rt.configureThread(LogManager::getThreadHandle(), REALTIME_THREAD_AUX);
+
+    /** Trouble codes from earlier runs are kept, and new ones are appended by the writer thread. */
+    if (dtcPath != nullptr) {
+        diagnostics.load();
+        diagnostics.start();
+        rt.configureThread(diagnostics.getThreadHandle(), REALTIME_THREAD_AUX);
+    }
+
+    /** Without the background task, the snapshots are saved by their own writer thread, off the control path. */
+    if (snapshotPath != nullptr && stateDivisor == 0) {
+        snapshots.start();
+        rt.configureThread(snapshots.getThreadHandle(), REALTIME_THREAD_AUX);
+    }
+
+    /** Expose the metrics, if requested. */
+    if (metricsPort > 0 && metrics.startServer((uint16_t)metricsPort) == false) {
+        return 1;
+    }
+    if (metricsPort > 0) {
+        rt.configureThread(metrics.getThreadHandle(), REALTIME_THREAD_AUX);
+    }
 
     /** Run the code. */
+    const std::chrono::milliseconds period(periodMs);
+    const std::chrono::milliseconds maxInterval(maxIntervalMs);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + period;
+
     fsm.initialize();
+    watchdog.start();
+    rt.configureThread(watchdog.getThreadHandle(), REALTIME_THREAD_SUPERVISOR);
+    rt.configureCurrentThread(REALTIME_THREAD_CONTROL);
+    if (stateDivisor > 0) {
+        tasks.start(&fsm);
+        rt.configureThread(tasks.getStateThreadHandle(), REALTIME_THREAD_STATE);
+        rt.configureThread(tasks.getBackgroundThreadHandle(), REALTIME_THREAD_AUX);
+    }
+
+    /** Measured over the first cycles, to verify that the cycle neither allocates, faults nor wakes up late. */
+    long verifyCycles = realtime ? RT_VERIFY_CYCLES : 0;
+    long cycleFaults = 0;
+    std::chrono::nanoseconds maxWakeupLatency(0);
+
+    CanFrame_t txFrame = {};
     while (true) {
-        fsm.handleCurrentState();
+        long faults = verifyCycles > 0 ? RealtimeManager::readPageFaults() : 0;
+
+        if (stateDivisor > 0) {
+            tasks.runControl();
+        } else {
+            fsm.handleCurrentState();
+
+            /** Hand the queued frames to the CAN driver. */
+            while (hal.popTransmitCanFrame(txFrame)) {
+                /** Call the underlying CAN driver to transmit the frame. */
+            }
+        }
+
+        if (verifyCycles > 0) {
+            cycleFaults += RealtimeManager::readPageFaults() - faults;
+            if (--verifyCycles == 0) {
+                std::cout << "Real-time check over " << RT_VERIFY_CYCLES << " cycles: "
+                          << cycleFaults << " page faults, ";
+                if (AllocationTripwire::isEnabled()) {
+                    std::cout << AllocationTripwire::getCount() << " allocations, ";
+                }
+                std::cout << "max wakeup latency "
+                          << std::chrono::duration_cast<std::chrono::microseconds>(maxWakeupLatency).count()
+                          << " us." << std::endl;
+                if (cycleFaults > 0) {
+                    std::cerr << "The cycle is touching memory that wasn't pre-faulted." << std::endl;
+                }
+                if (AllocationTripwire::getCount() > 0) {
+                    std::cerr << "The cycle is allocating memory." << std::endl;
+                }
+            }
+        }
+
+        /** Count the overrun and skip the missed cycles, rather than running them back to back. */
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now > deadline) {
+            metrics.count(METRIC_CYCLE_OVERRUNS);
+            while (deadline < now) {
+                deadline += period;
+            }
+        }
+
+        /**
+         * Sleep until something changes, then restart the period from the wakeup. The inputs are
+         * sampled every period meanwhile, and a switch change signals EVENT_INPUT_CHANGE.
+         * A display transfer in progress keeps advancing at the same rate.
+         */
+        if (eventDriven && fsm.needsPeriodicExecution() == false) {
+            std::chrono::steady_clock::time_point wakeup = now + maxInterval;
+            while (events.waitUntil(wakeup) == EVENT_INPUT_SAMPLE) {
+                hal.sampleInputs();
+                hal.flushDisplay();
+                while (hal.popTransmitCanFrame(txFrame)) {
+                    /** Call the underlying CAN driver to transmit the frame. */
+                }
+            }
+            deadline = std::chrono::steady_clock::now() + period;
+            continue;
+        }
+
+        std::this_thread::sleep_until(deadline);
+        if (verifyCycles > 0) {
+            std::chrono::nanoseconds latency = std::chrono::steady_clock::now() - deadline;
+            if (latency > maxWakeupLatency) {
+                maxWakeupLatency = latency;
+            }
+        }
+        deadline += period;
     }
 
     return 0;
-}
\ No newline at end of file
+}
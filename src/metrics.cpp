@@ -0,0 +1,381 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <iostream>
+
+#include "metrics.h"
+
+/** How long the server waits for a connection before checking whether it should stop. */
+#define METRICS_POLL_TIMEOUT_MS 200
+
+/** Maximum size of a scrape request that is read. The request body is ignored. */
+#define METRICS_REQUEST_SIZE 1024
+
+/** How long the server waits on a client before dropping it, so a stalled client can't block stopServer(). */
+#define METRICS_CLIENT_TIMEOUT_MS 200
+
+/** Source of unique instance identifiers and thread tokens. Zero is never handed out. */
+static std::atomic<uint64_t> nextInstanceId(1);
+static std::atomic<uint64_t> nextThreadToken(1);
+
+thread_local uint64_t MetricsManager::cachedInstance = 0;
+thread_local MetricsSlot_t *MetricsManager::cachedSlot = nullptr;
+thread_local uint64_t MetricsManager::threadToken = 0;
+
+/** Label values for each state. */
+static const char *stateLabels[STATE_MAX] = {
+    "min",
+    "boot",
+    "fatal_error",
+    "idle",
+    "ignition",
+    "active",
+};
+
+/** Label values for each guard failure reason. */
+static const char *guardLabels[GUARD_MAX] = {
+    "undervoltage",
+    "coolant_dry",
+    "ignition_off",
+};
+
+/** Metric names and help text for each event counter. */
+static const char *counterNames[METRIC_MAX] = {
+    "eae_cycles_total",
+    "eae_cycle_overruns_total",
+    "eae_can_rx_frames_total",
+    "eae_can_tx_frames_total",
+    "eae_can_rx_drops_total",
+    "eae_can_tx_drops_total",
+    "eae_can_rx_malformed_total",
+    "eae_can_rx_unknown_total",
+    "eae_fusion_degraded_cycles_total",
+    "eae_fusion_failed_cycles_total",
+};
+static const char *counterHelp[METRIC_MAX] = {
+    "Number of state machine cycles executed.",
+    "Number of cycles that finished after their deadline.",
+    "Number of CAN frames received.",
+    "Number of CAN frames transmitted.",
+    "Number of received CAN frames dropped.",
+    "Number of CAN frames dropped before transmission.",
+    "Number of received CAN frames rejected as malformed.",
+    "Number of received CAN frames with an unknown ID.",
+    "Number of active cycles with a temperature sensor left out of the vote.",
+    "Number of active cycles with no majority of the temperature sensors, or none usable.",
+};
+
+/**
+ * @brief Constructor.
+ */
+MetricsManager::MetricsManager()
+    : registeredThreads(0), instanceId(nextInstanceId.fetch_add(1)), watchdog(nullptr),
+      serverRunning(false), serverSocket(-1) {
+    for (MetricsSlot_t &slot : slots) {
+        for (auto &row : slot.transitions) {
+            for (auto &counter : row) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+        }
+        for (auto &row : slot.guardFailures) {
+            for (auto &counter : row) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+        }
+        for (auto &counter : slot.counters) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+        slot.owner.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Destructor. Stops the HTTP server if it is running.
+ */
+MetricsManager::~MetricsManager() {
+    stopServer();
+}
+
+/**
+ * @brief Finds the calling thread's slot, or hands one out, and caches it.
+ *
+ * Threads beyond METRICS_MAX_THREADS share the overflow slot and may lose increments.
+ *
+ * @return MetricsSlot_t& The slot.
+ */
+MetricsSlot_t &MetricsManager::registerThread() {
+    if (threadToken == 0) {
+        threadToken = nextThreadToken.fetch_add(1);
+    }
+
+    /** Only this thread writes its own token, so it can't be handed out twice. */
+    for (unsigned i = 0; i < METRICS_MAX_THREADS; i++) {
+        if (slots[i].owner.load(std::memory_order_relaxed) == threadToken) {
+            cachedInstance = instanceId;
+            cachedSlot = &slots[i];
+            return *cachedSlot;
+        }
+    }
+
+    unsigned index = registeredThreads.fetch_add(1);
+    if (index >= METRICS_MAX_THREADS) {
+        index = METRICS_MAX_THREADS;
+    } else {
+        slots[index].owner.store(threadToken, std::memory_order_relaxed);
+    }
+
+    cachedInstance = instanceId;
+    cachedSlot = &slots[index];
+    return *cachedSlot;
+}
+
+/**
+ * @brief Sums a transition counter over all threads.
+ *
+ * @param from The state being left.
+ * @param to The state being entered.
+ * @return uint64_t The total.
+ */
+uint64_t MetricsManager::getTransitionCount(FsmStates_e from, FsmStates_e to) {
+    uint64_t total = 0;
+    for (const MetricsSlot_t &slot : slots) {
+        total += slot.transitions[from][to].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+/**
+ * @brief Sums a guard failure counter over all threads.
+ *
+ * @param state The state whose guard failed.
+ * @param reason The reason the guard failed.
+ * @return uint64_t The total.
+ */
+uint64_t MetricsManager::getGuardFailureCount(FsmStates_e state, GuardFailure_e reason) {
+    uint64_t total = 0;
+    for (const MetricsSlot_t &slot : slots) {
+        total += slot.guardFailures[state][reason].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+/**
+ * @brief Sums an event counter over all threads.
+ *
+ * @param counter The counter to sum.
+ * @return uint64_t The total.
+ */
+uint64_t MetricsManager::getCount(MetricCounter_e counter) {
+    uint64_t total = 0;
+    for (const MetricsSlot_t &slot : slots) {
+        total += slot.counters[counter].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+/**
+ * @brief Aggregates all the counters and formats them in the Prometheus text format.
+ *
+ * Only non-zero transition and guard failure series are emitted, to keep the output short.
+ *
+ * @param text Overwritten with the formatted counters.
+ */
+void MetricsManager::scrape(std::string &text) {
+    char line[256];
+
+    text.clear();
+
+    text += "# HELP eae_transitions_total Number of state machine transitions.\n";
+    text += "# TYPE eae_transitions_total counter\n";
+    for (int from = STATE_MIN; from < STATE_MAX; from++) {
+        for (int to = STATE_MIN; to < STATE_MAX; to++) {
+            uint64_t total = getTransitionCount((FsmStates_e)from, (FsmStates_e)to);
+            if (total == 0) {
+                continue;
+            }
+            snprintf(line, sizeof(line), "eae_transitions_total{from=\"%s\",to=\"%s\"} %llu\n",
+                     stateLabels[from], stateLabels[to], (unsigned long long)total);
+            text += line;
+        }
+    }
+
+    text += "# HELP eae_guard_failures_total Number of failed state guards.\n";
+    text += "# TYPE eae_guard_failures_total counter\n";
+    for (int state = STATE_MIN; state < STATE_MAX; state++) {
+        for (int reason = 0; reason < GUARD_MAX; reason++) {
+            uint64_t total = getGuardFailureCount((FsmStates_e)state, (GuardFailure_e)reason);
+            if (total == 0) {
+                continue;
+            }
+            snprintf(line, sizeof(line), "eae_guard_failures_total{state=\"%s\",reason=\"%s\"} %llu\n",
+                     stateLabels[state], guardLabels[reason], (unsigned long long)total);
+            text += line;
+        }
+    }
+
+    for (int counter = 0; counter < METRIC_MAX; counter++) {
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                 counterNames[counter], counterHelp[counter], counterNames[counter], counterNames[counter],
+                 (unsigned long long)getCount((MetricCounter_e)counter));
+        text += line;
+    }
+
+    if (watchdog != nullptr) {
+        scrapeWatchdog(text);
+    }
+}
+
+/**
+ * @brief Formats the watchdog's cycle statistics in the Prometheus text format.
+ *
+ * @param text Appended with the formatted statistics.
+ */
+void MetricsManager::scrapeWatchdog(std::string &text) {
+    WatchdogStatistics_t statistics = {};
+    double deadlineUs = watchdog->getConfig().deadlineUs;
+    uint64_t cumulative = 0;
+    char line[512];
+
+    watchdog->getStatistics(statistics);
+
+    /** Cumulative histogram of the fraction of the deadline used by each cycle. */
+    text += "# HELP eae_cycle_deadline_utilization Fraction of the deadline used by each cycle.\n";
+    text += "# TYPE eae_cycle_deadline_utilization histogram\n";
+    for (int i = 0; i < WATCHDOG_HISTOGRAM_BUCKETS - 1; i++) {
+        cumulative += statistics.histogram[i];
+        snprintf(line, sizeof(line), "eae_cycle_deadline_utilization_bucket{le=\"%.1f\"} %llu\n",
+                 (i + 1) / 10.0, (unsigned long long)cumulative);
+        text += line;
+    }
+    snprintf(line, sizeof(line),
+             "eae_cycle_deadline_utilization_bucket{le=\"+Inf\"} %llu\n"
+             "eae_cycle_deadline_utilization_sum %f\n"
+             "eae_cycle_deadline_utilization_count %llu\n",
+             (unsigned long long)statistics.cycles,
+             deadlineUs > 0 ? statistics.totalDurationUs / deadlineUs : 0.0,
+             (unsigned long long)statistics.cycles);
+    text += line;
+
+    snprintf(line, sizeof(line),
+             "# HELP eae_cycle_max_duration_seconds Longest cycle.\n"
+             "# TYPE eae_cycle_max_duration_seconds gauge\n"
+             "eae_cycle_max_duration_seconds %f\n"
+             "# HELP eae_cycle_min_slack_seconds Smallest margin to the deadline.\n"
+             "# TYPE eae_cycle_min_slack_seconds gauge\n"
+             "eae_cycle_min_slack_seconds %f\n",
+             statistics.maxDurationUs / 1e6,
+             statistics.cycles > 0 ? statistics.minSlackUs / 1e6 : deadlineUs / 1e6);
+    text += line;
+
+    snprintf(line, sizeof(line),
+             "# HELP eae_watchdog_overruns_total Number of missed cycle deadlines.\n"
+             "# TYPE eae_watchdog_overruns_total counter\n"
+             "eae_watchdog_overruns_total %llu\n"
+             "# HELP eae_watchdog_missed_heartbeats_total Number of missed state machine task heartbeats.\n"
+             "# TYPE eae_watchdog_missed_heartbeats_total counter\n"
+             "eae_watchdog_missed_heartbeats_total %llu\n"
+             "# HELP eae_watchdog_tripped Whether the watchdog forced the fatal error state.\n"
+             "# TYPE eae_watchdog_tripped gauge\n"
+             "eae_watchdog_tripped %d\n",
+             (unsigned long long)statistics.overruns, (unsigned long long)statistics.missedHeartbeats,
+             watchdog->isTripped() ? 1 : 0);
+    text += line;
+}
+
+/**
+ * @brief Starts serving GET /metrics on the loopback interface.
+ *
+ * @param port The TCP port to listen on.
+ * @return true If the server was started.
+ */
+bool MetricsManager::startServer(uint16_t port) {
+    struct sockaddr_in address = {};
+    int enable = 1;
+
+    if (serverRunning) {
+        return false;
+    }
+
+    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (serverSocket < 0) {
+        std::cerr << "Failed to create the metrics socket." << std::endl;
+        return false;
+    }
+    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(serverSocket, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(serverSocket, 4) < 0) {
+        std::cerr << "Failed to listen for metrics on port " << port << "." << std::endl;
+        close(serverSocket);
+        serverSocket = -1;
+        return false;
+    }
+
+    serverRunning = true;
+    serverThread = std::thread(&MetricsManager::serve, this);
+    return true;
+}
+
+/**
+ * @brief Stops the HTTP server, if it is running.
+ */
+void MetricsManager::stopServer() {
+    if (serverRunning == false) {
+        return;
+    }
+
+    serverRunning = false;
+    serverThread.join();
+    close(serverSocket);
+    serverSocket = -1;
+}
+
+/**
+ * @brief Accepts and answers scrape requests until stopServer() is called.
+ */
+void MetricsManager::serve() {
+    char request[METRICS_REQUEST_SIZE];
+    char header[128];
+    std::string body;
+
+    while (serverRunning) {
+        struct pollfd fd = {serverSocket, POLLIN, 0};
+        if (poll(&fd, 1, METRICS_POLL_TIMEOUT_MS) <= 0) {
+            continue;
+        }
+
+        int client = accept(serverSocket, nullptr, nullptr);
+        if (client < 0) {
+            continue;
+        }
+        struct timeval timeout = {0, METRICS_CLIENT_TIMEOUT_MS * 1000};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        ssize_t length = recv(client, request, sizeof(request) - 1, 0);
+        request[length > 0 ? length : 0] = '\0';
+
+        if (strncmp(request, "GET /metrics", 12) == 0) {
+            scrape(body);
+            snprintf(header, sizeof(header),
+                     "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n",
+                     body.size());
+        } else {
+            body = "Not found.\n";
+            snprintf(header, sizeof(header),
+                     "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n\r\n",
+                     body.size());
+        }
+
+        send(client, header, strlen(header), MSG_NOSIGNAL);
+        send(client, body.data(), body.size(), MSG_NOSIGNAL);
+        close(client);
+    }
+}
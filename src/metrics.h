@@ -0,0 +1,244 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "fsm.h"
+#include "watchdog.h"
+
+/** Size of a cache line on the target, used to pad the per-thread counter slots. */
+#define METRICS_CACHE_LINE_SIZE 64
+
+/** Maximum number of threads that get their own counter slot. */
+#define METRICS_MAX_THREADS 8
+
+/**
+ * @brief Describes the plain event counters.
+ */
+typedef enum MetricCounter_e {
+    /** Number of calls to StateManager::handleCurrentState(). */
+    METRIC_CYCLES,
+    /** Number of cycles that finished after their deadline. */
+    METRIC_CYCLE_OVERRUNS,
+    /** Number of CAN frames popped from the reception queue. */
+    METRIC_CAN_RX_FRAMES,
+    /** Number of CAN frames pushed onto the transmission queue. */
+    METRIC_CAN_TX_FRAMES,
+    /** Number of CAN frames dropped because the reception queue was full. */
+    METRIC_CAN_RX_DROPS,
+    /** Number of CAN frames dropped because the transmission queue was full. */
+    METRIC_CAN_TX_DROPS,
+    /** Number of received CAN frames rejected because they can't be valid. */
+    METRIC_CAN_RX_MALFORMED,
+    /** Number of received CAN frames ignored because no message has their ID. */
+    METRIC_CAN_RX_UNKNOWN,
+    /** Number of active state cycles with a temperature sensor left out of the vote. */
+    METRIC_FUSION_DEGRADED,
+    /** Number of active state cycles with no majority of the temperature sensors, or none usable. */
+    METRIC_FUSION_FAILED,
+
+    METRIC_MAX
+} MetricCounter_e;
+
+/**
+ * @brief The counters owned by a single thread.
+ *
+ * Each slot is only ever written by one thread, so an increment is a plain
+ * relaxed load and store with no read-modify-write instruction. The atomics
+ * only exist so that the scraping thread can read the values without a data race.
+ * The slot is padded to a cache line so that threads never share a line.
+ */
+typedef struct alignas(METRICS_CACHE_LINE_SIZE) MetricsSlot_t {
+    /** Transitions, indexed by [from][to]. */
+    std::atomic<uint64_t> transitions[STATE_MAX][STATE_MAX];
+    /** Guard failures, indexed by [state][reason]. */
+    std::atomic<uint64_t> guardFailures[STATE_MAX][GUARD_MAX];
+    /** Plain event counters. */
+    std::atomic<uint64_t> counters[METRIC_MAX];
+    /** Token of the thread the slot was handed out to, or 0. Never set on the overflow slot. */
+    std::atomic<uint64_t> owner;
+} MetricsSlot_t;
+
+/**
+ * @brief Collects runtime counters and exposes them in the Prometheus text format
+ * over a local HTTP endpoint.
+ */
+class MetricsManager {
+public:
+    /**
+     * @brief Constructor.
+     */
+    MetricsManager();
+
+    /**
+     * @brief Destructor. Stops the HTTP server if it is running.
+     */
+    ~MetricsManager();
+
+    /**
+     * @brief Counts a transition between two states.
+     *
+     * @param from The state being left.
+     * @param to The state being entered.
+     */
+    void countTransition(FsmStates_e from, FsmStates_e to) {
+        increment(local().transitions[from][to]);
+    }
+
+    /**
+     * @brief Counts a failed guard.
+     *
+     * @param state The state whose guard failed.
+     * @param reason The reason the guard failed.
+     */
+    void countGuardFailure(FsmStates_e state, GuardFailure_e reason) {
+        increment(local().guardFailures[state][reason]);
+    }
+
+    /**
+     * @brief Counts an event.
+     *
+     * @param counter The counter to increment.
+     */
+    void count(MetricCounter_e counter) {
+        increment(local().counters[counter]);
+    }
+
+    /**
+     * @brief Sums a transition counter over all threads.
+     *
+     * @param from The state being left.
+     * @param to The state being entered.
+     * @return uint64_t The total.
+     */
+    uint64_t getTransitionCount(FsmStates_e from, FsmStates_e to);
+
+    /**
+     * @brief Sums a guard failure counter over all threads.
+     *
+     * @param state The state whose guard failed.
+     * @param reason The reason the guard failed.
+     * @return uint64_t The total.
+     */
+    uint64_t getGuardFailureCount(FsmStates_e state, GuardFailure_e reason);
+
+    /**
+     * @brief Sums an event counter over all threads.
+     *
+     * @param counter The counter to sum.
+     * @return uint64_t The total.
+     */
+    uint64_t getCount(MetricCounter_e counter);
+
+    /**
+     * @brief Adds the watchdog's cycle statistics to the scraped metrics.
+     *
+     * @param watchdog The watchdog, may be nullptr.
+     */
+    void attachWatchdog(WatchdogManager *watchdog) {
+        this->watchdog = watchdog;
+    }
+
+    /**
+     * @brief Aggregates all the counters and formats them in the Prometheus text format.
+     *
+     * @param text Overwritten with the formatted counters.
+     */
+    void scrape(std::string &text);
+
+    /**
+     * @brief Starts serving GET /metrics on the loopback interface.
+     *
+     * @param port The TCP port to listen on.
+     * @return true If the server was started.
+     */
+    bool startServer(uint16_t port);
+
+    /**
+     * @brief Stops the HTTP server, if it is running.
+     */
+    void stopServer();
+
+    /**
+     * @brief Retrieves the native handle of the HTTP server thread, so it can be pinned and prioritized.
+     *
+     * @return std::thread::native_handle_type The handle. Only valid while the thread is running.
+     */
+    std::thread::native_handle_type getThreadHandle() {
+        return serverThread.native_handle();
+    }
+
+private:
+    /** One slot per registered thread, plus a shared overflow slot. */
+    MetricsSlot_t slots[METRICS_MAX_THREADS + 1];
+
+    /** Number of slots handed out so far. */
+    std::atomic<unsigned> registeredThreads;
+
+    /** Unique identifier, used to invalidate the per-thread slot cache. */
+    uint64_t instanceId;
+
+    /** Optional source of cycle statistics, may be nullptr. */
+    WatchdogManager *watchdog;
+
+    /** HTTP server state. */
+    std::thread serverThread;
+    std::atomic<bool> serverRunning;
+    int serverSocket;
+
+    /**
+     * The calling thread's cached slot, valid while cachedInstance matches instanceId.
+     * The cache only holds the last instance used, and the slots record their owner's token,
+     * so a thread switching between instances finds its slot again rather than taking another.
+     */
+    static thread_local uint64_t cachedInstance;
+    static thread_local MetricsSlot_t *cachedSlot;
+    static thread_local uint64_t threadToken;
+
+    /**
+     * @brief Retrieves the calling thread's slot, registering the thread on first use.
+     *
+     * @return MetricsSlot_t& The slot.
+     */
+    MetricsSlot_t &local() {
+        if (cachedInstance == instanceId) {
+            return *cachedSlot;
+        }
+        return registerThread();
+    }
+
+    /**
+     * @brief Finds the calling thread's slot, or hands one out, and caches it.
+     *
+     * Threads beyond METRICS_MAX_THREADS share the overflow slot and may lose increments.
+     *
+     * @return MetricsSlot_t& The slot.
+     */
+    MetricsSlot_t &registerThread();
+
+    /**
+     * @brief Increments a counter owned by the calling thread.
+     *
+     * @param counter The counter to increment.
+     */
+    static void increment(std::atomic<uint64_t> &counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Formats the watchdog's cycle statistics in the Prometheus text format.
+     *
+     * @param text Appended with the formatted statistics.
+     */
+    void scrapeWatchdog(std::string &text);
+
+    /**
+     * @brief Accepts and answers scrape requests until stopServer() is called.
+     */
+    void serve();
+};
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/** Size of a cache line on the target, used to keep the queue indices apart. */
+#define QUEUE_CACHE_LINE_SIZE 64
+
+/**
+ * @brief A fixed-capacity, lock-free, multi-producer multi-consumer FIFO.
+ *
+ * All of the storage lives inside the object, so the queue acts as a static pool
+ * for the items passing through it: nothing is allocated after construction, and
+ * a full queue rejects new items instead of growing.
+ *
+ * Each cell carries a sequence number that tells producers and consumers whether
+ * it is free or filled for the current lap, as described by Dmitry Vyukov's
+ * bounded MPMC queue.
+ *
+ * @tparam T The item type. Copied in and out of the queue.
+ * @tparam N The capacity. Must be a power of two.
+ */
+template <typename T, size_t N>
+class BoundedQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "The capacity must be a power of two.");
+
+public:
+    /**
+     * @brief Constructor.
+     */
+    BoundedQueue() : enqueuePosition(0), dequeuePosition(0) {
+        for (size_t i = 0; i < N; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    /**
+     * @brief Copies an item to the back of the queue.
+     *
+     * @param item The item to push.
+     * @return true If the item was pushed, false if the queue is full.
+     */
+    bool push(const T &item) {
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        Cell *cell = nullptr;
+
+        while (true) {
+            cell = &cells[position & (N - 1)];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+            if (difference == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = item;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Copies the item at the front of the queue out, and removes it.
+     *
+     * @param item Overwritten with the popped item.
+     * @return true If an item was popped, false if the queue is empty.
+     */
+    bool pop(T &item) {
+        size_t position = dequeuePosition.load(std::memory_order_relaxed);
+        Cell *cell = nullptr;
+
+        while (true) {
+            cell = &cells[position & (N - 1)];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+
+            if (difference == 0) {
+                if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        item = cell->data;
+        cell->sequence.store(position + N, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Retrieves the number of items in the queue.
+     * Only approximate while other threads are pushing or popping.
+     *
+     * @return size_t The number of items.
+     */
+    size_t size() {
+        size_t enqueued = enqueuePosition.load(std::memory_order_relaxed);
+        size_t dequeued = dequeuePosition.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    /**
+     * @brief Retrieves the capacity of the queue.
+     *
+     * @return size_t The capacity.
+     */
+    static constexpr size_t capacity() {
+        return N;
+    }
+
+private:
+    /**
+     * @brief A slot in the queue.
+     */
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    Cell cells[N];
+
+    /**
+     * The indices are padded apart so that producers and consumers
+     * don't invalidate each other's cache lines.
+     */
+    char padding0[QUEUE_CACHE_LINE_SIZE];
+    std::atomic<size_t> enqueuePosition;
+    char padding1[QUEUE_CACHE_LINE_SIZE];
+    std::atomic<size_t> dequeuePosition;
+    char padding2[QUEUE_CACHE_LINE_SIZE];
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef RADIATOR_H
+#define RADIATOR_H
+
+/**
+ * Shape of the radiator's heat transfer. It saturates with the coolant flow, reaching half of its range
+ * at this fraction of the pump's duty cycle, and rises linearly with the airflow, from this fraction
+ * with the fan off, which is the vehicle's own airflow.
+ */
+#define RADIATOR_PUMP_HALF_FLOW 0.25f
+#define RADIATOR_FAN_FLOOR 0.3f
+
+/** Electrical power of the fan and the pump at full duty, in W. */
+#define RADIATOR_FAN_RATED_W 300.0f
+#define RADIATOR_PUMP_RATED_W 100.0f
+
+/**
+ * @brief The model of the radiator, the pump and the fan, shared by the controller's allocation
+ * and the tools' coolant loop model so that they can't drift apart.
+ *
+ * The duty cycles are from 0 to 1.
+ */
+class RadiatorModel {
+public:
+    /**
+     * @brief Computes the coolant flow's share of the heat transfer.
+     *
+     * @param pumpDuty The pump duty cycle.
+     * @return float The share, from 0 to 1.
+     */
+    static float getFlowFactor(float pumpDuty) {
+        return pumpDuty * (1.0f + RADIATOR_PUMP_HALF_FLOW) / (pumpDuty + RADIATOR_PUMP_HALF_FLOW);
+    }
+
+    /**
+     * @brief Computes the pump duty cycle giving a coolant flow's share of the heat transfer.
+     *
+     * @param flowFactor The share, from 0 to 1.
+     * @return float The pump duty cycle.
+     */
+    static float getPumpDutyForFlow(float flowFactor) {
+        return flowFactor * RADIATOR_PUMP_HALF_FLOW / (1.0f + RADIATOR_PUMP_HALF_FLOW - flowFactor);
+    }
+
+    /**
+     * @brief Computes the airflow's share of the heat transfer.
+     *
+     * @param fanDuty The fan duty cycle.
+     * @return float The share, from RADIATOR_FAN_FLOOR to 1.
+     */
+    static float getAirflowFactor(float fanDuty) {
+        return RADIATOR_FAN_FLOOR + (1.0f - RADIATOR_FAN_FLOOR) * fanDuty;
+    }
+
+    /**
+     * @brief Computes the heat transfer, relative to full duty.
+     *
+     * @param fanDuty The fan duty cycle.
+     * @param pumpDuty The pump duty cycle.
+     * @return float The heat transfer, from 0 to 1.
+     */
+    static float getHeatTransfer(float fanDuty, float pumpDuty) {
+        return getFlowFactor(pumpDuty) * getAirflowFactor(fanDuty);
+    }
+
+    /**
+     * @brief Computes the electrical power of the pump and the fan, which scales with the cube
+     * of the duty cycle, following the affinity laws.
+     *
+     * @param fanRatedW The fan's power at full duty, in W.
+     * @param pumpRatedW The pump's power at full duty, in W.
+     * @param fanDuty The fan duty cycle.
+     * @param pumpDuty The pump duty cycle.
+     * @return float The power, in W.
+     */
+    static float getElectricalPowerW(float fanRatedW, float pumpRatedW, float fanDuty, float pumpDuty) {
+        return fanRatedW * fanDuty * fanDuty * fanDuty + pumpRatedW * pumpDuty * pumpDuty * pumpDuty;
+    }
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <iostream>
+
+#include "realtime.h"
+
+/** Names of the thread roles, used in the reports. */
+static const char *roleNames[REALTIME_THREAD_MAX] = {
+    "control",
+    "state",
+    "supervisor",
+    "aux",
+};
+
+/**
+ * @brief Locks all current and future memory and pre-faults the heap.
+ * Must be called before any threads are started.
+ *
+ * @return true If every step succeeded.
+ */
+bool RealtimeManager::initialize() {
+    bool ok = true;
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        std::cerr << "Failed to lock memory: " << strerror(errno) << std::endl;
+        ok = false;
+    }
+
+    prefaultHeap();
+    return ok;
+}
+
+/**
+ * @brief Pins the calling thread and sets its priority, then pre-faults its stack.
+ *
+ * @param role The role of the calling thread.
+ * @return true If every step succeeded.
+ */
+bool RealtimeManager::configureCurrentThread(RealtimeThread_e role) {
+    bool ok = configureThread(pthread_self(), role);
+    prefaultStack();
+    return ok;
+}
+
+/**
+ * @brief Pins a thread and sets its priority.
+ *
+ * @param thread The native handle of the thread.
+ * @param role The role of the thread.
+ * @return true If every step succeeded.
+ */
+bool RealtimeManager::configureThread(std::thread::native_handle_type thread, RealtimeThread_e role) {
+    bool ok = true;
+    int result = 0;
+
+    if (config.cpu[role] >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config.cpu[role], &cpus);
+
+        result = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+        if (result != 0) {
+            std::cerr << "Failed to pin the " << roleNames[role] << " thread to CPU " << config.cpu[role]
+                      << ": " << strerror(result) << std::endl;
+            ok = false;
+        }
+    }
+
+    if (config.priority[role] > 0) {
+        struct sched_param param = {};
+        param.sched_priority = config.priority[role];
+
+        result = pthread_setschedparam(thread, SCHED_FIFO, &param);
+        if (result != 0) {
+            std::cerr << "Failed to set the " << roleNames[role] << " thread to SCHED_FIFO priority "
+                      << config.priority[role] << ": " << strerror(result) << std::endl;
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+/**
+ * @brief Retrieves the number of page faults taken by the calling thread so far.
+ *
+ * @return long The number of minor and major page faults.
+ */
+long RealtimeManager::readPageFaults() {
+    struct rusage usage = {};
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+/**
+ * @brief Touches REALTIME_STACK_PREFAULT_SIZE bytes of the calling thread's stack.
+ *
+ * The buffer is volatile so that the compiler can't remove the writes.
+ */
+void RealtimeManager::prefaultStack() {
+    volatile unsigned char stack[REALTIME_STACK_PREFAULT_SIZE];
+    long pageSize = sysconf(_SC_PAGESIZE);
+
+    for (size_t i = 0; i < sizeof(stack); i += pageSize) {
+        stack[i] = 0;
+    }
+}
+
+/**
+ * @brief Stops the allocator from returning memory to the system
+ * and touches REALTIME_HEAP_PREFAULT_SIZE bytes of heap.
+ *
+ * Large allocations are served from the main arena instead of fresh mappings,
+ * so the touched pages are reused for later allocations without faulting.
+ */
+void RealtimeManager::prefaultHeap() {
+    long pageSize = sysconf(_SC_PAGESIZE);
+
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    /** Volatile so that the compiler can't remove the allocation and the writes. */
+    volatile char *heap = (volatile char *)malloc(REALTIME_HEAP_PREFAULT_SIZE);
+    if (heap == nullptr) {
+        return;
+    }
+    for (size_t i = 0; i < REALTIME_HEAP_PREFAULT_SIZE; i += pageSize) {
+        heap[i] = 0;
+    }
+    free((void *)heap);
+}
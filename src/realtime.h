@@ -0,0 +1,102 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <cstddef>
+#include <thread>
+
+/** Amount of stack touched on the control thread so that it never faults during a cycle. */
+#define REALTIME_STACK_PREFAULT_SIZE (256 * 1024)
+
+/** Amount of heap touched at startup and kept by the allocator. */
+#define REALTIME_HEAP_PREFAULT_SIZE (4 * 1024 * 1024)
+
+/**
+ * @brief Describes the roles of the application's threads.
+ */
+typedef enum RealtimeThread_e {
+    /** Runs the state machine, or only the control loop when the tasks are split. */
+    REALTIME_THREAD_CONTROL,
+    /** Runs the state machine when the tasks are split. Must not preempt the control loop. */
+    REALTIME_THREAD_STATE,
+    /** Runs the watchdog. Must be able to preempt a stalled control thread. */
+    REALTIME_THREAD_SUPERVISOR,
+    /** Runs non-critical work, like serving metrics and writing logs. */
+    REALTIME_THREAD_AUX,
+
+    REALTIME_THREAD_MAX
+} RealtimeThread_e;
+
+/**
+ * @brief The real-time runtime parameters.
+ */
+typedef struct RealtimeConfig_t {
+    /** The CPU each thread is pinned to, or -1 to leave it unpinned. */
+    int cpu[REALTIME_THREAD_MAX];
+    /** The SCHED_FIFO priority of each thread, or 0 to leave it on the default scheduler. */
+    int priority[REALTIME_THREAD_MAX];
+} RealtimeConfig_t;
+
+/**
+ * @brief Sets up the process and its threads to run with bounded latency:
+ * locked and pre-faulted memory, pinned CPUs and SCHED_FIFO priorities.
+ *
+ * Each step that fails, usually for lack of privileges, is reported and
+ * skipped, so the application still runs without real-time guarantees.
+ */
+class RealtimeManager {
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param config The real-time parameters.
+     */
+    RealtimeManager(RealtimeConfig_t config) : config(config) {}
+
+    /**
+     * @brief Locks all current and future memory and pre-faults the heap.
+     * Must be called before any threads are started.
+     *
+     * @return true If every step succeeded.
+     */
+    bool initialize();
+
+    /**
+     * @brief Pins the calling thread and sets its priority, then pre-faults its stack.
+     *
+     * @param role The role of the calling thread.
+     * @return true If every step succeeded.
+     */
+    bool configureCurrentThread(RealtimeThread_e role);
+
+    /**
+     * @brief Pins a thread and sets its priority.
+     *
+     * @param thread The native handle of the thread.
+     * @param role The role of the thread.
+     * @return true If every step succeeded.
+     */
+    bool configureThread(std::thread::native_handle_type thread, RealtimeThread_e role);
+
+    /**
+     * @brief Retrieves the number of page faults taken by the calling thread so far.
+     *
+     * @return long The number of minor and major page faults.
+     */
+    static long readPageFaults();
+
+private:
+    RealtimeConfig_t config;
+
+    /**
+     * @brief Touches REALTIME_STACK_PREFAULT_SIZE bytes of the calling thread's stack.
+     */
+    static void prefaultStack();
+
+    /**
+     * @brief Stops the allocator from returning memory to the system
+     * and touches REALTIME_HEAP_PREFAULT_SIZE bytes of heap.
+     */
+    static void prefaultHeap();
+};
+
+#endif
@@ -0,0 +1,225 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "snapshot.h"
+#include "log.h"
+
+/** Marks a snapshot file. */
+#define SNAPSHOT_MAGIC 0x534E4150U
+
+/** FNV-1a parameters. */
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+/**
+ * @brief Constructor.
+ *
+ * @param path The snapshot file.
+ * @param maxAgeMs Oldest snapshot restore() accepts, in milliseconds.
+ */
+SnapshotManager::SnapshotManager(const char *path, uint32_t maxAgeMs)
+    : path(path), maxAgeMs(maxAgeMs), fd(-1), file(nullptr), sequence(0), running(false) {}
+
+/**
+ * @brief Destructor. Stops the writer thread if it is running, and unmaps the file.
+ */
+SnapshotManager::~SnapshotManager() {
+    stop();
+    if (file != nullptr) {
+        munmap(file, sizeof(SnapshotFile_t));
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/**
+ * @brief Maps the file, creating it if needed.
+ *
+ * A file with another layout, ie. written by another version, is cleared.
+ *
+ * @return true If the file is mapped.
+ */
+bool SnapshotManager::open() {
+    if (file != nullptr) {
+        return true;
+    }
+
+    fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(SnapshotFile_t)) != 0) {
+        LogManager::log(LOG_ERROR, "Failed to open the snapshot file.");
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, sizeof(SnapshotFile_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        LogManager::log(LOG_ERROR, "Failed to map the snapshot file.");
+        return false;
+    }
+    file = (SnapshotFile_t *)mapping;
+
+    if (file->magic != SNAPSHOT_MAGIC || file->version != SNAPSHOT_VERSION || file->size != sizeof(SnapshotFile_t)) {
+        memset(mapping, 0, sizeof(SnapshotFile_t));
+        file->magic = SNAPSHOT_MAGIC;
+        file->version = SNAPSHOT_VERSION;
+        file->size = sizeof(SnapshotFile_t);
+    }
+
+    /** Carry on numbering from the newest slot. */
+    for (SnapshotSlot_t &slot : file->slots) {
+        uint64_t slotSequence = slot.sequence.load(std::memory_order_acquire);
+        if (slotSequence > sequence) {
+            sequence = slotSequence;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Saves a snapshot. Called by the writer thread, or by a background task.
+ *
+ * @param snapshot The snapshot. Its timestamp is set to the current time.
+ */
+void SnapshotManager::save(Snapshot_t &snapshot) {
+    if (file == nullptr) {
+        return;
+    }
+
+    snapshot.timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    /** Overwrite the older slot. */
+    sequence++;
+    SnapshotSlot_t &slot = file->slots[sequence % 2];
+
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&slot.snapshot, &snapshot, sizeof(Snapshot_t));
+    slot.checksum = checksum(slot.snapshot);
+    slot.sequence.store(sequence, std::memory_order_release);
+}
+
+/**
+ * @brief Hands a snapshot to the writer thread, replacing the one it hasn't saved yet.
+ * Called by the control thread, which never touches the mapped file.
+ *
+ * @param snapshot The snapshot.
+ */
+void SnapshotManager::post(const Snapshot_t &snapshot) {
+    pending.post(snapshot);
+}
+
+/**
+ * @brief Saves the latest posted snapshot, if one was posted since the last call.
+ * Called by the writer thread.
+ *
+ * @return true If a snapshot was saved.
+ */
+bool SnapshotManager::flush() {
+    Snapshot_t snapshot = {};
+
+    if (pending.fetch(snapshot) == false) {
+        return false;
+    }
+    save(snapshot);
+    return true;
+}
+
+/**
+ * @brief Starts the writer thread, which calls flush() every SNAPSHOT_FLUSH_PERIOD_MS.
+ */
+void SnapshotManager::start() {
+    if (running) {
+        return;
+    }
+
+    running = true;
+    writerThread = std::thread(&SnapshotManager::run, this);
+}
+
+/**
+ * @brief Stops the writer thread and saves the last posted snapshot.
+ */
+void SnapshotManager::stop() {
+    if (running == false) {
+        return;
+    }
+
+    running = false;
+    writerThread.join();
+    flush();
+}
+
+/**
+ * @brief Retrieves the latest valid snapshot.
+ *
+ * A slot is valid if its sequence number didn't change while it was copied,
+ * its checksum matches, its state is in range, and it isn't older than the maximum age.
+ *
+ * @param snapshot Overwritten with the snapshot.
+ * @return true If a snapshot was found that is intact and recent enough.
+ */
+bool SnapshotManager::restore(Snapshot_t &snapshot) {
+    Snapshot_t candidate = {};
+    uint64_t bestSequence = 0;
+    uint64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    if (file == nullptr) {
+        return false;
+    }
+
+    for (SnapshotSlot_t &slot : file->slots) {
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        memcpy(&candidate, &slot.snapshot, sizeof(Snapshot_t));
+        uint64_t slotChecksum = slot.checksum;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+
+        if (before == 0 || before != after || before <= bestSequence || checksum(candidate) != slotChecksum) {
+            continue;
+        }
+        if (candidate.state <= STATE_MIN || candidate.state >= STATE_MAX) {
+            continue;
+        }
+        if (candidate.timestampMs > nowMs || nowMs - candidate.timestampMs > maxAgeMs) {
+            continue;
+        }
+
+        memcpy(&snapshot, &candidate, sizeof(Snapshot_t));
+        bestSequence = before;
+    }
+
+    return bestSequence > 0;
+}
+
+/**
+ * @brief Computes the FNV-1a hash of a snapshot.
+ *
+ * @param snapshot The snapshot.
+ * @return uint64_t The hash.
+ */
+uint64_t SnapshotManager::checksum(const Snapshot_t &snapshot) {
+    const uint8_t *bytes = (const uint8_t *)&snapshot;
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    for (size_t i = 0; i < sizeof(Snapshot_t); i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Calls flush() every SNAPSHOT_FLUSH_PERIOD_MS until stop() is called.
+ */
+void SnapshotManager::run() {
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(SNAPSHOT_FLUSH_PERIOD_MS));
+        flush();
+    }
+}
@@ -0,0 +1,169 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "fsm.h"
+#include "controller.h"
+#include "mailbox.h"
+
+/** Oldest snapshot a warm start resumes from, in milliseconds. */
+#define SNAPSHOT_MAX_AGE_MS 5000
+
+/** Bumped whenever the layout of the snapshot file changes. */
+#define SNAPSHOT_VERSION 1
+
+/** How often the writer thread saves the latest posted snapshot. */
+#define SNAPSHOT_FLUSH_PERIOD_MS 100
+
+/**
+ * @brief Everything needed to resume the control loop after a restart.
+ */
+typedef struct Snapshot_t {
+    /** The state machine state. */
+    FsmStates_e state;
+    /** The PID loop internals. */
+    ControllerState_t controller;
+    /** The last outputs. */
+    PlcOutputs_t outputs;
+    /** When the snapshot was taken, in milliseconds since the Unix epoch. Set by save(). */
+    uint64_t timestampMs;
+} Snapshot_t;
+
+/**
+ * @brief Keeps the latest snapshot of the control loop in a memory-mapped file,
+ * so that a restarted process can resume where the last one left off.
+ *
+ * The file holds two slots, written alternately. A slot is invalidated, written,
+ * checksummed, and then published by storing its sequence number, so saving never
+ * locks and a process that dies mid-save leaves the other slot intact. On restore,
+ * the valid slot with the highest sequence number wins.
+ *
+ * The mapping is shared, so the snapshot survives the process but not a power loss.
+ * Once the kernel has written a dirty page back, the next write to it faults, so the
+ * control thread only posts its snapshots, and a writer thread saves the latest one.
+ */
+class SnapshotManager {
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param path The snapshot file.
+     * @param maxAgeMs Oldest snapshot restore() accepts, in milliseconds.
+     */
+    SnapshotManager(const char *path, uint32_t maxAgeMs = SNAPSHOT_MAX_AGE_MS);
+
+    /**
+     * @brief Destructor. Stops the writer thread if it is running, and unmaps the file.
+     */
+    ~SnapshotManager();
+
+    SnapshotManager(const SnapshotManager &) = delete;
+    SnapshotManager &operator=(const SnapshotManager &) = delete;
+
+    /**
+     * @brief Maps the file, creating it if needed.
+     *
+     * @return true If the file is mapped.
+     */
+    bool open();
+
+    /**
+     * @brief Saves a snapshot. Called by the writer thread, or by a background task.
+     *
+     * @param snapshot The snapshot. Its timestamp is set to the current time.
+     */
+    void save(Snapshot_t &snapshot);
+
+    /**
+     * @brief Hands a snapshot to the writer thread, replacing the one it hasn't saved yet.
+     * Called by the control thread, which never touches the mapped file.
+     *
+     * @param snapshot The snapshot.
+     */
+    void post(const Snapshot_t &snapshot);
+
+    /**
+     * @brief Saves the latest posted snapshot, if one was posted since the last call.
+     * Called by the writer thread.
+     *
+     * @return true If a snapshot was saved.
+     */
+    bool flush();
+
+    /**
+     * @brief Starts the writer thread, which calls flush() every SNAPSHOT_FLUSH_PERIOD_MS.
+     */
+    void start();
+
+    /**
+     * @brief Stops the writer thread and saves the last posted snapshot.
+     */
+    void stop();
+
+    /**
+     * @brief Retrieves the native handle of the writer thread, so it can be pinned and prioritized.
+     *
+     * @return std::thread::native_handle_type The handle. Only valid while the thread is running.
+     */
+    std::thread::native_handle_type getThreadHandle() {
+        return writerThread.native_handle();
+    }
+
+    /**
+     * @brief Retrieves the latest valid snapshot.
+     *
+     * @param snapshot Overwritten with the snapshot.
+     * @return true If a snapshot was found that is intact and recent enough.
+     */
+    bool restore(Snapshot_t &snapshot);
+
+    /** A slot of the snapshot file. */
+    typedef struct SnapshotSlot_t {
+        /** 0 while the slot is being written. */
+        std::atomic<uint64_t> sequence;
+        uint64_t checksum;
+        Snapshot_t snapshot;
+    } SnapshotSlot_t;
+
+    /** The layout of the snapshot file. */
+    typedef struct SnapshotFile_t {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t size;
+        SnapshotSlot_t slots[2];
+    } SnapshotFile_t;
+
+private:
+    const char *path;
+    uint32_t maxAgeMs;
+    int fd;
+    SnapshotFile_t *file;
+
+    /** The sequence number of the last saved snapshot. */
+    uint64_t sequence;
+
+    /** From the control thread to the writer thread. */
+    Mailbox<Snapshot_t> pending;
+
+    /** Writer thread state. */
+    std::thread writerThread;
+    std::atomic<bool> running;
+
+    /**
+     * @brief Calls flush() every SNAPSHOT_FLUSH_PERIOD_MS until stop() is called.
+     */
+    void run();
+
+    /**
+     * @brief Computes the FNV-1a hash of a snapshot.
+     *
+     * @param snapshot The snapshot.
+     * @return uint64_t The hash.
+     */
+    static uint64_t checksum(const Snapshot_t &snapshot);
+};
+
+#endif
@@ -0,0 +1,208 @@
+#include <chrono>
+
+#include "tasks.h"
+#include "watchdog.h"
+#include "snapshot.h"
+#include "tripwire.h"
+
+/**
+ * @brief Constructor.
+ *
+ * @param hal The HAL.
+ * @param controller The controller, owned by the control task once started.
+ * @param config The rates of the tasks.
+ * @param watchdog Optional watchdog, timing the control task and the state machine heartbeat. May be nullptr.
+ * @param snapshots Optional snapshot store, written by the background task. May be nullptr.
+ * @param fusion Optional fusion of several temperature sensors, run by the control task. May be nullptr.
+ */
+TaskManager::TaskManager(HardwareManager *hal, ControlManager *controller, TaskConfig_t config,
+                         WatchdogManager *watchdog, SnapshotManager *snapshots, FusionManager *fusion)
+    : hal(hal), controller(controller), config(config), watchdog(watchdog), snapshots(snapshots),
+      fusion(fusion), worstFusionHealth(FUSION_HEALTHY), command(), inputs(), activation(0), controlCycles(0), lastState(STATE_MIN), lastStatus(), hasState(false),
+      hasStatus(false), fsm(nullptr), running(false) {}
+
+/**
+ * @brief Destructor. Stops the threads if they are running.
+ */
+TaskManager::~TaskManager() {
+    stop();
+}
+
+/**
+ * @brief Starts the state machine and background threads.
+ * The control task is run by the caller, with runControl().
+ *
+ * @param fsm The state machine, with this manager attached.
+ */
+void TaskManager::start(StateManager *fsm) {
+    if (running) {
+        return;
+    }
+
+    this->fsm = fsm;
+    running = true;
+
+    /** Start the heartbeat check from now, so that a state machine task that never runs is caught too. */
+    if (watchdog != nullptr) {
+        watchdog->heartbeat();
+    }
+    stateThread = std::thread(&TaskManager::runStateLoop, this);
+    backgroundThread = std::thread(&TaskManager::runBackgroundLoop, this);
+}
+
+/**
+ * @brief Stops the state machine and background threads.
+ */
+void TaskManager::stop() {
+    if (running == false) {
+        return;
+    }
+
+    running = false;
+    stateThread.join();
+    backgroundThread.join();
+
+    if (watchdog != nullptr) {
+        watchdog->disarmHeartbeat();
+    }
+}
+
+/**
+ * @brief Runs one cycle of the control task. Called by the control thread every control period.
+ *
+ * The controller and the fusion are reset when the state machine starts the equipment again,
+ * and left alone while it is disabled. The cycle takes none of the HAL locks: it runs on the
+ * inputs sampled last, and hands its duty cycles to the thread that writes the registers.
+ */
+void TaskManager::runControl() {
+    ControlStatus_t status = {};
+    FusedTemperature_t fused = {};
+
+    /** Nothing in the cycle may allocate. */
+    AllocationTripwire::arm();
+
+    if (watchdog != nullptr) {
+        watchdog->beginCycle();
+    }
+
+    commands.fetch(command);
+    if (command.enabled) {
+        if (command.activation != activation) {
+            controller->reset();
+            if (fusion != nullptr) {
+                fusion->reset();
+            }
+            worstFusionHealth.store(FUSION_HEALTHY, std::memory_order_relaxed);
+            activation = command.activation;
+        }
+
+        hal->fetchControlInputs(inputs);
+        if (fusion != nullptr) {
+            fusion->fuse(inputs, fused);
+            controller->process(fused, status.fanPowerPercent, status.pumpPowerPercent);
+
+            /** Keep the worst health until the state machine task consumes it. */
+            uint8_t worst = worstFusionHealth.load(std::memory_order_relaxed);
+            while (fused.health > worst &&
+                   worstFusionHealth.compare_exchange_weak(worst, (uint8_t)fused.health, std::memory_order_relaxed) == false) {
+            }
+        } else {
+            controller->process(inputs.temperature, status.fanPowerPercent, status.pumpPowerPercent);
+        }
+        hal->setPowerOutputs(status.fanPowerPercent, status.pumpPowerPercent);
+    }
+
+    controlCycles++;
+    controller->saveState(status.controller);
+    status.cycles = controlCycles;
+    statuses.post(status);
+
+    AllocationTripwire::disarm();
+
+    if (watchdog != nullptr) {
+        watchdog->endCycle();
+    }
+}
+
+/**
+ * @brief Runs one cycle of the background task.
+ *
+ * A snapshot is only saved once both the state machine and the control task have
+ * posted their state, so that it never pairs a state with a controller that hasn't run.
+ */
+void TaskManager::runBackground() {
+    Snapshot_t snapshot = {};
+
+    hasState = states.fetch(lastState) || hasState;
+    hasStatus = statuses.fetch(lastStatus) || hasStatus;
+
+    if (snapshots != nullptr && hasState && hasStatus) {
+        snapshot.state = lastState;
+        snapshot.controller = lastStatus.controller;
+        hal->retrieveOutputs(snapshot.outputs);
+        snapshots->save(snapshot);
+    }
+}
+
+/**
+ * @brief Publishes the state machine's state to the other tasks.
+ * Called by the state machine at the end of each cycle.
+ *
+ * @param state The current state.
+ * @param activation Number of times the equipment was started.
+ */
+void TaskManager::publishState(FsmStates_e state, uint32_t activation) {
+    ControlCommand_t next = {state == STATE_ACTIVE, activation};
+
+    commands.post(next);
+    states.post(state);
+}
+
+/**
+ * @brief Runs the state machine every stateDivisor control periods until stop() is called.
+ */
+void TaskManager::runStateLoop() {
+    const std::chrono::microseconds period((uint64_t)config.controlPeriodUs * config.stateDivisor);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now();
+    CanFrame_t frame = {};
+
+    while (running) {
+        fsm->handleCurrentState();
+
+        /** Hand the queued frames to the CAN driver. */
+        while (hal->popTransmitCanFrame(frame)) {
+            /** Call the underlying CAN driver to transmit the frame. */
+        }
+
+        if (watchdog != nullptr) {
+            watchdog->heartbeat();
+        }
+
+        /** Skip the missed periods, rather than running them back to back. */
+        deadline += period;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        while (deadline < now) {
+            deadline += period;
+        }
+        std::this_thread::sleep_until(deadline);
+    }
+}
+
+/**
+ * @brief Calls runBackground() every background period until stop() is called.
+ */
+void TaskManager::runBackgroundLoop() {
+    const std::chrono::milliseconds period(config.backgroundPeriodMs);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now();
+
+    while (running) {
+        runBackground();
+
+        deadline += period;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        while (deadline < now) {
+            deadline += period;
+        }
+        std::this_thread::sleep_until(deadline);
+    }
+}
@@ -0,0 +1,212 @@
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "fsm.h"
+#include "mailbox.h"
+
+class WatchdogManager;
+class SnapshotManager;
+
+/** Default number of control periods per state machine period. */
+#define TASK_DEFAULT_STATE_DIVISOR 10
+
+/** Number of state machine periods without a heartbeat before the watchdog trips. */
+#define TASK_STATE_HEARTBEAT_PERIODS 2
+
+/** Default period of the background task. */
+#define TASK_DEFAULT_BACKGROUND_PERIOD_MS 100
+
+/**
+ * @brief The rates of the tasks.
+ */
+typedef struct TaskConfig_t {
+    /** Period of the control task, in microseconds. */
+    uint32_t controlPeriodUs;
+    /** Number of control periods per state machine period. */
+    uint32_t stateDivisor;
+    /** Period of the background task, in milliseconds. */
+    uint32_t backgroundPeriodMs;
+} TaskConfig_t;
+
+/**
+ * @brief Posted by the state machine task to the control task.
+ */
+typedef struct ControlCommand_t {
+    /** Whether the control loop drives the fan and the pump. */
+    bool enabled;
+    /** Incremented each time the equipment is started, so that the control loop starts from scratch. */
+    uint32_t activation;
+} ControlCommand_t;
+
+/**
+ * @brief Posted by the control task to the background task.
+ */
+typedef struct ControlStatus_t {
+    /** The PID loop internals, after the last cycle. */
+    ControllerState_t controller;
+    /** The duty cycles of the last cycle. */
+    int fanPowerPercent;
+    int pumpPowerPercent;
+    /** Number of control cycles run. */
+    uint64_t cycles;
+} ControlStatus_t;
+
+/**
+ * @brief Splits the cycle into tasks running at their own rate and priority.
+ *
+ * - The control task runs the PID loop every control period, on the caller's thread.
+ *   It only reads the temperature and writes the duty cycles.
+ * - The state machine task runs the guards, transitions and display updates every
+ *   stateDivisor control periods, and hands the queued CAN frames to the driver.
+ * - The background task saves the snapshots.
+ *
+ * The tasks only share the HAL and the latest state of each other, through mailboxes,
+ * so a slow state machine or background cycle never delays a control cycle. The control task
+ * doesn't take the HAL locks either: the registers are read and written by the state
+ * machine task, which hands the sampled inputs to the control task and applies its duty
+ * cycles every state machine period.
+ * The equipment is still enabled and disabled by the state machine. The control task only
+ * sets the duty cycles of enabled equipment, so it can't undo a guard failure.
+ */
+class TaskManager {
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param hal The HAL.
+     * @param controller The controller, owned by the control task once started.
+     * @param config The rates of the tasks.
+     * @param watchdog Optional watchdog, timing the control task and the state machine heartbeat. May be nullptr.
+     * @param snapshots Optional snapshot store, written by the background task. May be nullptr.
+     * @param fusion Optional fusion of several temperature sensors, run by the control task. May be nullptr.
+     */
+    TaskManager(HardwareManager *hal, ControlManager *controller, TaskConfig_t config,
+                WatchdogManager *watchdog = nullptr, SnapshotManager *snapshots = nullptr,
+                FusionManager *fusion = nullptr);
+
+    /**
+     * @brief Destructor. Stops the threads if they are running.
+     */
+    ~TaskManager();
+
+    TaskManager(const TaskManager &) = delete;
+    TaskManager &operator=(const TaskManager &) = delete;
+
+    /**
+     * @brief Starts the state machine and background threads.
+     * The control task is run by the caller, with runControl().
+     *
+     * @param fsm The state machine, with this manager attached.
+     */
+    void start(StateManager *fsm);
+
+    /**
+     * @brief Stops the state machine and background threads.
+     */
+    void stop();
+
+    /**
+     * @brief Runs one cycle of the control task. Called by the control thread every control period.
+     */
+    void runControl();
+
+    /**
+     * @brief Runs one cycle of the background task.
+     */
+    void runBackground();
+
+    /**
+     * @brief Publishes the state machine's state to the other tasks.
+     * Called by the state machine at the end of each cycle.
+     *
+     * @param state The current state.
+     * @param activation Number of times the equipment was started.
+     */
+    void publishState(FsmStates_e state, uint32_t activation);
+
+    /**
+     * @brief Retrieves the worst fusion health of the control cycles since the last call.
+     * Called by the state machine task.
+     *
+     * @return FusionHealth_e The health. FUSION_HEALTHY without fusion.
+     */
+    FusionHealth_e consumeFusionHealth() {
+        return (FusionHealth_e)worstFusionHealth.exchange(FUSION_HEALTHY, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Retrieves the native handle of the state machine thread, so it can be pinned and prioritized.
+     *
+     * @return std::thread::native_handle_type The handle. Only valid while the thread is running.
+     */
+    std::thread::native_handle_type getStateThreadHandle() {
+        return stateThread.native_handle();
+    }
+
+    /**
+     * @brief Retrieves the native handle of the background thread, so it can be pinned and prioritized.
+     *
+     * @return std::thread::native_handle_type The handle. Only valid while the thread is running.
+     */
+    std::thread::native_handle_type getBackgroundThreadHandle() {
+        return backgroundThread.native_handle();
+    }
+
+private:
+    HardwareManager *hal;
+    ControlManager *controller;
+    TaskConfig_t config;
+
+    /** Optional watchdog, may be nullptr. */
+    WatchdogManager *watchdog;
+
+    /** Optional snapshot store, may be nullptr. */
+    SnapshotManager *snapshots;
+
+    /** Optional fusion of several temperature sensors, may be nullptr. */
+    FusionManager *fusion;
+
+    /** From the state machine task to the control task. */
+    Mailbox<ControlCommand_t> commands;
+
+    /** From the control task to the state machine task. The health values are ordered by severity. */
+    std::atomic<uint8_t> worstFusionHealth;
+
+    /** From the state machine task and the control task to the background task. */
+    Mailbox<FsmStates_e> states;
+    Mailbox<ControlStatus_t> statuses;
+
+    /** The latest command and inputs, and the activation the controller was last reset for. Owned by the control task. */
+    ControlCommand_t command;
+    PlcInputs_t inputs;
+    uint32_t activation;
+    uint64_t controlCycles;
+
+    /** The latest state and status. Owned by the background task. */
+    FsmStates_e lastState;
+    ControlStatus_t lastStatus;
+    bool hasState;
+    bool hasStatus;
+
+    /** Thread state. */
+    StateManager *fsm;
+    std::thread stateThread;
+    std::thread backgroundThread;
+    std::atomic<bool> running;
+
+    /**
+     * @brief Runs the state machine every stateDivisor control periods until stop() is called.
+     */
+    void runStateLoop();
+
+    /**
+     * @brief Calls runBackground() every background period until stop() is called.
+     */
+    void runBackgroundLoop();
+};
+
+#endif
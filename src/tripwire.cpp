@@ -0,0 +1,94 @@
+#ifdef EAE_ALLOCATION_TRIPWIRE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+
+#include "tripwire.h"
+
+/** The glibc allocator, which the wrappers forward to. */
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *pointer, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+}
+
+thread_local bool AllocationTripwire::armed = false;
+thread_local uint64_t AllocationTripwire::count = 0;
+
+/** The mode shared by all threads. */
+static std::atomic<int> tripwireMode(TRIPWIRE_COUNT);
+
+/**
+ * @brief Selects what happens on an armed allocation, for all threads.
+ *
+ * @param mode The mode.
+ */
+void AllocationTripwire::setMode(TripwireMode_e mode) {
+    tripwireMode.store(mode, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Counts an armed allocation, or aborts.
+ *
+ * Only async-signal-safe calls are made here, since anything else could allocate again.
+ */
+void AllocationTripwire::trip() {
+    static const char message[] = "Memory was allocated on the control path.\n";
+
+    count++;
+    if (tripwireMode.load(std::memory_order_relaxed) == TRIPWIRE_ABORT) {
+        armed = false;
+        (void)write(STDERR_FILENO, message, sizeof(message) - 1);
+        abort();
+    }
+}
+
+/**
+ * The malloc family is wrapped so that allocations made by the C library,
+ * the C++ runtime (operator new forwards to malloc) and the application
+ * are all seen. Freeing is left to the C library.
+ */
+extern "C" {
+
+void *malloc(size_t size) {
+    AllocationTripwire::record();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    AllocationTripwire::record();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+    AllocationTripwire::record();
+    return __libc_realloc(pointer, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    AllocationTripwire::record();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    AllocationTripwire::record();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size) {
+    AllocationTripwire::record();
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+
+    *pointer = __libc_memalign(alignment, size);
+    return *pointer == nullptr && size != 0 ? ENOMEM : 0;
+}
+
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef TRIPWIRE_H
+#define TRIPWIRE_H
+
+#include <cstdint>
+
+/**
+ * @brief Describes what happens when memory is allocated while the tripwire is armed.
+ */
+typedef enum TripwireMode_e {
+    /** Count the allocation. */
+    TRIPWIRE_COUNT,
+    /** Print a message and abort the process. */
+    TRIPWIRE_ABORT
+} TripwireMode_e;
+
+/**
+ * @brief Detects heap allocations on the control path.
+ *
+ * When the project is built with EAE_ALLOCATION_TRIPWIRE, the malloc family is
+ * wrapped, and every allocation made by a thread while it has the tripwire armed
+ * is counted or aborts the process. The state machine arms the tripwire for the
+ * duration of each cycle. Without EAE_ALLOCATION_TRIPWIRE, every function is an
+ * empty inline and nothing is wrapped.
+ */
+class AllocationTripwire {
+public:
+#ifdef EAE_ALLOCATION_TRIPWIRE
+    /**
+     * @brief Selects what happens on an armed allocation, for all threads.
+     *
+     * @param mode The mode.
+     */
+    static void setMode(TripwireMode_e mode);
+
+    /**
+     * @brief Arms the tripwire on the calling thread.
+     */
+    static void arm() {
+        armed = true;
+    }
+
+    /**
+     * @brief Disarms the tripwire on the calling thread.
+     */
+    static void disarm() {
+        armed = false;
+    }
+
+    /**
+     * @brief Retrieves the number of allocations made by the calling thread while armed.
+     *
+     * @return uint64_t The number of allocations.
+     */
+    static uint64_t getCount() {
+        return count;
+    }
+
+    /**
+     * @brief Records an allocation. Called by the malloc wrappers.
+     */
+    static void record() {
+        if (armed) {
+            trip();
+        }
+    }
+
+    /**
+     * @brief Whether the tripwire was compiled in.
+     *
+     * @return true If allocations are detected.
+     */
+    static constexpr bool isEnabled() {
+        return true;
+    }
+
+private:
+    static thread_local bool armed;
+    static thread_local uint64_t count;
+
+    /**
+     * @brief Counts an armed allocation, or aborts.
+     */
+    static void trip();
+#else
+    static void setMode(TripwireMode_e) {}
+    static void arm() {}
+    static void disarm() {}
+    static uint64_t getCount() {
+        return 0;
+    }
+    static constexpr bool isEnabled() {
+        return false;
+    }
+#endif
+};
+
+#endif
@@ -0,0 +1,247 @@
+#include <limits>
+
+#include "watchdog.h"
+#include "log.h"
+
+/**
+ * @brief Converts a steady clock time point to nanoseconds.
+ *
+ * @param time The time point to convert.
+ * @return int64_t The time in nanoseconds.
+ */
+static int64_t toNanoseconds(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+/**
+ * @brief Constructor.
+ *
+ * @param hal The HAL used to force the safe outputs.
+ * @param config The watchdog parameters.
+ */
+WatchdogManager::WatchdogManager(HardwareManager *hal, WatchdogConfig_t config)
+    : hal(hal), config(config), sequence(0), cycleStartNs(0), lastOverrunSequence(0), lastHeartbeatNs(0),
+      missedHeartbeatNs(0), tripped(false), forcedOutputs(false),
+      cycles(0), overruns(0), consecutiveOverruns(0), missedHeartbeats(0), maxDurationUs(0),
+      minSlackUs(std::numeric_limits<int64_t>::max()), totalDurationUs(0), running(false) {
+    for (std::atomic<uint64_t> &bucket : histogram) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    hal->setSafeOutputs(config.safeOutputs);
+}
+
+/**
+ * @brief Destructor. Stops the supervisor thread if it is running.
+ */
+WatchdogManager::~WatchdogManager() {
+    stop();
+}
+
+/**
+ * @brief Starts the supervisor thread.
+ */
+void WatchdogManager::start() {
+    if (running) {
+        return;
+    }
+
+    running = true;
+    supervisorThread = std::thread(&WatchdogManager::run, this);
+}
+
+/**
+ * @brief Stops the supervisor thread.
+ */
+void WatchdogManager::stop() {
+    if (running == false) {
+        return;
+    }
+
+    running = false;
+    supervisorThread.join();
+}
+
+/**
+ * @brief Marks the beginning of a cycle. Called by the state machine.
+ */
+void WatchdogManager::beginCycle() {
+    cycleStartNs.store(toNanoseconds(std::chrono::steady_clock::now()), std::memory_order_relaxed);
+    sequence.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * @brief Marks the end of a cycle and records its duration. Called by the state machine.
+ */
+void WatchdogManager::endCycle() {
+    uint64_t cycle = sequence.load(std::memory_order_relaxed);
+    int64_t durationUs = (toNanoseconds(std::chrono::steady_clock::now()) -
+                          cycleStartNs.load(std::memory_order_relaxed)) / 1000;
+    int64_t slackUs = (int64_t)config.deadlineUs - durationUs;
+    int bucket = config.deadlineUs > 0 ? (int)(durationUs * 10 / config.deadlineUs) : WATCHDOG_HISTOGRAM_BUCKETS - 1;
+
+    /** Update the statistics. Only this thread writes them, so a plain load and store is enough. */
+    if (bucket >= WATCHDOG_HISTOGRAM_BUCKETS) {
+        bucket = WATCHDOG_HISTOGRAM_BUCKETS - 1;
+    }
+    histogram[bucket].store(histogram[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    cycles.store(cycles.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    totalDurationUs.store(totalDurationUs.load(std::memory_order_relaxed) + durationUs, std::memory_order_relaxed);
+    if (durationUs > maxDurationUs.load(std::memory_order_relaxed)) {
+        maxDurationUs.store(durationUs, std::memory_order_relaxed);
+    }
+    if (slackUs < minSlackUs.load(std::memory_order_relaxed)) {
+        minSlackUs.store(slackUs, std::memory_order_relaxed);
+    }
+
+    /**
+     * The supervisor may count an overrun of this cycle concurrently, so the streak is only reset
+     * if it hasn't changed since it was read. An overrun counted after the reset still starts a new streak.
+     */
+    if (slackUs < 0) {
+        overrun(cycle);
+    } else {
+        uint32_t consecutive = consecutiveOverruns.load(std::memory_order_relaxed);
+        if (lastOverrunSequence.load(std::memory_order_relaxed) != cycle) {
+            consecutiveOverruns.compare_exchange_strong(consecutive, 0, std::memory_order_relaxed);
+        }
+    }
+
+    sequence.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * @brief Marks the end of a state machine task cycle. The first call starts the heartbeat check.
+ * Called by the state machine task.
+ */
+void WatchdogManager::heartbeat() {
+    lastHeartbeatNs.store(toNanoseconds(std::chrono::steady_clock::now()), std::memory_order_release);
+}
+
+/**
+ * @brief Stops the heartbeat check, until the next heartbeat. Called when the state machine task stops.
+ */
+void WatchdogManager::disarmHeartbeat() {
+    lastHeartbeatNs.store(0, std::memory_order_release);
+}
+
+/**
+ * @brief Checks whether the current cycle has stalled past its deadline,
+ * and whether the state machine task missed its heartbeat.
+ * Called periodically by the supervisor thread.
+ *
+ * @param now The current time.
+ */
+void WatchdogManager::supervise(std::chrono::steady_clock::time_point now) {
+    superviseHeartbeat(now);
+
+    uint64_t cycle = sequence.load(std::memory_order_acquire);
+
+    /** Nothing to do between cycles. */
+    if ((cycle & 1U) == 0) {
+        return;
+    }
+
+    int64_t elapsedUs = (toNanoseconds(now) - cycleStartNs.load(std::memory_order_relaxed)) / 1000;
+    if (elapsedUs <= (int64_t)config.deadlineUs) {
+        return;
+    }
+
+    /**
+     * The cycle is stalled, so its outputs can't be trusted. It may be stalled inside the HAL,
+     * so the overrun is counted first, and the safe outputs are forced without taking a lock.
+     */
+    if (lastOverrunSequence.load(std::memory_order_relaxed) != cycle) {
+        overrun(cycle);
+        forceSafeOutputs();
+    }
+}
+
+/**
+ * @brief Retrieves the cycle statistics.
+ *
+ * @param statistics Overwritten with the current statistics.
+ */
+void WatchdogManager::getStatistics(WatchdogStatistics_t &statistics) {
+    statistics.cycles = cycles.load(std::memory_order_relaxed);
+    statistics.overruns = overruns.load(std::memory_order_relaxed);
+    statistics.consecutiveOverruns = consecutiveOverruns.load(std::memory_order_relaxed);
+    statistics.missedHeartbeats = missedHeartbeats.load(std::memory_order_relaxed);
+    statistics.maxDurationUs = maxDurationUs.load(std::memory_order_relaxed);
+    statistics.minSlackUs = minSlackUs.load(std::memory_order_relaxed);
+    statistics.totalDurationUs = totalDurationUs.load(std::memory_order_relaxed);
+    for (int i = 0; i < WATCHDOG_HISTOGRAM_BUCKETS; i++) {
+        statistics.histogram[i] = histogram[i].load(std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Counts a missed deadline once per cycle, and trips the watchdog
+ * when there were too many in a row.
+ *
+ * @param cycle The sequence number of the cycle that missed its deadline.
+ */
+void WatchdogManager::overrun(uint64_t cycle) {
+    /** The supervisor and the state machine can both detect the same overrun. */
+    if (lastOverrunSequence.exchange(cycle, std::memory_order_relaxed) == cycle) {
+        return;
+    }
+
+    overruns.fetch_add(1, std::memory_order_relaxed);
+    uint32_t consecutive = consecutiveOverruns.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    if (consecutive >= config.maxConsecutiveOverruns && tripped.exchange(true, std::memory_order_release) == false) {
+        LogManager::log(LOG_ERROR, "Watchdog tripped, consecutive deadline misses: ", (float)consecutive);
+        forceSafeOutputs();
+    }
+}
+
+/**
+ * @brief Forces the safe outputs and trips the watchdog if the state machine task
+ * missed its heartbeat.
+ *
+ * @param now The current time.
+ */
+void WatchdogManager::superviseHeartbeat(std::chrono::steady_clock::time_point now) {
+    int64_t lastNs = lastHeartbeatNs.load(std::memory_order_acquire);
+
+    if (config.heartbeatTimeoutUs == 0 || lastNs == 0 || lastNs == missedHeartbeatNs.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    int64_t elapsedUs = (toNanoseconds(now) - lastNs) / 1000;
+    if (elapsedUs <= (int64_t)config.heartbeatTimeoutUs) {
+        return;
+    }
+
+    /** Only the supervisor thread writes the missed heartbeat. */
+    missedHeartbeatNs.store(lastNs, std::memory_order_relaxed);
+    missedHeartbeats.fetch_add(1, std::memory_order_relaxed);
+    if (tripped.exchange(true, std::memory_order_release) == false) {
+        LogManager::log(LOG_ERROR, "Watchdog tripped, microseconds since the last state machine heartbeat: ", (float)elapsedUs);
+    }
+    forceSafeOutputs();
+}
+
+/**
+ * @brief Forces the safe outputs in the HAL, without taking any of its locks.
+ * The display is left to the state machine, which flushes the outputs when it takes them over.
+ */
+void WatchdogManager::forceSafeOutputs() {
+    hal->forceSafeOutputs();
+    forcedOutputs.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Calls supervise() until stop() is called.
+ *
+ * The deadline is checked four times per period, so a stall is detected
+ * at most a quarter of a deadline late.
+ */
+void WatchdogManager::run() {
+    const std::chrono::microseconds interval(config.deadlineUs / 4 > 0 ? config.deadlineUs / 4 : 1);
+
+    while (running) {
+        std::this_thread::sleep_for(interval);
+        supervise(std::chrono::steady_clock::now());
+    }
+}
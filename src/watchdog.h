@@ -0,0 +1,230 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "hal.h"
+
+/** Number of buckets in the deadline utilization histogram. Each covers 10% of the deadline. */
+#define WATCHDOG_HISTOGRAM_BUCKETS 11
+
+/**
+ * @brief The parameters of the watchdog.
+ */
+typedef struct WatchdogConfig_t {
+    /** The maximum duration of a cycle, in microseconds. */
+    uint32_t deadlineUs;
+    /** The number of consecutive deadline misses before the state machine is forced into STATE_FATAL_ERROR. */
+    uint32_t maxConsecutiveOverruns;
+    /** The outputs that are forced when a deadline is missed. */
+    PlcOutputs_t safeOutputs;
+    /**
+     * The longest time between two heartbeats of the state machine task, in microseconds.
+     * A missed heartbeat forces the safe outputs and trips the watchdog. 0 disables the check.
+     */
+    uint32_t heartbeatTimeoutUs;
+} WatchdogConfig_t;
+
+/**
+ * @brief Describes how close the cycles have come to their deadline.
+ */
+typedef struct WatchdogStatistics_t {
+    /** Number of completed cycles. */
+    uint64_t cycles;
+    /** Number of cycles that missed their deadline, including stalled cycles. */
+    uint64_t overruns;
+    /** Number of deadline misses since the last cycle that met its deadline. */
+    uint32_t consecutiveOverruns;
+    /** Number of times the state machine task missed its heartbeat. */
+    uint64_t missedHeartbeats;
+    /** Longest completed cycle, in microseconds. */
+    int64_t maxDurationUs;
+    /** Smallest margin to the deadline, in microseconds. Negative if a deadline was missed. */
+    int64_t minSlackUs;
+    /** Sum of all completed cycle durations, in microseconds. */
+    uint64_t totalDurationUs;
+    /**
+     * Completed cycles by the fraction of the deadline they used.
+     * Bucket i counts cycles that used [10 * i, 10 * (i + 1))% of the deadline.
+     * The last bucket counts cycles that used 100% or more.
+     */
+    uint64_t histogram[WATCHDOG_HISTOGRAM_BUCKETS];
+} WatchdogStatistics_t;
+
+/**
+ * @brief Supervises the cycle deadline of the state machine from a separate thread.
+ *
+ * The state machine marks the beginning and end of each cycle. A cycle that takes
+ * longer than the deadline causes the safe outputs to be forced, and too many
+ * consecutive misses trip the watchdog, which the state machine checks at the
+ * beginning of each cycle.
+ *
+ * When the tasks are split, the cycles timed are those of the control task, and the
+ * state machine task sends a heartbeat each cycle instead. A state machine cycle that
+ * doesn't come in time forces the safe outputs and trips the watchdog at once, since
+ * the guards aren't running.
+ */
+class WatchdogManager {
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param hal The HAL used to force the safe outputs.
+     * @param config The watchdog parameters.
+     */
+    WatchdogManager(HardwareManager *hal, WatchdogConfig_t config);
+
+    /**
+     * @brief Destructor. Stops the supervisor thread if it is running.
+     */
+    ~WatchdogManager();
+
+    /**
+     * @brief Starts the supervisor thread.
+     */
+    void start();
+
+    /**
+     * @brief Stops the supervisor thread.
+     */
+    void stop();
+
+    /**
+     * @brief Marks the beginning of a cycle. Called by the state machine.
+     */
+    void beginCycle();
+
+    /**
+     * @brief Marks the end of a cycle and records its duration. Called by the state machine.
+     */
+    void endCycle();
+
+    /**
+     * @brief Marks the end of a state machine task cycle. The first call starts the heartbeat check.
+     * Called by the state machine task.
+     */
+    void heartbeat();
+
+    /**
+     * @brief Stops the heartbeat check, until the next heartbeat. Called when the state machine task stops.
+     */
+    void disarmHeartbeat();
+
+    /**
+     * @brief Checks whether the current cycle has stalled past its deadline,
+     * and whether the state machine task missed its heartbeat.
+     * Called periodically by the supervisor thread.
+     *
+     * @param now The current time.
+     */
+    void supervise(std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Retrieves the native handle of the supervisor thread, so it can be pinned and prioritized.
+     *
+     * @return std::thread::native_handle_type The handle. Only valid while the thread is running.
+     */
+    std::thread::native_handle_type getThreadHandle() {
+        return supervisorThread.native_handle();
+    }
+
+    /**
+     * @brief Whether too many consecutive deadlines were missed.
+     *
+     * @return true If the state machine must enter STATE_FATAL_ERROR.
+     */
+    bool isTripped() {
+        return tripped.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Whether the safe outputs were forced since the last call.
+     *
+     * @return true If the outputs were forced, and the state machine must
+     * restart the ignition sequence to enable the equipment again.
+     */
+    bool consumeForcedOutputs() {
+        return forcedOutputs.exchange(false, std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Retrieves the cycle statistics.
+     *
+     * @param statistics Overwritten with the current statistics.
+     */
+    void getStatistics(WatchdogStatistics_t &statistics);
+
+    /**
+     * @brief Retrieves the watchdog parameters.
+     *
+     * @return const WatchdogConfig_t& The parameters.
+     */
+    const WatchdogConfig_t &getConfig() {
+        return config;
+    }
+
+private:
+    HardwareManager *hal;
+    WatchdogConfig_t config;
+
+    /** Sequence number of the current cycle. Odd while a cycle is running. */
+    std::atomic<uint64_t> sequence;
+    /** Start time of the current cycle, in steady clock nanoseconds. */
+    std::atomic<int64_t> cycleStartNs;
+    /** Sequence number of the last cycle counted as an overrun, so each cycle is only counted once. */
+    std::atomic<uint64_t> lastOverrunSequence;
+
+    /** Time of the last heartbeat, in steady clock nanoseconds. 0 while the check is disarmed. */
+    std::atomic<int64_t> lastHeartbeatNs;
+    /** Time of the last heartbeat counted as missed, so each miss is only counted once. */
+    std::atomic<int64_t> missedHeartbeatNs;
+
+    std::atomic<bool> tripped;
+    std::atomic<bool> forcedOutputs;
+
+    /** Statistics. Written by the state machine thread, except for the overrun and missed heartbeat counts. */
+    std::atomic<uint64_t> cycles;
+    std::atomic<uint64_t> overruns;
+    std::atomic<uint32_t> consecutiveOverruns;
+    std::atomic<uint64_t> missedHeartbeats;
+    std::atomic<int64_t> maxDurationUs;
+    std::atomic<int64_t> minSlackUs;
+    std::atomic<uint64_t> totalDurationUs;
+    std::atomic<uint64_t> histogram[WATCHDOG_HISTOGRAM_BUCKETS];
+
+    /** Supervisor thread state. */
+    std::thread supervisorThread;
+    std::atomic<bool> running;
+
+    /**
+     * @brief Counts a missed deadline once per cycle, and trips the watchdog
+     * when there were too many in a row.
+     *
+     * @param cycle The sequence number of the cycle that missed its deadline.
+     */
+    void overrun(uint64_t cycle);
+
+    /**
+     * @brief Forces the safe outputs and trips the watchdog if the state machine task
+     * missed its heartbeat.
+     *
+     * @param now The current time.
+     */
+    void superviseHeartbeat(std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Forces the safe outputs in the HAL, without taking any of its locks.
+     * The display is left to the state machine, which flushes the outputs when it takes them over.
+     */
+    void forceSafeOutputs();
+
+    /**
+     * @brief Calls supervise() until stop() is called.
+     */
+    void run();
+};
+
+#endif
@@ -4,6 +4,28 @@
 #include "fsm.h"
 #include "hal.h"
 #include "controller.h"
+#include "metrics.h"
+#include "watchdog.h"
+#include "realtime.h"
+#include "tripwire.h"
+#include "events.h"
+#include "display.h"
+#include "harness.h"
+#include "dtc.h"
+#include "snapshot.h"
+#include "mailbox.h"
+#include "tasks.h"
+#include "fusion.h"
+
+#include <sched.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <string>
+#include <thread>
 
 /**
  * @brief Ensures that, after initialization, the FSM enters the STATE_BOOT state.
@@ -148,6 +170,1654 @@ TEST(FsmTests, ExitsIgnitionStateOnLevelSwitchOpen)
     EXPECT_EQ(state, STATE_IDLE);
 }
 
+/**
+ * @brief Ensures that the pump and the fan are disabled, not only set to 0%,
+ * when a guard fails in the STATE_ACTIVE state.
+ */
+TEST(FsmTests, DisablesEquipmentWhenActiveGuardFails)
+{
+    PlcInputs_t inputs = {};
+    PlcOutputs_t outputs = {};
+    float supplyVoltageThreshold = 20.0f;
+
+    /** Arrange. */
+    Parameters_t params = {supplyVoltageThreshold, 20.0f};
+    HardwareManager hal = HardwareManager();
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    StateManager fsm = StateManager(params, &hal, &controller);
+
+    fsm.initialize();
+    fsm.handleCurrentState();
+
+    inputs.ignitionClosed = true;
+    inputs.supplyVoltage = supplyVoltageThreshold + 1;
+    inputs.levelSwitchClosed = true;
+    hal.setInputs(inputs);
+    fsm.handleCurrentState();
+    fsm.handleCurrentState();
+    ASSERT_EQ(fsm.getState(), STATE_ACTIVE);
+
+    /** Act. */
+    inputs.supplyVoltage = supplyVoltageThreshold - 1;
+    hal.setInputs(inputs);
+    fsm.handleCurrentState();
+
+    /** Assert. */
+    hal.retrieveOutputs(outputs);
+    EXPECT_EQ(fsm.getState(), STATE_IDLE);
+    EXPECT_FALSE(outputs.pumpEnable);
+    EXPECT_FALSE(outputs.pumpIgnition);
+    EXPECT_FALSE(outputs.fanEnable);
+}
+
+/**
+ * @brief Ensures that a supply voltage that can't be compared, ie. NaN,
+ * fails the under-voltage guard.
+ */
+TEST(FsmTests, ExitsIgnitionStateOnInvalidSupplyVoltage)
+{
+    PlcInputs_t inputs = {};
+
+    /** Arrange. */
+    Parameters_t params = {20.0f, 20.0f};
+    HardwareManager hal = HardwareManager();
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    StateManager fsm = StateManager(params, &hal, &controller);
+
+    /** Act. */
+    fsm.initialize();
+    fsm.handleCurrentState();
+
+    inputs.ignitionClosed = true;
+    inputs.supplyVoltage = NAN;
+    inputs.levelSwitchClosed = true;
+    hal.setInputs(inputs);
+
+    fsm.handleCurrentState();
+    fsm.handleCurrentState();
+
+    /** Assert. */
+    EXPECT_EQ(fsm.getState(), STATE_IDLE);
+}
+
+/**
+ * @brief Ensures that the control signals are off below the setpoint, proportional
+ * above it, and clamped to 100%.
+ */
+TEST(ControllerTests, ScalesAndClampsOutput)
+{
+    int fanPowerPercent = -1;
+    int pumpPowerPercent = -1;
+    int belowSetpoint = 0;
+    int aboveSetpoint = 0;
+
+    /** Arrange. */
+    ControlManager controller = ControlManager(60.0f, {10.0f, 0.0f, 0.0f}, 0.01f);
+    controller.initialize();
+
+    /** Act. */
+    controller.process(55.0f, fanPowerPercent, pumpPowerPercent);
+    belowSetpoint = fanPowerPercent;
+    controller.process(62.0f, fanPowerPercent, pumpPowerPercent);
+    aboveSetpoint = fanPowerPercent;
+    controller.process(90.0f, fanPowerPercent, pumpPowerPercent);
+
+    /** Assert. */
+    EXPECT_EQ(belowSetpoint, 0);
+    EXPECT_EQ(aboveSetpoint, 20);
+    EXPECT_EQ(fanPowerPercent, 100);
+    EXPECT_EQ(pumpPowerPercent, 100);
+}
+
+/**
+ * @brief Ensures that the integrator doesn't wind up while the output is saturated,
+ * so the output backs off as soon as the temperature drops below the setpoint.
+ */
+TEST(ControllerTests, DoesNotWindUpWhenSaturated)
+{
+    int fanPowerPercent = -1;
+    int pumpPowerPercent = -1;
+
+    /** Arrange. */
+    ControlManager controller = ControlManager(60.0f, {10.0f, 1.0f, 0.0f}, 0.01f);
+    controller.initialize();
+
+    /** Act. Ten minutes far above the setpoint, then just below it. */
+    for (int i = 0; i < 60000; i++) {
+        controller.process(80.0f, fanPowerPercent, pumpPowerPercent);
+    }
+    controller.process(59.0f, fanPowerPercent, pumpPowerPercent);
+
+    /** Assert. */
+    EXPECT_LT(fanPowerPercent, 100);
+    EXPECT_LT(pumpPowerPercent, 100);
+}
+
+/**
+ * @brief Ensures that the optimal allocation rejects at least as much heat as running
+ * the fan and the pump at the demand, for no more power, and for less at part load.
+ */
+TEST(ControllerTests, OptimalAllocationSavesPower)
+{
+    int fanPowerPercent = -1;
+    int pumpPowerPercent = -1;
+
+    /** Arrange. A unit proportional gain makes the demand equal to the temperature. */
+    ControlManager controller = ControlManager(0.0f, {1.0f, 0.0f, 0.0f}, 0.01f, ALLOCATION_OPTIMAL);
+
+    for (int demand = 0; demand <= 100; demand++) {
+        controller.reset();
+
+        /** Act. */
+        controller.process((float)demand, fanPowerPercent, pumpPowerPercent);
+
+        /** Assert. */
+        EXPECT_GE(ControlManager::getHeatTransfer(fanPowerPercent, pumpPowerPercent),
+                  ControlManager::getHeatTransfer(demand, demand));
+        EXPECT_LE(ControlManager::getElectricalPower(fanPowerPercent, pumpPowerPercent),
+                  ControlManager::getElectricalPower(demand, demand));
+    }
+
+    controller.reset();
+    controller.process(20.0f, fanPowerPercent, pumpPowerPercent);
+    EXPECT_LT(ControlManager::getElectricalPower(fanPowerPercent, pumpPowerPercent),
+              0.8f * ControlManager::getElectricalPower(20, 20));
+}
+
+/**
+ * @brief Ensures that the predictive mode holds the demand between samples,
+ * and brings a plant matching its model to the setpoint without offset.
+ */
+TEST(ControllerTests, PredictiveModeSettlesWithoutOffset)
+{
+    const float periodS = 0.1f;
+    const float setpoint = 60.0f;
+    PlantModel_t model = {-0.5f, 20.0f, 0.0f};
+    PredictiveConfig_t config = {};
+    float temperature = 80.0f;
+    int fanPowerPercent = 0;
+    int pumpPowerPercent = 0;
+    int firstFanPowerPercent = 0;
+    bool held = true;
+
+    /** Arrange. The plant settles 0.5 degree lower per percent of demand, from 80 degrees. */
+    config.samplePeriodS = 1.0f;
+    config.horizon = CONTROLLER_DEFAULT_HORIZON;
+    config.moveSuppression = CONTROLLER_DEFAULT_MOVE_SUPPRESSION;
+    ControlManager::buildStepResponse(model, config);
+    ControlManager controller = ControlManager(setpoint, {CONTROLLER_DEFAULT_KP, CONTROLLER_DEFAULT_KI,
+                                               CONTROLLER_DEFAULT_KD}, periodS, ALLOCATION_EQUAL, &config);
+
+    /** Act. */
+    for (int i = 0; i < 6000; i++) {
+        controller.process(temperature, fanPowerPercent, pumpPowerPercent);
+        if (i == 0) {
+            firstFanPowerPercent = fanPowerPercent;
+        } else if (i < 10) {
+            held = held && fanPowerPercent == firstFanPowerPercent;
+        }
+
+        float settled = 80.0f + model.gainCPerPercent * fanPowerPercent;
+        temperature += (settled - temperature) * periodS / model.timeConstantS;
+    }
+
+    /** Assert. */
+    EXPECT_GT(firstFanPowerPercent, 0);
+    EXPECT_TRUE(held);
+    EXPECT_NEAR(temperature, setpoint, 0.5f);
+    EXPECT_NEAR(fanPowerPercent, 40, 1);
+}
+
+/**
+ * @brief Ensures that the predictive mode controls a plant matching the default model, whose step
+ * response is far from settled at the end of the table, without overshooting, and rejects
+ * tables that can't be extrapolated.
+ */
+TEST(ControllerTests, PredictiveModeExtrapolatesDefaultModel)
+{
+    const float periodS = 0.1f;
+    const float setpoint = 60.0f;
+    const int deadTimeSteps = (int)(CONTROLLER_DEFAULT_MODEL_DEAD_TIME_S / periodS);
+    PlantModel_t model = {CONTROLLER_DEFAULT_MODEL_GAIN_C_PER_PERCENT, CONTROLLER_DEFAULT_MODEL_TIME_CONSTANT_S,
+                          CONTROLLER_DEFAULT_MODEL_DEAD_TIME_S};
+    PredictiveConfig_t config = {};
+    int delayed[deadTimeSteps] = {};
+    float temperature = 80.0f;
+    float lowest = temperature;
+    int fanPowerPercent = 0;
+    int pumpPowerPercent = 0;
+
+    /** Arrange. The plant settles at the setpoint with a 40% demand. */
+    config.samplePeriodS = CONTROLLER_DEFAULT_SAMPLE_PERIOD_S;
+    config.horizon = CONTROLLER_DEFAULT_HORIZON;
+    config.moveSuppression = CONTROLLER_DEFAULT_MOVE_SUPPRESSION;
+    ControlManager::buildStepResponse(model, config);
+    ControlManager controller = ControlManager(setpoint, {CONTROLLER_DEFAULT_KP, CONTROLLER_DEFAULT_KI,
+                                               CONTROLLER_DEFAULT_KD}, periodS, ALLOCATION_EQUAL, &config);
+    PredictiveConfig_t stalled = config;
+    stalled.stepResponse[CONTROLLER_MODEL_LENGTH - 1] = stalled.stepResponse[CONTROLLER_MODEL_LENGTH - 2];
+    PredictiveConfig_t unreachable = config;
+    unreachable.horizon = 1;
+
+    /** Act. */
+    for (int i = 0; i < 20000; i++) {
+        controller.process(temperature, fanPowerPercent, pumpPowerPercent);
+
+        float settled = setpoint - model.gainCPerPercent * (40 - delayed[i % deadTimeSteps]);
+        delayed[i % deadTimeSteps] = fanPowerPercent;
+        temperature += (settled - temperature) * periodS / model.timeConstantS;
+        lowest = std::min(lowest, temperature);
+    }
+
+    /** Assert. */
+    EXPECT_LT(std::fabs(config.stepResponse[CONTROLLER_MODEL_LENGTH - 1]), 0.5f * std::fabs(model.gainCPerPercent));
+    EXPECT_TRUE(ControlManager::validatePredictiveConfig(config));
+    EXPECT_FALSE(ControlManager::validatePredictiveConfig(stalled));
+    EXPECT_FALSE(ControlManager::validatePredictiveConfig(unreachable));
+    EXPECT_GT(lowest, setpoint - 0.2f);
+    EXPECT_NEAR(temperature, setpoint, 0.05f);
+    EXPECT_NEAR(fanPowerPercent, 40, 1);
+}
+
+/**
+ * @brief Ensures that failed guards raise trouble codes with occurrence counts,
+ * timestamps and the inputs of the first occurrence.
+ */
+TEST(DtcTests, RecordsGuardFailures)
+{
+    PlcInputs_t inputs = {};
+    DtcRecord_t record = {};
+    float supplyVoltageThreshold = 20.0f;
+
+    /** Arrange. */
+    Parameters_t params = {supplyVoltageThreshold, 20.0f};
+    DiagnosticManager diagnostics;
+    HardwareManager hal = HardwareManager();
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    StateManager fsm = StateManager(params, &hal, &controller, nullptr, nullptr, &diagnostics);
+
+    fsm.initialize();
+    fsm.handleCurrentState();
+
+    /** Act. Two ignition attempts on low voltage, then one with the ignition open. */
+    inputs.ignitionClosed = true;
+    inputs.levelSwitchClosed = true;
+    inputs.supplyVoltage = supplyVoltageThreshold - 1;
+    hal.setInputs(inputs);
+    for (int i = 0; i < 4; i++) {
+        fsm.handleCurrentState();
+    }
+
+    inputs.supplyVoltage = supplyVoltageThreshold - 2;
+    hal.setInputs(inputs);
+    fsm.handleCurrentState();
+    fsm.handleCurrentState();
+
+    /** Assert. */
+    ASSERT_TRUE(diagnostics.getRecord(DTC_UNDERVOLTAGE, record));
+    EXPECT_EQ(record.occurrences, 3U);
+    EXPECT_LE(record.firstSeenMs, record.lastSeenMs);
+    EXPECT_EQ(record.freezeFrameState, STATE_IGNITION);
+    EXPECT_EQ(record.freezeFrame.supplyVoltage, supplyVoltageThreshold - 1);
+    EXPECT_FALSE(diagnostics.getRecord(DTC_COOLANT_DRY, record));
+}
+
+/**
+ * @brief Ensures that the records survive a restart, that repeated occurrences are
+ * coalesced into one appended entry, and that a torn entry is discarded.
+ */
+TEST(DtcTests, PersistsAcrossRestarts)
+{
+    PlcInputs_t inputs = {};
+    DtcRecord_t record = {};
+    std::string path = testing::TempDir() + "dtc_persist_test.bin";
+    size_t appended = 0;
+
+    /** Arrange. */
+    remove(path.c_str());
+    inputs.supplyVoltage = 12.5f;
+
+    /** Act. */
+    {
+        DiagnosticManager diagnostics(path.c_str());
+        for (int i = 0; i < 5; i++) {
+            diagnostics.raise(DTC_COOLANT_DRY, STATE_ACTIVE, inputs);
+        }
+        appended = diagnostics.flush();
+    }
+
+    /** A write that was cut short by a power loss. */
+    FILE *file = fopen(path.c_str(), "ab");
+    ASSERT_NE(file, nullptr);
+    fputs("torn", file);
+    fclose(file);
+
+    DiagnosticManager restarted(path.c_str());
+    bool loaded = restarted.load();
+    restarted.raise(DTC_COOLANT_DRY, STATE_IGNITION, inputs);
+
+    /** Assert. */
+    EXPECT_EQ(appended, 1U);
+    EXPECT_TRUE(loaded);
+    ASSERT_TRUE(restarted.getRecord(DTC_COOLANT_DRY, record));
+    EXPECT_EQ(record.occurrences, 6U);
+    EXPECT_EQ(record.freezeFrameState, STATE_ACTIVE);
+    EXPECT_EQ(record.freezeFrame.supplyVoltage, 12.5f);
+    EXPECT_EQ(restarted.flush(), 1U);
+
+    remove(path.c_str());
+}
+
+/**
+ * @brief Ensures that a restarted state machine resumes the active state,
+ * with the controller and outputs as they were before the restart.
+ */
+TEST(SnapshotTests, WarmStartResumesActiveState)
+{
+    PlcInputs_t inputs = {};
+    PlcOutputs_t before = {};
+    PlcOutputs_t after = {};
+    ControllerState_t saved = {};
+    ControllerState_t restored = {};
+    std::string path = testing::TempDir() + "snapshot_warm_test.bin";
+
+    /** Arrange. */
+    remove(path.c_str());
+    Parameters_t params = {20.0f, 20.0f};
+    inputs.ignitionClosed = true;
+    inputs.supplyVoltage = 24.0f;
+    inputs.levelSwitchClosed = true;
+    inputs.temperature = 25.0f;
+
+    {
+        SnapshotManager snapshots(path.c_str());
+        ASSERT_TRUE(snapshots.open());
+        HardwareManager hal = HardwareManager();
+        ControlManager controller = ControlManager(params.temperatureSetpoint);
+        StateManager fsm = StateManager(params, &hal, &controller, nullptr, nullptr, nullptr, &snapshots);
+
+        fsm.initialize();
+        hal.setInputs(inputs);
+        for (int i = 0; i < 10; i++) {
+            fsm.handleCurrentState();
+        }
+        ASSERT_EQ(fsm.getState(), STATE_ACTIVE);
+        ASSERT_TRUE(snapshots.flush());
+        controller.saveState(saved);
+        hal.retrieveOutputs(before);
+    }
+
+    /** Act. */
+    SnapshotManager snapshots(path.c_str());
+    ASSERT_TRUE(snapshots.open());
+    HardwareManager hal = HardwareManager();
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    StateManager fsm = StateManager(params, &hal, &controller, nullptr, nullptr, nullptr, &snapshots);
+    fsm.initialize();
+
+    /** Assert. */
+    controller.saveState(restored);
+    hal.retrieveOutputs(after);
+    EXPECT_EQ(fsm.getState(), STATE_ACTIVE);
+    EXPECT_GT(saved.integral, 0.0f);
+    EXPECT_EQ(restored.integral, saved.integral);
+    EXPECT_EQ(restored.lastTemperature, saved.lastTemperature);
+    EXPECT_TRUE(after.pumpEnable);
+    EXPECT_EQ(after.fanPowerPercent, before.fanPowerPercent);
+    EXPECT_EQ(after.pumpPowerPercent, before.pumpPowerPercent);
+
+    remove(path.c_str());
+}
+
+/**
+ * @brief Ensures that the writer only saves the latest posted snapshot, and only once.
+ */
+TEST(SnapshotTests, WriterSavesLatestPostedSnapshot)
+{
+    Snapshot_t snapshot = {};
+    std::string path = testing::TempDir() + "snapshot_writer_test.bin";
+
+    /** Arrange. */
+    remove(path.c_str());
+    SnapshotManager snapshots(path.c_str());
+    ASSERT_TRUE(snapshots.open());
+
+    /** Act. */
+    bool savedBeforePost = snapshots.flush();
+    snapshot.state = STATE_IGNITION;
+    snapshots.post(snapshot);
+    snapshot.state = STATE_ACTIVE;
+    snapshots.post(snapshot);
+    bool savedAfterPost = snapshots.flush();
+    bool savedAgain = snapshots.flush();
+    bool restored = snapshots.restore(snapshot);
+
+    /** Assert. */
+    EXPECT_FALSE(savedBeforePost);
+    EXPECT_TRUE(savedAfterPost);
+    EXPECT_FALSE(savedAgain);
+    EXPECT_TRUE(restored);
+    EXPECT_EQ(snapshot.state, STATE_ACTIVE);
+
+    remove(path.c_str());
+}
+
+/**
+ * @brief Ensures that a torn snapshot falls back to the previous one,
+ * and that a stale snapshot isn't resumed.
+ */
+TEST(SnapshotTests, RejectsTornAndStaleSnapshots)
+{
+    Snapshot_t snapshot = {};
+    std::string path = testing::TempDir() + "snapshot_reject_test.bin";
+
+    /** Arrange. */
+    remove(path.c_str());
+    {
+        SnapshotManager snapshots(path.c_str());
+        ASSERT_TRUE(snapshots.open());
+        snapshot.state = STATE_IGNITION;
+        snapshots.save(snapshot);
+        snapshot.state = STATE_ACTIVE;
+        snapshots.save(snapshot);
+    }
+
+    /** Tear the newest snapshot, which is in the first slot, by flipping its state. */
+    FILE *file = fopen(path.c_str(), "r+b");
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(fseek(file, offsetof(SnapshotManager::SnapshotFile_t, slots) + offsetof(SnapshotManager::SnapshotSlot_t, snapshot) +
+                              offsetof(Snapshot_t, state), SEEK_SET), 0);
+    fputc(0xFF, file);
+    fclose(file);
+
+    /** Act. */
+    SnapshotManager snapshots(path.c_str());
+    ASSERT_TRUE(snapshots.open());
+    bool fallback = snapshots.restore(snapshot);
+    FsmStates_e fallbackState = snapshot.state;
+
+    SnapshotManager impatient(path.c_str(), 1);
+    ASSERT_TRUE(impatient.open());
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    bool stale = impatient.restore(snapshot);
+
+    /** Assert. */
+    EXPECT_TRUE(fallback);
+    EXPECT_EQ(fallbackState, STATE_IGNITION);
+    EXPECT_FALSE(stale);
+
+    remove(path.c_str());
+}
+
+/**
+ * @brief Ensures that a mailbox only hands out the latest item, and never a torn one.
+ */
+TEST(TaskTests, MailboxHandsOutLatestItem)
+{
+    typedef struct Pair_t {
+        uint64_t value;
+        uint64_t doubled;
+    } Pair_t;
+
+    Mailbox<Pair_t> mailbox;
+    Pair_t item = {};
+    uint64_t last = 0;
+    uint64_t torn = 0;
+    uint64_t reordered = 0;
+    std::atomic<bool> done(false);
+    const uint64_t count = 200000;
+
+    /** Arrange. */
+    for (uint64_t i = 1; i <= 3; i++) {
+        mailbox.post({i, i * 2});
+    }
+    bool fetchedLatest = mailbox.fetch(item) && item.value == 3;
+    bool fetchedAgain = mailbox.fetch(item);
+
+    /** Act. */
+    std::thread writer([&]() {
+        for (uint64_t i = 4; i <= count; i++) {
+            mailbox.post({i, i * 2});
+        }
+        done = true;
+    });
+    while (true) {
+        bool finished = done;
+        if (mailbox.fetch(item)) {
+            torn += item.doubled != item.value * 2;
+            reordered += item.value <= last;
+            last = item.value;
+        } else if (finished) {
+            break;
+        }
+    }
+    writer.join();
+
+    /** Assert. */
+    EXPECT_TRUE(fetchedLatest);
+    EXPECT_FALSE(fetchedAgain);
+    EXPECT_EQ(torn, 0U);
+    EXPECT_EQ(reordered, 0U);
+    EXPECT_EQ(last, count);
+}
+
+/**
+ * @brief Ensures that the control and the state machine tasks can read the inputs
+ * while they are updated from another thread, without ever seeing a half-written update.
+ */
+TEST(TaskTests, InputsAreReadWhole)
+{
+    HardwareManager hal = HardwareManager();
+    PlcInputs_t written = {};
+    std::atomic<bool> done(false);
+    uint64_t torn[2] = {0, 0};
+    const int count = 100000;
+
+    /** Arrange. */
+    hal.initialize();
+
+    /** Act. */
+    std::thread writer([&]() {
+        for (int i = 1; i <= count; i++) {
+            written.supplyVoltage = (float)i;
+            written.temperature = (float)i;
+            for (int j = 0; j < HAL_REDUNDANT_TEMP_INPUTS; j++) {
+                written.redundantTemperatures[j] = (float)i;
+            }
+            hal.setInputs(written);
+        }
+        done = true;
+    });
+    std::thread readers[2];
+    for (int r = 0; r < 2; r++) {
+        readers[r] = std::thread([&hal, &done, &torn, r]() {
+            PlcInputs_t read = {};
+            while (done == false) {
+                hal.retrieveInputs(read);
+                bool whole = read.temperature == read.supplyVoltage;
+                for (int j = 0; j < HAL_REDUNDANT_TEMP_INPUTS; j++) {
+                    whole = whole && read.redundantTemperatures[j] == read.supplyVoltage;
+                }
+                torn[r] += whole == false;
+            }
+        });
+    }
+    writer.join();
+    for (std::thread &reader : readers) {
+        reader.join();
+    }
+
+    /** Assert. */
+    PlcInputs_t last = {};
+    hal.retrieveInputs(last);
+    EXPECT_EQ(torn[0], 0U);
+    EXPECT_EQ(torn[1], 0U);
+    EXPECT_EQ(last.temperature, (float)count);
+}
+
+/**
+ * @brief Ensures that the control task only drives the equipment the state machine enabled,
+ * and that a guard failure isn't undone by the next control cycle.
+ */
+TEST(TaskTests, ControlTaskFollowsStateMachine)
+{
+    PlcInputs_t inputs = {};
+    PlcOutputs_t outputs = {};
+    float supplyVoltageThreshold = 20.0f;
+
+    /** Arrange. */
+    Parameters_t params = {supplyVoltageThreshold, 20.0f};
+    HardwareManager hal = HardwareManager();
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    StateManager fsm = StateManager(params, &hal, &controller);
+    TaskConfig_t config = {10000, TASK_DEFAULT_STATE_DIVISOR, TASK_DEFAULT_BACKGROUND_PERIOD_MS};
+    TaskManager tasks(&hal, &controller, config);
+    fsm.attachTasks(&tasks);
+
+    fsm.initialize();
+    inputs.ignitionClosed = true;
+    inputs.supplyVoltage = supplyVoltageThreshold + 1;
+    inputs.levelSwitchClosed = true;
+    inputs.temperature = params.temperatureSetpoint + 5;
+    hal.setInputs(inputs);
+    for (int i = 0; i < 3; i++) {
+        fsm.handleCurrentState();
+    }
+    ASSERT_EQ(fsm.getState(), STATE_ACTIVE);
+
+    /** Act. */
+    tasks.runControl();
+    hal.retrieveOutputs(outputs);
+    int activeFanPowerPercent = outputs.fanPowerPercent;
+
+    inputs.supplyVoltage = supplyVoltageThreshold - 1;
+    hal.setInputs(inputs);
+    fsm.handleCurrentState();
+
+    /** A control cycle that is still running on the last command can't drive the disabled equipment. */
+    hal.setPowerOutputs(50, 50);
+    tasks.runControl();
+
+    /** Assert. */
+    hal.retrieveOutputs(outputs);
+    EXPECT_EQ(activeFanPowerPercent, 40);
+    EXPECT_EQ(fsm.getState(), STATE_IDLE);
+    EXPECT_FALSE(outputs.fanEnable);
+    EXPECT_FALSE(outputs.pumpEnable);
+    EXPECT_EQ(outputs.fanPowerPercent, 0);
+    EXPECT_EQ(outputs.pumpPowerPercent, 0);
+}
+
+/**
+ * @brief Ensures that a control cycle completes while the state machine task holds the HAL locks,
+ * and that its duty cycles are applied once the locks are released.
+ */
+TEST(TaskTests, ControlCycleDoesNotWaitForHalLocks)
+{
+    PlcInputs_t inputs = {};
+    PlcOutputs_t outputs = {};
+    std::atomic<bool> controlled(false);
+    bool controlledWhileLocked = false;
+
+    /** Arrange. */
+    Parameters_t params = {20.0f, 20.0f};
+    HardwareManager hal = HardwareManager();
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    StateManager fsm = StateManager(params, &hal, &controller);
+    TaskConfig_t config = {10000, TASK_DEFAULT_STATE_DIVISOR, TASK_DEFAULT_BACKGROUND_PERIOD_MS};
+    TaskManager tasks(&hal, &controller, config);
+    fsm.attachTasks(&tasks);
+
+    fsm.initialize();
+    inputs.ignitionClosed = true;
+    inputs.supplyVoltage = params.minVoltage + 1;
+    inputs.levelSwitchClosed = true;
+    inputs.temperature = params.temperatureSetpoint + 5;
+    hal.setInputs(inputs);
+    for (int i = 0; i < 3; i++) {
+        fsm.handleCurrentState();
+    }
+    ASSERT_EQ(fsm.getState(), STATE_ACTIVE);
+
+    /** Act. */
+    hal.getInputsLock().lock();
+    hal.getOutputsLock().lock();
+    std::thread control([&]() {
+        tasks.runControl();
+        controlled = true;
+    });
+    for (int i = 0; i < 1000 && controlled == false; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    controlledWhileLocked = controlled;
+    hal.getOutputsLock().unlock();
+    hal.getInputsLock().unlock();
+    control.join();
+
+    /** Assert. */
+    hal.retrieveOutputs(outputs);
+    EXPECT_TRUE(controlledWhileLocked);
+    EXPECT_EQ(outputs.fanPowerPercent, 40);
+}
+
+/**
+ * @brief Ensures that invalid, jumping and outlying readings are left out of the fused temperature,
+ * and that the hottest reading is used when the remaining sensors disagree.
+ */
+TEST(FusionTests, OutvotesFailedSensors)
+{
+    PlcInputs_t inputs = {};
+    FusedTemperature_t first = {};
+    FusedTemperature_t second = {};
+
+    /** Arrange. */
+    FusionConfig_t config = {4, 0.01f, FUSION_DEFAULT_MAX_RATE_C_PER_S, FUSION_DEFAULT_VOTE_TOLERANCE_C,
+                             FUSION_DEFAULT_STALE_CYCLES};
+    FusionManager fusion(config);
+
+    /** Act. */
+    inputs.temperature = 60.0f;
+    inputs.redundantTemperatures[0] = 61.0f;
+    inputs.redundantTemperatures[1] = NAN;
+    inputs.redundantTemperatures[2] = 90.0f;
+    fusion.fuse(inputs, first);
+
+    inputs.temperature = 60.02f;
+    inputs.redundantTemperatures[0] = 70.0f;
+    fusion.fuse(inputs, second);
+
+    /** Assert. */
+    EXPECT_FLOAT_EQ(first.temperature, 60.5f);
+    EXPECT_EQ(first.health, FUSION_DEGRADED);
+    EXPECT_EQ(first.agreeingMask, 0x3U);
+    EXPECT_EQ(first.flags[0], 0U);
+    EXPECT_EQ(first.flags[2], FUSION_FLAG_INVALID);
+    EXPECT_EQ(first.flags[3], FUSION_FLAG_OUTVOTED);
+
+    EXPECT_FLOAT_EQ(second.temperature, 90.0f);
+    EXPECT_EQ(second.health, FUSION_NO_MAJORITY);
+    EXPECT_EQ(second.agreeingMask, 0U);
+    EXPECT_EQ(second.flags[1], FUSION_FLAG_RATE);
+}
+
+/**
+ * @brief Ensures that the active state counts the cycles run on degraded or failed sensors,
+ * and raises each trouble code once when the health gets worse.
+ */
+TEST(FusionTests, DegradedSensorsRaiseTroubleCodes)
+{
+    PlcInputs_t inputs = {};
+    DtcRecord_t degraded = {};
+    DtcRecord_t failed = {};
+
+    /** Arrange. */
+    Parameters_t params = {20.0f, 60.0f};
+    FusionConfig_t config = {3, 0.01f, FUSION_DEFAULT_MAX_RATE_C_PER_S, FUSION_DEFAULT_VOTE_TOLERANCE_C,
+                             FUSION_DEFAULT_STALE_CYCLES};
+    MetricsManager metrics;
+    DiagnosticManager diagnostics;
+    FusionManager fusion(config);
+    HardwareManager hal = HardwareManager();
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    StateManager fsm = StateManager(params, &hal, &controller, &metrics, nullptr, &diagnostics);
+    fsm.attachFusion(&fusion);
+
+    inputs.ignitionClosed = true;
+    inputs.levelSwitchClosed = true;
+    inputs.supplyVoltage = 24.0f;
+    inputs.temperature = 55.0f;
+    inputs.redundantTemperatures[0] = 55.0f;
+    inputs.redundantTemperatures[1] = 55.0f;
+    fsm.initialize();
+    hal.setInputs(inputs);
+    for (int i = 0; i < 5; i++) {
+        fsm.handleCurrentState();
+    }
+    ASSERT_EQ(fsm.getState(), STATE_ACTIVE);
+
+    /** Act. One sensor drops out for three cycles, then every sensor for two. */
+    inputs.redundantTemperatures[1] = NAN;
+    hal.setInputs(inputs);
+    for (int i = 0; i < 3; i++) {
+        fsm.handleCurrentState();
+    }
+    inputs.temperature = NAN;
+    inputs.redundantTemperatures[0] = NAN;
+    hal.setInputs(inputs);
+    for (int i = 0; i < 2; i++) {
+        fsm.handleCurrentState();
+    }
+
+    /** Assert. */
+    EXPECT_EQ(fsm.getState(), STATE_ACTIVE);
+    EXPECT_EQ(metrics.getCount(METRIC_FUSION_DEGRADED), 3U);
+    EXPECT_EQ(metrics.getCount(METRIC_FUSION_FAILED), 2U);
+    ASSERT_TRUE(diagnostics.getRecord(DTC_SENSOR_DEGRADED, degraded));
+    ASSERT_TRUE(diagnostics.getRecord(DTC_SENSOR_FAILED, failed));
+    EXPECT_EQ(degraded.occurrences, 1U);
+    EXPECT_EQ(failed.occurrences, 1U);
+    EXPECT_EQ(failed.freezeFrameState, STATE_ACTIVE);
+}
+
+/**
+ * @brief Ensures that a reading frozen while the other sensors move is flagged as stale.
+ */
+TEST(FusionTests, FlagsFrozenSensor)
+{
+    PlcInputs_t inputs = {};
+    FusedTemperature_t fused = {};
+    const uint32_t staleCycles = 5;
+
+    /** Arrange. */
+    FusionConfig_t config = {3, 0.01f, FUSION_DEFAULT_MAX_RATE_C_PER_S, FUSION_DEFAULT_VOTE_TOLERANCE_C, staleCycles};
+    FusionManager fusion(config);
+
+    /** Act. */
+    for (int cycle = 0; cycle < 10; cycle++) {
+        inputs.temperature = 50.0f + 0.01f * cycle;
+        inputs.redundantTemperatures[0] = 50.5f + 0.01f * cycle;
+        inputs.redundantTemperatures[1] = 50.0f;
+        fusion.fuse(inputs, fused);
+    }
+
+    /** Assert. */
+    EXPECT_EQ(fused.health, FUSION_DEGRADED);
+    EXPECT_EQ(fused.agreeingMask, 0x3U);
+    EXPECT_EQ(fused.flags[2], FUSION_FLAG_STALE);
+    EXPECT_NEAR(fused.temperature, 50.34f, 0.001f);
+}
+
+/**
+ * @brief Ensures that the controller keeps regulating on the fused temperature when the main sensor fails,
+ * and cools as hard as possible when every sensor fails.
+ */
+TEST(FusionTests, ControllerSurvivesFailedMainSensor)
+{
+    PlcInputs_t inputs = {};
+    FusedTemperature_t fused = {};
+    int fanPowerPercent = 0;
+    int pumpPowerPercent = 0;
+
+    /** Arrange. */
+    FusionConfig_t config = {3, 0.01f, FUSION_DEFAULT_MAX_RATE_C_PER_S, FUSION_DEFAULT_VOTE_TOLERANCE_C,
+                             FUSION_DEFAULT_STALE_CYCLES};
+    FusionManager fusion(config);
+    ControlManager controller = ControlManager(60.0f);
+
+    inputs.temperature = NAN;
+    inputs.redundantTemperatures[0] = 55.0f;
+    inputs.redundantTemperatures[1] = 55.5f;
+
+    /** Act & Assert. */
+    fusion.fuse(inputs, fused);
+    controller.process(fused, fanPowerPercent, pumpPowerPercent);
+    EXPECT_EQ(fanPowerPercent, 0);
+    EXPECT_EQ(pumpPowerPercent, 0);
+
+    inputs.redundantTemperatures[0] = NAN;
+    inputs.redundantTemperatures[1] = 200.0f;
+    fusion.fuse(inputs, fused);
+    controller.process(fused, fanPowerPercent, pumpPowerPercent);
+    EXPECT_EQ(fused.health, FUSION_FAILED);
+    EXPECT_EQ(fanPowerPercent, 100);
+    EXPECT_EQ(pumpPowerPercent, 100);
+}
+
+/**
+ * @brief Ensures that received frames are counted as malformed or unknown, and never stall the reception queue.
+ */
+TEST(MetricsTests, ClassifiesReceivedCanFrames)
+{
+    CanFrame_t tooLong = {0x100U, CAN_MESSAGE_LEN + 1, {}};
+    CanFrame_t wideId = {CAN_MAX_EXTENDED_ID + 1U, 0, {}};
+    CanFrame_t unknown = {CAN_MAX_EXTENDED_ID, CAN_MESSAGE_LEN, {}};
+
+    /** Arrange. */
+    Parameters_t params = {20.0f, 20.0f};
+    MetricsManager metrics;
+    HardwareManager hal = HardwareManager(&metrics);
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    StateManager fsm = StateManager(params, &hal, &controller, &metrics);
+
+    fsm.initialize();
+    fsm.handleCurrentState();
+
+    /** Act. */
+    hal.queueReceivedCanFrame(tooLong);
+    hal.queueReceivedCanFrame(wideId);
+    hal.queueReceivedCanFrame(unknown);
+    fsm.handleCurrentState();
+
+    /** Assert. */
+    EXPECT_EQ(metrics.getCount(METRIC_CAN_RX_FRAMES), 3U);
+    EXPECT_EQ(metrics.getCount(METRIC_CAN_RX_MALFORMED), 2U);
+    EXPECT_EQ(metrics.getCount(METRIC_CAN_RX_UNKNOWN), 1U);
+}
+
+/**
+ * @brief Ensures that transitions and failed guards are counted per state.
+ */
+TEST(MetricsTests, CountsTransitionsAndGuardFailures)
+{
+    PlcInputs_t inputs = {};
+    float supplyVoltageThreshold = 20.0f;
+
+    /** Arrange. */
+    Parameters_t params = {supplyVoltageThreshold, 20.0f};
+    MetricsManager metrics;
+    HardwareManager hal = HardwareManager(&metrics);
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    StateManager fsm = StateManager(params, &hal, &controller, &metrics);
+
+    /** Act. */
+    fsm.initialize();
+    fsm.handleCurrentState();
+
+    hal.retrieveInputs(inputs);
+    inputs.ignitionClosed = true;
+    inputs.supplyVoltage = supplyVoltageThreshold - 1;
+    hal.setInputs(inputs);
+
+    fsm.handleCurrentState();
+    fsm.handleCurrentState();
+
+    /** Assert. */
+    EXPECT_EQ(metrics.getTransitionCount(STATE_BOOT, STATE_IDLE), 1U);
+    EXPECT_EQ(metrics.getTransitionCount(STATE_IDLE, STATE_IGNITION), 1U);
+    EXPECT_EQ(metrics.getTransitionCount(STATE_IGNITION, STATE_IDLE), 1U);
+    EXPECT_EQ(metrics.getGuardFailureCount(STATE_IGNITION, GUARD_UNDERVOLTAGE), 1U);
+    EXPECT_EQ(metrics.getGuardFailureCount(STATE_IGNITION, GUARD_COOLANT_DRY), 0U);
+    EXPECT_EQ(metrics.getCount(METRIC_CYCLES), 3U);
+}
+
+/**
+ * @brief Ensures that counters incremented from several threads are summed on scrape.
+ */
+TEST(MetricsTests, AggregatesCountersAcrossThreads)
+{
+    const int threadCount = 4;
+    const int incrementsPerThread = 10000;
+    std::thread threads[threadCount];
+
+    /** Arrange. */
+    MetricsManager metrics;
+
+    /** Act. */
+    for (std::thread &thread : threads) {
+        thread = std::thread([&metrics]() {
+            for (int i = 0; i < incrementsPerThread; i++) {
+                metrics.count(METRIC_CAN_RX_FRAMES);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    /** Assert. */
+    EXPECT_EQ(metrics.getCount(METRIC_CAN_RX_FRAMES), (uint64_t)(threadCount * incrementsPerThread));
+}
+
+/**
+ * @brief Ensures that a thread switching between instances keeps its slot in each,
+ * so the other threads don't end up sharing the overflow slot.
+ */
+TEST(MetricsTests, ThreadKeepsItsSlotAcrossInstances)
+{
+    const int incrementsPerThread = 10000;
+    std::thread threads[METRICS_MAX_THREADS - 1];
+
+    /** Arrange. */
+    MetricsManager first;
+    MetricsManager second;
+    for (int i = 0; i < 4 * METRICS_MAX_THREADS; i++) {
+        first.count(METRIC_CYCLES);
+        second.count(METRIC_CYCLES);
+    }
+
+    /** Act. */
+    for (std::thread &thread : threads) {
+        thread = std::thread([&first]() {
+            for (int i = 0; i < incrementsPerThread; i++) {
+                first.count(METRIC_CAN_RX_FRAMES);
+            }
+        });
+    }
+    for (int i = 0; i < incrementsPerThread; i++) {
+        first.count(METRIC_CAN_RX_FRAMES);
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    /** Assert. */
+    EXPECT_EQ(first.getCount(METRIC_CYCLES), (uint64_t)(4 * METRICS_MAX_THREADS));
+    EXPECT_EQ(second.getCount(METRIC_CYCLES), (uint64_t)(4 * METRICS_MAX_THREADS));
+    EXPECT_EQ(first.getCount(METRIC_CAN_RX_FRAMES), (uint64_t)(METRICS_MAX_THREADS * incrementsPerThread));
+}
+
+/**
+ * @brief Ensures that the scraped text contains the labelled series.
+ */
+TEST(MetricsTests, ScrapeFormatsPrometheusText)
+{
+    std::string text;
+
+    /** Arrange. */
+    MetricsManager metrics;
+    metrics.countTransition(STATE_BOOT, STATE_IDLE);
+    metrics.countGuardFailure(STATE_ACTIVE, GUARD_COOLANT_DRY);
+    metrics.count(METRIC_CYCLE_OVERRUNS);
+
+    /** Act. */
+    metrics.scrape(text);
+
+    /** Assert. */
+    EXPECT_NE(text.find("eae_transitions_total{from=\"boot\",to=\"idle\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("eae_guard_failures_total{state=\"active\",reason=\"coolant_dry\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("eae_cycle_overruns_total 1\n"), std::string::npos);
+}
+
+/**
+ * @brief Ensures that a cycle stalled past its deadline forces the safe outputs
+ * without tripping the watchdog.
+ */
+TEST(WatchdogTests, StalledCycleForcesSafeOutputs)
+{
+    PlcOutputs_t outputs = {};
+    WatchdogStatistics_t statistics = {};
+
+    /** Arrange. */
+    HardwareManager hal = HardwareManager();
+    WatchdogConfig_t config = {};
+    config.deadlineUs = 1000;
+    config.maxConsecutiveOverruns = 3;
+    WatchdogManager watchdog(&hal, config);
+
+    hal.retrieveOutputs(outputs);
+    outputs.fanEnable = true;
+    outputs.fanPowerPercent = 80;
+    hal.setOutputs(outputs);
+
+    /** Act. */
+    watchdog.beginCycle();
+    watchdog.supervise(std::chrono::steady_clock::now() + std::chrono::milliseconds(10));
+    watchdog.endCycle();
+
+    /** Assert. */
+    hal.retrieveOutputs(outputs);
+    watchdog.getStatistics(statistics);
+    EXPECT_FALSE(outputs.fanEnable);
+    EXPECT_EQ(outputs.fanPowerPercent, 0);
+    EXPECT_EQ(statistics.overruns, 1U);
+    EXPECT_FALSE(watchdog.isTripped());
+}
+
+/**
+ * @brief Ensures that a cycle stalled inside the HAL, holding the outputs lock, doesn't block
+ * the supervisor, and that the outputs the cycle writes when it resumes aren't driven.
+ */
+TEST(WatchdogTests, CycleStalledInHalTripsWatchdog)
+{
+    PlcOutputs_t outputs = {};
+    std::atomic<bool> supervised(false);
+    bool supervisedWhileStalled = false;
+
+    /** Arrange. */
+    HardwareManager hal = HardwareManager();
+    WatchdogConfig_t config = {};
+    config.deadlineUs = 1000;
+    config.maxConsecutiveOverruns = 1;
+    WatchdogManager watchdog(&hal, config);
+
+    hal.retrieveOutputs(outputs);
+    outputs.fanEnable = true;
+    outputs.fanPowerPercent = 80;
+
+    /** Act. */
+    watchdog.beginCycle();
+    hal.getOutputsLock().lock();
+    std::thread supervisor([&]() {
+        watchdog.supervise(std::chrono::steady_clock::now() + std::chrono::milliseconds(10));
+        supervised = true;
+    });
+    for (int i = 0; i < 1000 && supervised == false; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    supervisedWhileStalled = supervised;
+    hal.getOutputsLock().unlock();
+    supervisor.join();
+
+    hal.setOutputs(outputs);
+    watchdog.endCycle();
+
+    /** Assert. */
+    hal.retrieveOutputs(outputs);
+    EXPECT_TRUE(supervisedWhileStalled);
+    EXPECT_TRUE(watchdog.isTripped());
+    EXPECT_FALSE(outputs.fanEnable);
+    EXPECT_EQ(outputs.fanPowerPercent, 0);
+}
+
+/**
+ * @brief Ensures that a state machine task that misses its heartbeat forces the safe outputs
+ * and trips the watchdog, even though the control task keeps meeting its deadline.
+ */
+TEST(WatchdogTests, MissedStateHeartbeatTripsWatchdog)
+{
+    PlcOutputs_t outputs = {};
+    WatchdogStatistics_t statistics = {};
+
+    /** Arrange. */
+    HardwareManager hal = HardwareManager();
+    WatchdogConfig_t config = {};
+    config.deadlineUs = 1000;
+    config.maxConsecutiveOverruns = 3;
+    config.heartbeatTimeoutUs = 20000;
+    WatchdogManager watchdog(&hal, config);
+
+    hal.retrieveOutputs(outputs);
+    outputs.fanEnable = true;
+    outputs.fanPowerPercent = 80;
+    hal.setOutputs(outputs);
+
+    /** Act. */
+    watchdog.supervise(std::chrono::steady_clock::now() + std::chrono::milliseconds(100));
+    bool trippedDisarmed = watchdog.isTripped();
+
+    watchdog.heartbeat();
+    watchdog.supervise(std::chrono::steady_clock::now() + std::chrono::milliseconds(10));
+    bool trippedInTime = watchdog.isTripped();
+
+    watchdog.beginCycle();
+    watchdog.endCycle();
+    watchdog.supervise(std::chrono::steady_clock::now() + std::chrono::milliseconds(30));
+    watchdog.supervise(std::chrono::steady_clock::now() + std::chrono::milliseconds(40));
+
+    /** Assert. */
+    hal.retrieveOutputs(outputs);
+    watchdog.getStatistics(statistics);
+    EXPECT_FALSE(trippedDisarmed);
+    EXPECT_FALSE(trippedInTime);
+    EXPECT_TRUE(watchdog.isTripped());
+    EXPECT_FALSE(outputs.fanEnable);
+    EXPECT_EQ(outputs.fanPowerPercent, 0);
+    EXPECT_EQ(statistics.missedHeartbeats, 1U);
+    EXPECT_EQ(statistics.overruns, 0U);
+}
+
+/**
+ * @brief Ensures that, after too many consecutive deadline misses,
+ * the FSM enters the STATE_FATAL_ERROR state and stays there.
+ */
+TEST(WatchdogTests, ConsecutiveOverrunsEnterFatalErrorState)
+{
+    /** Arrange. */
+    Parameters_t params = {20.0f, 20.0f};
+    HardwareManager hal = HardwareManager();
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    WatchdogConfig_t config = {};
+    config.deadlineUs = 1000;
+    config.maxConsecutiveOverruns = 2;
+    WatchdogManager watchdog(&hal, config);
+    StateManager fsm = StateManager(params, &hal, &controller, nullptr, &watchdog);
+
+    /** Act. */
+    fsm.initialize();
+    fsm.handleCurrentState();
+
+    for (int i = 0; i < 2; i++) {
+        watchdog.beginCycle();
+        watchdog.supervise(std::chrono::steady_clock::now() + std::chrono::milliseconds(10));
+        watchdog.endCycle();
+    }
+
+    fsm.handleCurrentState();
+    fsm.handleCurrentState();
+
+    /** Assert. */
+    EXPECT_TRUE(watchdog.isTripped());
+    EXPECT_EQ(fsm.getState(), STATE_FATAL_ERROR);
+}
+
+/**
+ * @brief Ensures that cycles that meet their deadline are recorded in the statistics.
+ */
+TEST(WatchdogTests, RecordsCycleStatistics)
+{
+    WatchdogStatistics_t statistics = {};
+    uint64_t histogramTotal = 0;
+
+    /** Arrange. */
+    Parameters_t params = {20.0f, 20.0f};
+    HardwareManager hal = HardwareManager();
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    WatchdogConfig_t config = {};
+    config.deadlineUs = 1000000;
+    config.maxConsecutiveOverruns = 1;
+    WatchdogManager watchdog(&hal, config);
+    StateManager fsm = StateManager(params, &hal, &controller, nullptr, &watchdog);
+
+    /** Act. */
+    fsm.initialize();
+    for (int i = 0; i < 10; i++) {
+        fsm.handleCurrentState();
+    }
+
+    /** Assert. */
+    watchdog.getStatistics(statistics);
+    for (uint64_t bucket : statistics.histogram) {
+        histogramTotal += bucket;
+    }
+    EXPECT_EQ(statistics.cycles, 10U);
+    EXPECT_EQ(statistics.overruns, 0U);
+    EXPECT_EQ(histogramTotal, 10U);
+    EXPECT_GT(statistics.minSlackUs, 0);
+    EXPECT_EQ(fsm.getState(), STATE_IDLE);
+}
+
+/**
+ * @brief Ensures that a thread is pinned to the configured CPU.
+ * Priorities are left at 0, since SCHED_FIFO needs privileges the tests may not have.
+ */
+TEST(RealtimeTests, PinsThreadToCpu)
+{
+    int cpu = -1;
+    int allowedCpu = -1;
+    bool configured = false;
+    cpu_set_t allowed;
+
+    /** Arrange. The test may be confined to some CPUs, so pin to the first one allowed. */
+    CPU_ZERO(&allowed);
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    for (int i = 0; i < CPU_SETSIZE && allowedCpu < 0; i++) {
+        if (CPU_ISSET(i, &allowed)) {
+            allowedCpu = i;
+        }
+    }
+    ASSERT_GE(allowedCpu, 0);
+    RealtimeConfig_t config = {};
+    config.cpu[REALTIME_THREAD_AUX] = allowedCpu;
+    config.cpu[REALTIME_THREAD_CONTROL] = -1;
+    config.cpu[REALTIME_THREAD_SUPERVISOR] = -1;
+    RealtimeManager rt(config);
+
+    /** Act. */
+    std::thread thread([&]() {
+        configured = rt.configureCurrentThread(REALTIME_THREAD_AUX);
+        cpu = sched_getcpu();
+    });
+    thread.join();
+
+    /** Assert. */
+    EXPECT_TRUE(configured);
+    EXPECT_EQ(cpu, allowedCpu);
+}
+
+/**
+ * @brief Ensures that received CAN frames beyond the queue capacity are dropped and counted,
+ * and that the state machine drains the queue.
+ */
+TEST(CanTests, DropsFramesWhenReceptionQueueIsFull)
+{
+    CanFrame_t frame = {0x100, 1, {0x42}};
+    int queued = 0;
+
+    /** Arrange. */
+    Parameters_t params = {20.0f, 20.0f};
+    MetricsManager metrics;
+    HardwareManager hal = HardwareManager(&metrics);
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    StateManager fsm = StateManager(params, &hal, &controller, &metrics);
+
+    fsm.initialize();
+    fsm.handleCurrentState();
+
+    /** Act. */
+    for (int i = 0; i < CAN_RX_QUEUE_SIZE + 1; i++) {
+        queued += hal.queueReceivedCanFrame(frame) ? 1 : 0;
+    }
+    fsm.handleCurrentState();
+
+    /** Assert. */
+    EXPECT_EQ(queued, CAN_RX_QUEUE_SIZE);
+    EXPECT_EQ(metrics.getCount(METRIC_CAN_RX_DROPS), 1U);
+    EXPECT_EQ(metrics.getCount(METRIC_CAN_RX_FRAMES), (uint64_t)CAN_RX_QUEUE_SIZE);
+    EXPECT_FALSE(hal.receiveCanFrame(frame));
+}
+
+/**
+ * @brief Ensures that the tripwire counts allocations made while it is armed, and only those.
+ */
+TEST(AllocationTests, TripwireCountsArmedAllocations)
+{
+    if (AllocationTripwire::isEnabled() == false) {
+        GTEST_SKIP() << "Built without EAE_ALLOCATION_TRIPWIRE.";
+    }
+
+    /** Arrange. */
+    uint64_t before = AllocationTripwire::getCount();
+
+    /** Act. */
+    int *unarmed = new int(1);
+    AllocationTripwire::arm();
+    int *armed = new int(2);
+    AllocationTripwire::disarm();
+
+    /** Assert. */
+    EXPECT_EQ(AllocationTripwire::getCount() - before, 1U);
+    delete unarmed;
+    delete armed;
+}
+
+/**
+ * @brief Ensures that a million cycles through every state, with CAN traffic
+ * and logging, don't allocate any memory.
+ */
+TEST(AllocationTests, StateMachineCyclesDoNotAllocate)
+{
+    if (AllocationTripwire::isEnabled() == false) {
+        GTEST_SKIP() << "Built without EAE_ALLOCATION_TRIPWIRE.";
+    }
+
+    PlcInputs_t inputs = {};
+    CanFrame_t frame = {0x100, 1, {0x42}};
+    float supplyVoltageThreshold = 20.0f;
+
+    /** Arrange. */
+    Parameters_t params = {supplyVoltageThreshold, 20.0f};
+    MetricsManager metrics;
+    HardwareManager hal = HardwareManager(&metrics);
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    WatchdogConfig_t config = {};
+    config.deadlineUs = 1000000;
+    config.maxConsecutiveOverruns = 1000000;
+    WatchdogManager watchdog(&hal, config);
+    StateManager fsm = StateManager(params, &hal, &controller, &metrics, &watchdog);
+
+    fsm.initialize();
+    uint64_t before = AllocationTripwire::getCount();
+
+    /** Act. Toggle the inputs to visit every guard, in both the ignition and active states. */
+    for (int i = 0; i < 1000000; i++) {
+        inputs.ignitionClosed = (i / 100) % 2 == 0;
+        inputs.levelSwitchClosed = (i % 1000) < 850 || (i % 1000) >= 900;
+        inputs.supplyVoltage = (i / 10000) % 3 == 2 ? supplyVoltageThreshold - 1 : supplyVoltageThreshold + 1;
+        hal.setInputs(inputs);
+        if (i % 10 == 0) {
+            hal.queueReceivedCanFrame(frame);
+        }
+
+        fsm.handleCurrentState();
+    }
+
+    /** Assert. */
+    EXPECT_EQ(AllocationTripwire::getCount() - before, 0U);
+    EXPECT_GT(metrics.getTransitionCount(STATE_ACTIVE, STATE_IDLE), 0U);
+    EXPECT_GT(metrics.getGuardFailureCount(STATE_ACTIVE, GUARD_COOLANT_DRY), 0U);
+}
+
+/**
+ * @brief Ensures that a switch input change wakes up the event loop, and that other inputs don't.
+ */
+TEST(EventTests, SwitchChangeWakesUpEventLoop)
+{
+    PlcInputs_t inputs = {};
+    uint32_t voltageSources = EVENT_NONE;
+    uint32_t switchSources = EVENT_NONE;
+
+    /** Arrange. */
+    EventManager events;
+    ASSERT_TRUE(events.initialize());
+    HardwareManager hal = HardwareManager(nullptr, &events);
+
+    /** Act. */
+    hal.retrieveInputs(inputs);
+    inputs.supplyVoltage = 24.0f;
+    hal.setInputs(inputs);
+    voltageSources = events.waitUntil(std::chrono::steady_clock::now() + std::chrono::milliseconds(5));
+
+    inputs.ignitionClosed = true;
+    hal.setInputs(inputs);
+    switchSources = events.waitUntil(std::chrono::steady_clock::now() + std::chrono::seconds(10));
+
+    /** Assert. */
+    EXPECT_EQ(voltageSources, (uint32_t)EVENT_TIMEOUT);
+    EXPECT_EQ(switchSources, (uint32_t)EVENT_INPUT_CHANGE);
+}
+
+/**
+ * @brief Ensures that a received CAN frame wakes up the event loop.
+ */
+TEST(EventTests, CanFrameWakesUpEventLoop)
+{
+    CanFrame_t frame = {0x100, 1, {0x42}};
+    uint32_t sources = EVENT_NONE;
+
+    /** Arrange. */
+    EventManager events;
+    ASSERT_TRUE(events.initialize());
+    HardwareManager hal = HardwareManager(nullptr, &events);
+
+    /** Act. */
+    std::thread receiver([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        hal.queueReceivedCanFrame(frame);
+    });
+    sources = events.waitUntil(std::chrono::steady_clock::now() + std::chrono::seconds(10));
+    receiver.join();
+
+    /** Assert. */
+    EXPECT_EQ(sources, (uint32_t)EVENT_CAN_RX);
+}
+
+/**
+ * @brief Ensures that the event loop is woken up to sample the inputs, and that an unchanged
+ * sample doesn't count as a switch change.
+ */
+TEST(EventTests, InputSamplingWakesUpEventLoop)
+{
+    uint32_t sampleSources = EVENT_NONE;
+    uint32_t nextSources = EVENT_NONE;
+    bool switchesChanged = true;
+
+    /** Arrange. */
+    EventManager events;
+    ASSERT_TRUE(events.initialize());
+    HardwareManager hal = HardwareManager(nullptr, &events);
+    events.startSampling(std::chrono::milliseconds(1));
+
+    /** Act. */
+    sampleSources = events.waitUntil(std::chrono::steady_clock::now() + std::chrono::seconds(10));
+    switchesChanged = hal.sampleInputs();
+    nextSources = events.waitUntil(std::chrono::steady_clock::now() + std::chrono::seconds(10));
+
+    /** Assert. */
+    EXPECT_EQ(sampleSources, (uint32_t)EVENT_INPUT_SAMPLE);
+    EXPECT_FALSE(switchesChanged);
+    EXPECT_EQ(nextSources, (uint32_t)EVENT_INPUT_SAMPLE);
+}
+
+/**
+ * @brief Ensures that only the idle and fatal error states are left to the event loop.
+ */
+TEST(EventTests, ActiveStateRunsPeriodically)
+{
+    PlcInputs_t inputs = {};
+
+    /** Arrange. */
+    Parameters_t params = {20.0f, 20.0f};
+    HardwareManager hal = HardwareManager();
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    StateManager fsm = StateManager(params, &hal, &controller);
+
+    /** Act & Assert. */
+    fsm.initialize();
+    EXPECT_TRUE(fsm.needsPeriodicExecution());
+    fsm.handleCurrentState();
+    EXPECT_FALSE(fsm.needsPeriodicExecution());
+
+    inputs.ignitionClosed = true;
+    inputs.levelSwitchClosed = true;
+    inputs.supplyVoltage = 24.0f;
+    hal.setInputs(inputs);
+    fsm.handleCurrentState();
+    fsm.handleCurrentState();
+    EXPECT_EQ(fsm.getState(), STATE_ACTIVE);
+    EXPECT_TRUE(fsm.needsPeriodicExecution());
+}
+
+/**
+ * @brief Ensures that a display state longer than one frame is segmented into
+ * a first frame and numbered consecutive frames that reassemble into the payload.
+ */
+TEST(DisplayTests, SegmentsLongMessages)
+{
+    CanFrame_t frame = {};
+    std::string payload;
+    int frames = 0;
+    size_t length = 0;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    /** Arrange. */
+    DisplayManager display;
+    display.update({SUFFICIENT, DISPLAY_MESSAGE_READY_FOR_IGNITION});
+
+    /** Act. Space the frames out so the rate limit never applies. */
+    while (display.nextFrame(frame, now)) {
+        if (frames == 0) {
+            EXPECT_EQ(frame.data[0] & 0xF0, 0x10);
+            length = ((frame.data[0] & 0x0F) << 8) | frame.data[1];
+            payload.append((const char *)&frame.data[2], frame.dlc - 2);
+        } else {
+            EXPECT_EQ(frame.data[0], 0x20 | (frames & 0x0F));
+            payload.append((const char *)&frame.data[1], frame.dlc - 1);
+        }
+        EXPECT_EQ(frame.id, (uint32_t)DISPLAY_CAN_ID);
+        frames++;
+        now += std::chrono::seconds(1);
+    }
+
+    /** Assert. */
+    ASSERT_EQ(payload.size(), length);
+    EXPECT_EQ(payload[0], SUFFICIENT);
+    EXPECT_EQ(payload[1], DISPLAY_MESSAGE_READY_FOR_IGNITION);
+    EXPECT_EQ(payload.substr(2), DisplayManager::getMessageText(DISPLAY_MESSAGE_READY_FOR_IGNITION));
+    EXPECT_FALSE(display.isTransferring());
+}
+
+/**
+ * @brief Ensures that display frames are released no faster than the rate limit allows.
+ */
+TEST(DisplayTests, RateLimitsFrames)
+{
+    CanFrame_t frame = {};
+    int burst = 0;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    /** Arrange. */
+    DisplayManager display;
+    display.update({DRY, DISPLAY_MESSAGE_COOLANT_REFILL_REQUIRED});
+
+    /** Act. Spend the burst, then start another transfer straight away. */
+    while (display.nextFrame(frame, now)) {
+        burst++;
+    }
+    display.update({SUFFICIENT, DISPLAY_MESSAGE_READY_FOR_IGNITION});
+    bool sentBeforeRefill = display.nextFrame(frame, now + std::chrono::microseconds(100));
+    bool sentAfterRefill = display.nextFrame(frame, now + std::chrono::milliseconds(1000 / DISPLAY_FRAMES_PER_SECOND));
+
+    /** Assert. */
+    EXPECT_EQ(burst, DISPLAY_FRAME_BURST);
+    EXPECT_FALSE(sentBeforeRefill);
+    EXPECT_TRUE(sentAfterRefill);
+}
+
+/**
+ * @brief Ensures that a transfer held back by the rate limit is finished by flushing the display alone,
+ * as the event-driven loop does while the state machine sleeps.
+ */
+TEST(DisplayTests, FlushingDisplayFinishesTransfer)
+{
+    PlcOutputs_t outputs = {};
+    CanFrame_t frame = {};
+    int heldFrames = 0;
+    int flushedFrames = 0;
+
+    /** Arrange. Spend the burst on a first transfer, then start another straight away. */
+    HardwareManager hal = HardwareManager();
+    outputs.displayState = {DRY, DISPLAY_MESSAGE_COOLANT_REFILL_REQUIRED};
+    hal.setOutputs(outputs);
+    hal.flushOutputs();
+    while (hal.popTransmitCanFrame(frame)) {
+    }
+    outputs.displayState = {SUFFICIENT, DISPLAY_MESSAGE_READY_FOR_IGNITION};
+    hal.setOutputs(outputs);
+    hal.flushOutputs();
+    while (hal.popTransmitCanFrame(frame)) {
+        heldFrames++;
+    }
+
+    /** Act. */
+    std::this_thread::sleep_for(std::chrono::milliseconds(DISPLAY_FRAME_BURST * 1000 / DISPLAY_FRAMES_PER_SECOND));
+    hal.flushDisplay();
+    while (hal.popTransmitCanFrame(frame)) {
+        flushedFrames++;
+    }
+
+    /** Assert. The transfer is a first frame and three consecutive frames. */
+    EXPECT_LT(heldFrames, 4);
+    EXPECT_EQ(heldFrames + flushedFrames, 4);
+}
+
+/**
+ * @brief Ensures that the idle state only sends display frames when the display state changes.
+ */
+TEST(DisplayTests, SendsOnlyOnChange)
+{
+    PlcInputs_t inputs = {};
+    CanFrame_t frame = {};
+    int firstFrames = 0;
+    int repeatFrames = 0;
+    int changeFrames = 0;
+
+    /** Arrange. */
+    Parameters_t params = {20.0f, 20.0f};
+    HardwareManager hal = HardwareManager();
+    ControlManager controller = ControlManager(params.temperatureSetpoint);
+    StateManager fsm = StateManager(params, &hal, &controller);
+
+    fsm.initialize();
+    fsm.handleCurrentState();
+
+    /** Act. */
+    inputs.levelSwitchClosed = true;
+    hal.setInputs(inputs);
+    fsm.handleCurrentState();
+    while (hal.popTransmitCanFrame(frame)) {
+        firstFrames += frame.id == DISPLAY_CAN_ID ? 1 : 0;
+    }
+
+    for (int i = 0; i < 10; i++) {
+        fsm.handleCurrentState();
+    }
+    while (hal.popTransmitCanFrame(frame)) {
+        repeatFrames += frame.id == DISPLAY_CAN_ID ? 1 : 0;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(DISPLAY_FRAME_BURST * 1000 / DISPLAY_FRAMES_PER_SECOND));
+    inputs.levelSwitchClosed = false;
+    hal.setInputs(inputs);
+    fsm.handleCurrentState();
+    while (hal.popTransmitCanFrame(frame)) {
+        changeFrames += frame.id == DISPLAY_CAN_ID ? 1 : 0;
+    }
+
+    /** Assert. */
+    EXPECT_GT(firstFrames, 0);
+    EXPECT_EQ(repeatFrames, 0);
+    EXPECT_GT(changeFrames, 0);
+}
+
+/**
+ * @brief Ensures that the safety invariants hold for a million random steps,
+ * and that the random steps reach the active and fatal error states.
+ */
+TEST(PropertyTests, InvariantsHoldForRandomSteps)
+{
+    const int runs = 1000;
+    const int steps = 1000;
+    uint8_t step[FUZZ_STEP_SIZE] = {};
+    bool reachedActive = false;
+    bool reachedFatalError = false;
+
+    /** Arrange. A fixed seed, so that a failure can be reproduced. */
+    Parameters_t params = {20.0f, 20.0f};
+    std::mt19937 generator(1234);
+
+    for (int run = 0; run < runs; run++) {
+        FsmHarness harness(params);
+
+        for (int i = 0; i < steps; i++) {
+            for (uint8_t &byte : step) {
+                byte = (uint8_t)generator();
+            }
+
+            /** Act. */
+            FuzzViolation_e violation = harness.step(step);
+
+            /** Assert. */
+            ASSERT_EQ(violation, FUZZ_OK) << FsmHarness::getViolationName(violation) << " in run " << run
+                                          << ", step " << i;
+            reachedActive |= harness.getState() == STATE_ACTIVE;
+            reachedFatalError |= harness.getState() == STATE_FATAL_ERROR;
+        }
+    }
+
+    EXPECT_TRUE(reachedActive);
+    EXPECT_TRUE(reachedFatalError);
+}
+
 int main(int argc, char **argv) {
     // Initialize the GoogleTest framework with command-line arguments
     ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "controller.h"
+#include "thermal.h"
+
+/** Default simulation settings. */
+#define DEFAULT_SETPOINT_C 60.0f
+#define DEFAULT_BAND_C 0.5f
+#define DEFAULT_LOAD_STEP 0.5f
+#define DEFAULT_WARMUP_S 1800.0f
+#define DEFAULT_DURATION_S 1800.0f
+#define DEFAULT_PERIOD_MS 10
+
+/** Default number of timed controller updates. */
+#define DEFAULT_CALLS 200000
+
+/** Demand step used to identify the plant, in percent. */
+#define BENCH_IDENTIFY_STEP_PERCENT 5.0f
+
+/**
+ * @brief The settings shared by every simulation.
+ */
+typedef struct BenchConfig_t {
+    /** The temperature setpoint, in degrees. */
+    float setpointC;
+    /** The temperature is settled once it stays this close to the setpoint, in degrees. */
+    float bandC;
+    /** Relative increase of the load at the end of the warm-up. */
+    float loadStep;
+    /** Simulated time before and after the load step, in seconds. */
+    float warmupS;
+    float durationS;
+    /** The period of the controller, in seconds. */
+    float periodS;
+} BenchConfig_t;
+
+/**
+ * @brief How a controller rejected the load step.
+ */
+typedef struct LoadStepResult_t {
+    /** Highest temperature above the setpoint after the step, in degrees. */
+    float peakC;
+    /** Time from the step until the temperature stayed in the band, in seconds. */
+    float settlingS;
+    /** Integral of the absolute error after the step, in degree seconds. */
+    float iaeCS;
+    /** Electrical energy used by the pump and the fan after the step, in J. */
+    float energyJ;
+    /** Whether the temperature was in the band at the end of the simulation. */
+    bool settled;
+} LoadStepResult_t;
+
+/**
+ * @brief The cost of the controller updates.
+ */
+typedef struct TimingResult_t {
+    double meanNs;
+    double p99Ns;
+    double maxNs;
+} TimingResult_t;
+
+/**
+ * @brief Prints the command line usage.
+ *
+ * @param program The name of the executable.
+ */
+static void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options]" << std::endl;
+    std::cerr << "  --setpoint <C>        Temperature setpoint. Default: " << DEFAULT_SETPOINT_C << std::endl;
+    std::cerr << "  --band <C>            Settling band around the setpoint. Default: " << DEFAULT_BAND_C << std::endl;
+    std::cerr << "  --load-step <R>       Relative increase of the load. Default: " << DEFAULT_LOAD_STEP << std::endl;
+    std::cerr << "  --warmup-s <S>        Simulated time before the load step. Default: " << DEFAULT_WARMUP_S
+              << std::endl;
+    std::cerr << "  --duration-s <S>      Simulated time after the load step. Default: " << DEFAULT_DURATION_S
+              << std::endl;
+    std::cerr << "  --period-ms <MS>      Period of the controller. Default: " << DEFAULT_PERIOD_MS << std::endl;
+    std::cerr << "  --sample-s <S>        Period of the predictive updates. Default: "
+              << CONTROLLER_DEFAULT_SAMPLE_PERIOD_S << std::endl;
+    std::cerr << "  --horizon <N>         Prediction horizon, in samples. Default: " << CONTROLLER_DEFAULT_HORIZON
+              << std::endl;
+    std::cerr << "  --move-suppression <L> Penalty on demand changes. Default: " << CONTROLLER_DEFAULT_MOVE_SUPPRESSION
+              << std::endl;
+    std::cerr << "  --calls <N>           Timed controller updates. Default: " << DEFAULT_CALLS << std::endl;
+}
+
+/**
+ * @brief Finds the demand that holds the plant at a temperature, with the fan and the pump at the demand.
+ *
+ * @param plant The plant.
+ * @param temperatureC The temperature, in degrees.
+ * @return float The demand, in percent.
+ */
+static float settledDemand(const ThermalParameters_t &plant, float temperatureC) {
+    float low = 0.0f;
+    float high = 100.0f;
+
+    /** The rejected heat rises with the demand, so bisect. */
+    for (int i = 0; i < 30; i++) {
+        float demand = 0.5f * (low + high);
+        float rejectedW = ThermalModel::getHeatTransferWPerK(plant, demand / 100.0f, demand / 100.0f) *
+                          (temperatureC - plant.ambientC);
+        if (rejectedW < plant.loadW) {
+            low = demand;
+        } else {
+            high = demand;
+        }
+    }
+
+    return 0.5f * (low + high);
+}
+
+/**
+ * @brief Identifies the step response of the plant around the setpoint, by stepping the demand
+ * of the settled plant and sampling the sensed temperature. The gain is where the stepped plant settles.
+ *
+ * @param plant The plant.
+ * @param config The simulation settings.
+ * @param predictive Its step response and gain are overwritten, at its sample period.
+ */
+static void identify(const ThermalParameters_t &plant, const BenchConfig_t &config, PredictiveConfig_t &predictive) {
+    ThermalModel model(plant, config.setpointC);
+    float duty = (settledDemand(plant, config.setpointC) + BENCH_IDENTIFY_STEP_PERCENT) / 100.0f;
+    long stepsPerSample = std::max(1L, std::lround(predictive.samplePeriodS / config.periodS));
+
+    for (int k = 0; k < CONTROLLER_MODEL_LENGTH; k++) {
+        for (long i = 0; i < stepsPerSample; i++) {
+            model.step(duty, duty, config.periodS);
+        }
+        predictive.stepResponse[k] = (model.getSensedTemperature() - config.setpointC) / BENCH_IDENTIFY_STEP_PERCENT;
+    }
+
+    float settledC = plant.ambientC + plant.loadW / ThermalModel::getHeatTransferWPerK(plant, duty, duty);
+    predictive.gainCPerPercent = (settledC - config.setpointC) / BENCH_IDENTIFY_STEP_PERCENT;
+}
+
+/**
+ * @brief Simulates a controller in closed loop on the plant, warmed up at the setpoint,
+ * through a load step.
+ *
+ * The controller reads the sensed temperature, and the results use the true temperature.
+ *
+ * @param controller The controller.
+ * @param plant The plant.
+ * @param config The simulation settings.
+ * @param result Overwritten with the results.
+ */
+static void simulateLoadStep(ControlManager &controller, ThermalParameters_t plant, const BenchConfig_t &config,
+                             LoadStepResult_t &result) {
+    ThermalModel warm(plant, config.setpointC);
+    long warmupSteps = std::lround(config.warmupS / config.periodS);
+    long steps = std::lround(config.durationS / config.periodS);
+    int fanPowerPercent = 0;
+    int pumpPowerPercent = 0;
+
+    controller.initialize();
+    for (long i = 0; i < warmupSteps; i++) {
+        controller.process(warm.getSensedTemperature(), fanPowerPercent, pumpPowerPercent);
+        warm.step(fanPowerPercent / 100.0f, pumpPowerPercent / 100.0f, config.periodS);
+    }
+
+    /** Carry the temperatures over to a plant with the higher load. */
+    plant.loadW *= 1.0f + config.loadStep;
+    ThermalModel model(plant, warm.getTemperature());
+    float sensed = warm.getSensedTemperature();
+
+    result = {};
+    float lastOutsideS = 0.0f;
+    for (long i = 0; i < steps; i++) {
+        controller.process(i == 0 ? sensed : model.getSensedTemperature(), fanPowerPercent, pumpPowerPercent);
+        model.step(fanPowerPercent / 100.0f, pumpPowerPercent / 100.0f, config.periodS);
+
+        float error = model.getTemperature() - config.setpointC;
+        result.peakC = std::max(result.peakC, error);
+        result.iaeCS += std::fabs(error) * config.periodS;
+        if (std::fabs(error) > config.bandC) {
+            lastOutsideS = (i + 1) * config.periodS;
+        }
+    }
+
+    result.settled = lastOutsideS < steps * config.periodS;
+    result.settlingS = lastOutsideS;
+    result.energyJ = model.getEnergyJ();
+}
+
+/**
+ * @brief Times controller updates, one by one, on a temperature wandering around the setpoint.
+ *
+ * @param controller The controller.
+ * @param config The simulation settings.
+ * @param calls Number of timed updates.
+ * @param result Overwritten with the timings.
+ */
+static void timeUpdates(ControlManager &controller, const BenchConfig_t &config, long calls,
+                        TimingResult_t &result) {
+    std::vector<double> durations(calls);
+    int fanPowerPercent = 0;
+    int pumpPowerPercent = 0;
+    double total = 0.0;
+
+    controller.initialize();
+    for (long i = 0; i < calls; i++) {
+        float temperature = config.setpointC + 2.0f * std::sin(i * 0.001f);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        controller.process(temperature, fanPowerPercent, pumpPowerPercent);
+        durations[i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        total += durations[i];
+    }
+
+    std::sort(durations.begin(), durations.end());
+    result.meanNs = calls > 0 ? total / calls : 0.0;
+    result.p99Ns = calls > 0 ? durations[(size_t)(0.99 * (calls - 1))] : 0.0;
+    result.maxNs = calls > 0 ? durations.back() : 0.0;
+}
+
+/**
+ * @brief Prints the results of a controller.
+ *
+ * @param name The name of the controller.
+ * @param loadStep The load step results.
+ * @param timing The timings.
+ */
+static void printResult(const char *name, const LoadStepResult_t &loadStep, const TimingResult_t &timing) {
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::left << std::setw(11) << name << std::right
+              << " peak " << std::setw(6) << loadStep.peakC << " C"
+              << "  settling " << std::setw(7) << std::setprecision(1) << loadStep.settlingS << " s"
+              << (loadStep.settled ? " " : "*")
+              << "  IAE " << std::setw(7) << loadStep.iaeCS << " C.s"
+              << "  energy " << std::setw(7) << loadStep.energyJ / 1000.0f << " kJ"
+              << "  update mean " << std::setw(6) << timing.meanNs << " ns, p99 " << std::setw(6)
+              << timing.p99Ns << " ns, max " << std::setw(8) << timing.maxNs << " ns" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option longOptions[] = {
+        {"setpoint", required_argument, nullptr, 'S'},
+        {"band", required_argument, nullptr, 'b'},
+        {"load-step", required_argument, nullptr, 'l'},
+        {"warmup-s", required_argument, nullptr, 'w'},
+        {"duration-s", required_argument, nullptr, 'd'},
+        {"period-ms", required_argument, nullptr, 'P'},
+        {"sample-s", required_argument, nullptr, 's'},
+        {"horizon", required_argument, nullptr, 'H'},
+        {"move-suppression", required_argument, nullptr, 'm'},
+        {"calls", required_argument, nullptr, 'c'},
+        {nullptr, 0, nullptr, 0},
+    };
+    BenchConfig_t config = {DEFAULT_SETPOINT_C, DEFAULT_BAND_C, DEFAULT_LOAD_STEP, DEFAULT_WARMUP_S,
+                            DEFAULT_DURATION_S, 0.0f};
+    PredictiveConfig_t predictive = {};
+    int periodMs = DEFAULT_PERIOD_MS;
+    long calls = DEFAULT_CALLS;
+    int option = 0;
+
+    predictive.samplePeriodS = CONTROLLER_DEFAULT_SAMPLE_PERIOD_S;
+    predictive.horizon = CONTROLLER_DEFAULT_HORIZON;
+    predictive.moveSuppression = CONTROLLER_DEFAULT_MOVE_SUPPRESSION;
+
+    /** Parse the options. */
+    while ((option = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (option) {
+            case 'S':
+                config.setpointC = atof(optarg);
+                break;
+            case 'b':
+                config.bandC = atof(optarg);
+                break;
+            case 'l':
+                config.loadStep = atof(optarg);
+                break;
+            case 'w':
+                config.warmupS = atof(optarg);
+                break;
+            case 'd':
+                config.durationS = atof(optarg);
+                break;
+            case 'P':
+                periodMs = atoi(optarg);
+                break;
+            case 's':
+                predictive.samplePeriodS = atof(optarg);
+                break;
+            case 'H':
+                predictive.horizon = (uint32_t)atol(optarg);
+                break;
+            case 'm':
+                predictive.moveSuppression = atof(optarg);
+                break;
+            case 'c':
+                calls = atol(optarg);
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (config.bandC <= 0.0f || config.warmupS < 0.0f || config.durationS <= 0.0f || periodMs <= 0 ||
+        predictive.samplePeriodS <= 0.0f || predictive.horizon < 1 ||
+        predictive.horizon > CONTROLLER_MODEL_LENGTH || predictive.moveSuppression < 0.0f || calls <= 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    config.periodS = periodMs / 1000.0f;
+
+    /** Identify the plant, and compare with the default model the firmware uses. */
+    ThermalParameters_t plant = ThermalModel::getNominalParameters();
+    identify(plant, config, predictive);
+
+    PlantModel_t defaultModel = {CONTROLLER_DEFAULT_MODEL_GAIN_C_PER_PERCENT, CONTROLLER_DEFAULT_MODEL_TIME_CONSTANT_S,
+                                 CONTROLLER_DEFAULT_MODEL_DEAD_TIME_S};
+    PredictiveConfig_t defaults = predictive;
+    ControlManager::buildStepResponse(defaultModel, defaults);
+    if (ControlManager::validatePredictiveConfig(predictive) == false ||
+        ControlManager::validatePredictiveConfig(defaults) == false) {
+        std::cerr << "The model of the predictive controller is rejected." << std::endl;
+        return 1;
+    }
+    std::cout << std::fixed << std::setprecision(3) << "Identified step response, in C per % of demand, every "
+              << predictive.samplePeriodS << " s:" << std::endl;
+    for (int k = 0; k < CONTROLLER_MODEL_LENGTH; k += CONTROLLER_MODEL_LENGTH / 8) {
+        std::cout << "  t=" << std::setw(7) << std::setprecision(0) << (k + 1) * predictive.samplePeriodS
+                  << " s: " << std::setprecision(3) << std::setw(7) << predictive.stepResponse[k]
+                  << " (default model " << std::setw(7) << defaults.stepResponse[k] << ")" << std::endl;
+    }
+    std::cout << "  settled: " << std::setw(7) << predictive.gainCPerPercent << " (default model " << std::setw(7)
+              << defaults.gainCPerPercent << ")" << std::endl;
+
+    /**
+     * Run the controllers through the same load step, and time their updates. The predictive
+     * controller runs with the identified response, and with the default model the firmware uses.
+     */
+    PidGains_t gains = {CONTROLLER_DEFAULT_KP, CONTROLLER_DEFAULT_KI, CONTROLLER_DEFAULT_KD};
+    ControlManager pid(config.setpointC, gains, config.periodS);
+    ControlManager mpc(config.setpointC, gains, config.periodS, ALLOCATION_EQUAL, &predictive);
+    ControlManager mpcDefaults(config.setpointC, gains, config.periodS, ALLOCATION_EQUAL, &defaults);
+    LoadStepResult_t pidStep = {};
+    LoadStepResult_t mpcStep = {};
+    LoadStepResult_t mpcDefaultsStep = {};
+    simulateLoadStep(pid, plant, config, pidStep);
+    simulateLoadStep(mpc, plant, config, mpcStep);
+    simulateLoadStep(mpcDefaults, plant, config, mpcDefaultsStep);
+
+    /** Every call of the timed predictive controllers is a full update. */
+    PredictiveConfig_t everyCall = predictive;
+    PredictiveConfig_t defaultsEveryCall = defaults;
+    everyCall.samplePeriodS = config.periodS;
+    defaultsEveryCall.samplePeriodS = config.periodS;
+    ControlManager mpcEveryCall(config.setpointC, gains, config.periodS, ALLOCATION_EQUAL, &everyCall);
+    ControlManager mpcDefaultsEveryCall(config.setpointC, gains, config.periodS, ALLOCATION_EQUAL,
+                                        &defaultsEveryCall);
+    TimingResult_t pidTiming = {};
+    TimingResult_t mpcTiming = {};
+    TimingResult_t mpcDefaultsTiming = {};
+    timeUpdates(pid, config, calls, pidTiming);
+    timeUpdates(mpcEveryCall, config, calls, mpcTiming);
+    timeUpdates(mpcDefaultsEveryCall, config, calls, mpcDefaultsTiming);
+
+    std::cout << "Load step of " << std::setprecision(0) << config.loadStep * 100.0f << "% at "
+              << config.setpointC << " C, settling band " << std::setprecision(2) << config.bandC
+              << " C (* didn't settle):" << std::endl;
+    printResult("pid", pidStep, pidTiming);
+    printResult("predictive", mpcStep, mpcTiming);
+    printResult("pred/model", mpcDefaultsStep, mpcDefaultsTiming);
+
+    return 0;
+}
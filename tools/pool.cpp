@@ -0,0 +1,94 @@
+#include <thread>
+#include <vector>
+
+#include "pool.h"
+
+/**
+ * @brief Constructor.
+ *
+ * @param workers The number of workers, including the calling thread. Clamped to 1 .. POOL_MAX_WORKERS.
+ */
+WorkStealingPool::WorkStealingPool(unsigned workers)
+    : workers(workers < 1 ? 1 : (workers > POOL_MAX_WORKERS ? POOL_MAX_WORKERS : workers)), steals(0) {
+    for (WorkerRange_t &range : ranges) {
+        range.next.store(0, std::memory_order_relaxed);
+        range.end = 0;
+    }
+}
+
+/**
+ * @brief Runs every task, and returns once they are all done.
+ * The calling thread is worker 0.
+ *
+ * @param count The number of tasks.
+ * @param task The task.
+ * @param context Passed to every task.
+ */
+void WorkStealingPool::run(size_t count, PoolTask_t task, void *context) {
+    std::vector<std::thread> threads;
+
+    /** Split the indices evenly, the first ranges taking the remainder. */
+    size_t begin = 0;
+    for (unsigned i = 0; i < workers; i++) {
+        size_t size = count / workers + (i < count % workers ? 1 : 0);
+        ranges[i].next.store(begin, std::memory_order_relaxed);
+        ranges[i].end = begin + size;
+        begin += size;
+    }
+    steals.store(0, std::memory_order_relaxed);
+
+    /** Starting the threads publishes the ranges to them. */
+    threads.reserve(workers - 1);
+    for (unsigned i = 1; i < workers; i++) {
+        threads.emplace_back(&WorkStealingPool::work, this, i, task, context);
+    }
+    work(0, task, context);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+/**
+ * @brief Retrieves the number of workers.
+ *
+ * @return unsigned The number of workers.
+ */
+unsigned WorkStealingPool::getWorkerCount() {
+    return workers;
+}
+
+/**
+ * @brief Retrieves the number of tasks run by a worker other than the one they were assigned to,
+ * during the last run().
+ *
+ * @return uint64_t The number of stolen tasks.
+ */
+uint64_t WorkStealingPool::getStealCount() {
+    return steals.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Runs tasks until every range is empty.
+ *
+ * Ranges are visited starting with the worker's own, then the next ones in turn,
+ * so that thieves spread over the remaining ranges instead of all hitting the first.
+ *
+ * @param worker The worker.
+ * @param task The task.
+ * @param context Passed to every task.
+ */
+void WorkStealingPool::work(unsigned worker, PoolTask_t task, void *context) {
+    uint64_t stolen = 0;
+
+    for (unsigned offset = 0; offset < workers; offset++) {
+        WorkerRange_t &range = ranges[(worker + offset) % workers];
+        size_t index = 0;
+
+        while ((index = range.next.fetch_add(1, std::memory_order_relaxed)) < range.end) {
+            task(index, worker, context);
+            stolen += offset > 0 ? 1 : 0;
+        }
+    }
+
+    steals.fetch_add(stolen, std::memory_order_relaxed);
+}
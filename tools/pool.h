@@ -0,0 +1,83 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/** Most workers a pool can have. */
+#define POOL_MAX_WORKERS 64
+
+/**
+ * @brief A task run by the pool.
+ *
+ * @param index The index of the task, from 0 to the task count.
+ * @param worker The worker running the task, from 0 to the worker count.
+ * @param context The context given to run().
+ */
+typedef void (*PoolTask_t)(size_t index, unsigned worker, void *context);
+
+/**
+ * @brief Runs indexed tasks across threads, with work stealing.
+ *
+ * The indices are split into one contiguous range per worker. A worker claims the next
+ * index of its own range, and once it runs out, claims the next indices of the other
+ * workers' ranges. Claims are a single fetch_add, so nothing is allocated or locked
+ * once the threads are started, and slow tasks don't leave the other workers idle.
+ */
+class WorkStealingPool {
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param workers The number of workers, including the calling thread. Clamped to 1 .. POOL_MAX_WORKERS.
+     */
+    WorkStealingPool(unsigned workers);
+
+    /**
+     * @brief Runs every task, and returns once they are all done.
+     * The calling thread is worker 0.
+     *
+     * @param count The number of tasks.
+     * @param task The task.
+     * @param context Passed to every task.
+     */
+    void run(size_t count, PoolTask_t task, void *context);
+
+    /**
+     * @brief Retrieves the number of workers.
+     *
+     * @return unsigned The number of workers.
+     */
+    unsigned getWorkerCount();
+
+    /**
+     * @brief Retrieves the number of tasks run by a worker other than the one they were assigned to,
+     * during the last run().
+     *
+     * @return uint64_t The number of stolen tasks.
+     */
+    uint64_t getStealCount();
+
+private:
+    /** The range of indices of a worker, on its own cache line. */
+    typedef struct alignas(64) WorkerRange_t {
+        std::atomic<size_t> next;
+        size_t end;
+    } WorkerRange_t;
+
+    unsigned workers;
+    WorkerRange_t ranges[POOL_MAX_WORKERS];
+    std::atomic<uint64_t> steals;
+
+    /**
+     * @brief Runs tasks until every range is empty.
+     *
+     * @param worker The worker.
+     * @param task The task.
+     * @param context Passed to every task.
+     */
+    void work(unsigned worker, PoolTask_t task, void *context);
+};
+
+#endif
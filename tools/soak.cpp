@@ -0,0 +1,735 @@
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "fsm.h"
+#include "hal.h"
+#include "controller.h"
+#include "metrics.h"
+
+/** Default bus settings. */
+#define DEFAULT_BITRATE 500000
+#define DEFAULT_LOAD_PERCENT 80.0
+#define DEFAULT_BURST 1
+
+/** Default frame mix. */
+#define DEFAULT_EXTENDED_FRACTION 0.1
+#define DEFAULT_MALFORMED_FRACTION 0.05
+
+/** Default run settings. */
+#define DEFAULT_DURATION_S 5.0
+#define DEFAULT_PERIOD_MS 10
+
+/** Frame length on the bus, in bits, without the data and bit stuffing, including the interframe space. */
+#define SOAK_STANDARD_FRAME_BITS 47
+#define SOAK_EXTENDED_FRAME_BITS 67
+
+/** With the hot ID distribution, this fraction of the frames uses one of a few IDs. */
+#define SOAK_HOT_IDS 8
+#define SOAK_HOT_FRACTION 0.9
+
+/** Arrival times of the queued frames. Must be a power of two, well above the reception queue size. */
+#define SOAK_ARRIVAL_RING_SIZE 4096
+
+/** How long the driver thread blocks on the socket before checking whether it must stop. */
+#define SOAK_SOCKET_TIMEOUT_MS 100
+
+/** Supply voltage of the simulated PLC, and the minimum the state machine accepts. */
+#define SOAK_SUPPLY_VOLTAGE 24.0f
+#define SOAK_MIN_VOLTAGE 20.0f
+#define SOAK_SETPOINT_C 60.0f
+
+/**
+ * @brief Describes how the IDs of the frames are drawn.
+ */
+typedef enum SoakIdDistribution_e {
+    /** Uniformly over the standard or extended range. */
+    SOAK_IDS_UNIFORM,
+    /** Mostly from a few IDs, like the periodic messages of a real bus. */
+    SOAK_IDS_HOT,
+
+    SOAK_IDS_MAX
+} SoakIdDistribution_e;
+
+/**
+ * @brief The load and frame mix.
+ */
+typedef struct SoakConfig_t {
+    /** Bus bitrate, in bit/s. */
+    uint32_t bitrate;
+    /** Average bus load, in percent of the bitrate. */
+    double loadPercent;
+    /** Number of frames sent back to back at full bus speed. */
+    uint32_t burst;
+    /** Fraction of frames with a 29-bit ID. */
+    double extendedFraction;
+    /** Fraction of frames that can't be valid, with more than 8 bytes or an ID wider than 29 bits. */
+    double malformedFraction;
+    SoakIdDistribution_e ids;
+    /** Duration of each phase, in seconds. */
+    double durationS;
+    /** Period of the state machine, in milliseconds. */
+    int periodMs;
+    unsigned seed;
+    /** The vcan interface to send through, or nullptr to push onto the reception queue directly. */
+    const char *interface;
+} SoakConfig_t;
+
+/**
+ * @brief State shared by the generator, the driver and the state machine threads during a phase.
+ */
+typedef struct SoakContext_t {
+    const SoakConfig_t *config;
+    HardwareManager *hal;
+    std::atomic<bool> running;
+
+    /** Written by the generator thread. */
+    std::atomic<uint64_t> sent;
+    std::atomic<uint64_t> sentMalformed;
+    std::atomic<uint64_t> sentBits;
+    /** Frames the socket refused, ie. malformed ones. vcan only. */
+    std::atomic<uint64_t> busRejected;
+    /**
+     * Frames with an ID wider than 29 bits, left for the driver to queue directly, since bit 29
+     * of a SocketCAN ID flags an error frame. vcan only.
+     */
+    std::atomic<uint64_t> wideIdsSent;
+
+    /** Written by the driver, which is the generator thread without vcan. */
+    std::atomic<uint64_t> received;
+    std::atomic<uint64_t> queued;
+    std::atomic<uint64_t> queuedMalformed;
+    std::atomic<uint64_t> queueDrops;
+    /** Frames with an ID wider than 29 bits the driver has queued. vcan only. */
+    uint64_t wideIdsInjected;
+
+    /**
+     * When each queued frame was pushed, in nanoseconds, indexed by its position in the queue.
+     * A slot is written before its frame is pushed, and read once the frame was popped.
+     */
+    int64_t arrivals[SOAK_ARRIVAL_RING_SIZE];
+} SoakContext_t;
+
+/**
+ * @brief The outcome of a phase.
+ */
+typedef struct PhaseResult_t {
+    const char *state;
+    double seconds;
+    /** Bus load actually offered, in percent. */
+    double offeredLoadPercent;
+    uint64_t sent;
+    uint64_t busRejected;
+    uint64_t busDrops;
+    uint64_t queueDrops;
+    uint64_t handled;
+    /** Frames the state machine rejected as malformed, or ignored as unknown. */
+    uint64_t malformed;
+    uint64_t unknown;
+    /** Malformed frames that were queued but not rejected, or valid frames that were rejected. */
+    uint64_t misclassified;
+    double dropRate;
+    /** Time from the frame being queued until the end of the cycle that handled it, in microseconds. */
+    double latencyP50Us;
+    double latencyP99Us;
+    double latencyP999Us;
+    double latencyMaxUs;
+    /** Duration of the state machine cycles, in microseconds. */
+    double cycleMeanUs;
+    double cycleMaxUs;
+    bool reachedState;
+} PhaseResult_t;
+
+/**
+ * @brief Prints the command line usage.
+ *
+ * @param program The name of the executable.
+ */
+static void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options]" << std::endl;
+    std::cerr << "  --bitrate <BPS>        Bus bitrate. Default: " << DEFAULT_BITRATE << std::endl;
+    std::cerr << "  --load <PERCENT>       Average bus load. Default: " << DEFAULT_LOAD_PERCENT << std::endl;
+    std::cerr << "  --burst <N>            Frames sent back to back at full bus speed. Default: " << DEFAULT_BURST
+              << std::endl;
+    std::cerr << "  --extended <FRACTION>  Fraction of frames with a 29-bit ID. Default: "
+              << DEFAULT_EXTENDED_FRACTION << std::endl;
+    std::cerr << "  --malformed <FRACTION> Fraction of malformed frames. Default: " << DEFAULT_MALFORMED_FRACTION
+              << std::endl;
+    std::cerr << "  --ids <DIST>           ID distribution: uniform or hot. Default: hot" << std::endl;
+    std::cerr << "  --state <STATE>        State to soak: idle, active or both. Default: both" << std::endl;
+    std::cerr << "  --duration-s <S>       Duration of each state. Default: " << DEFAULT_DURATION_S << std::endl;
+    std::cerr << "  --period-ms <MS>       Period of the state machine. Default: " << DEFAULT_PERIOD_MS << std::endl;
+    std::cerr << "  --seed <N>             Seed of the frame mix. Default: 1" << std::endl;
+    std::cerr << "  --vcan <IFACE>         Send through a SocketCAN interface, ie. vcan0, instead of the queue."
+              << std::endl;
+    std::cerr << "  --report <PATH>        Write the results to a JSON file." << std::endl;
+    std::cerr << "  --max-drop-rate <R>    Exit with 2 if a state drops more than this fraction of frames." << std::endl;
+    std::cerr << "  --max-p99-us <US>      Exit with 2 if a state's 99th percentile latency is above this." << std::endl;
+}
+
+/**
+ * @brief Retrieves the current time.
+ *
+ * @return int64_t The steady clock time, in nanoseconds.
+ */
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Computes how long a frame occupies the bus.
+ *
+ * @param frame The frame.
+ * @return uint32_t The length, in bits.
+ */
+static uint32_t frameBits(const CanFrame_t &frame) {
+    uint32_t header = frame.id > CAN_SFF_MASK ? SOAK_EXTENDED_FRAME_BITS : SOAK_STANDARD_FRAME_BITS;
+    return header + 8U * std::min<uint32_t>(frame.dlc, CAN_MESSAGE_LEN);
+}
+
+/**
+ * @brief Draws a frame from the mix.
+ *
+ * @param config The frame mix.
+ * @param generator The random generator.
+ * @param frame Overwritten with the frame.
+ * @return true If the frame is malformed.
+ */
+static bool drawFrame(const SoakConfig_t &config, std::mt19937 &generator, CanFrame_t &frame) {
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    bool extended = unit(generator) < config.extendedFraction;
+    bool malformed = unit(generator) < config.malformedFraction;
+    uint32_t range = extended ? CAN_EFF_MASK : CAN_SFF_MASK;
+
+    if (config.ids == SOAK_IDS_HOT && unit(generator) < SOAK_HOT_FRACTION) {
+        frame.id = 0x100U + (uint32_t)(generator() % SOAK_HOT_IDS);
+    } else {
+        frame.id = generator() % (range + 1U);
+    }
+    frame.dlc = (uint8_t)(generator() % (CAN_MESSAGE_LEN + 1));
+    for (uint8_t &byte : frame.data) {
+        byte = (uint8_t)generator();
+    }
+
+    /** Half of the malformed frames are too long, the other half have an ID wider than 29 bits. */
+    if (malformed) {
+        if (generator() % 2 == 0) {
+            frame.dlc = (uint8_t)(CAN_MESSAGE_LEN + 1 + generator() % 7);
+        } else {
+            frame.id = (CAN_MAX_EXTENDED_ID + 1U) | frame.id;
+        }
+    }
+
+    return malformed;
+}
+
+/**
+ * @brief Pushes a frame onto the reception queue, like the CAN driver, and records when.
+ * Only called by one thread.
+ *
+ * @param context The phase.
+ * @param frame The frame.
+ */
+static void deliver(SoakContext_t &context, const CanFrame_t &frame) {
+    uint64_t position = context.queued.load(std::memory_order_relaxed);
+    bool malformed = frame.dlc > CAN_MESSAGE_LEN || frame.id > CAN_MAX_EXTENDED_ID;
+
+    context.received.fetch_add(1, std::memory_order_relaxed);
+    context.arrivals[position & (SOAK_ARRIVAL_RING_SIZE - 1)] = nowNs();
+    if (context.hal->queueReceivedCanFrame(frame) == false) {
+        context.queueDrops.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    context.queued.store(position + 1, std::memory_order_relaxed);
+    if (malformed) {
+        context.queuedMalformed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Opens a raw socket on a SocketCAN interface.
+ *
+ * @param interface The interface.
+ * @return int The socket, or -1.
+ */
+static int openCanSocket(const char *interface) {
+    struct sockaddr_can address = {};
+    struct ifreq request = {};
+    struct timeval timeout = {0, SOAK_SOCKET_TIMEOUT_MS * 1000};
+
+    int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (fd < 0) {
+        return -1;
+    }
+
+    strncpy(request.ifr_name, interface, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFINDEX, &request) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    address.can_family = AF_CAN;
+    address.can_ifindex = request.ifr_ifindex;
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    return fd;
+}
+
+/**
+ * @brief Sends the frame mix until the phase ends, pacing each burst to keep the average bus load.
+ *
+ * @param context The phase.
+ * @param fd The socket to send through, or -1 to deliver onto the queue directly.
+ */
+static void generate(SoakContext_t *context, int fd) {
+    const SoakConfig_t &config = *context->config;
+    std::mt19937 generator(config.seed);
+    double nsPerBit = 1e9 / config.bitrate;
+    double nsPerLoadedBit = nsPerBit * 100.0 / config.loadPercent;
+    int64_t burstStart = nowNs();
+    CanFrame_t frame = {};
+    struct can_frame socketFrame = {};
+
+    while (context->running.load(std::memory_order_relaxed)) {
+        uint64_t burstBits = 0;
+
+        for (uint32_t i = 0; i < config.burst; i++) {
+            bool malformed = drawFrame(config, generator, frame);
+            uint32_t bits = frameBits(frame);
+
+            /** Frames within a burst follow each other at full bus speed. */
+            int64_t sendAt = burstStart + (int64_t)(burstBits * nsPerBit);
+            if (sendAt > nowNs()) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(sendAt - nowNs()));
+            }
+            burstBits += bits;
+
+            context->sent.fetch_add(1, std::memory_order_relaxed);
+            context->sentBits.fetch_add(bits, std::memory_order_relaxed);
+            if (malformed) {
+                context->sentMalformed.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            if (fd < 0) {
+                deliver(*context, frame);
+                continue;
+            }
+            if (frame.id > CAN_MAX_EXTENDED_ID) {
+                context->wideIdsSent.fetch_add(1, std::memory_order_release);
+                continue;
+            }
+
+            socketFrame.can_id = frame.id > CAN_SFF_MASK ? (frame.id | CAN_EFF_FLAG) : frame.id;
+            socketFrame.can_dlc = frame.dlc;
+            memcpy(socketFrame.data, frame.data, CAN_MESSAGE_LEN);
+            if (write(fd, &socketFrame, sizeof(socketFrame)) != (ssize_t)sizeof(socketFrame)) {
+                context->busRejected.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        /** The next burst starts once this one has used up its share of the load. */
+        burstStart += (int64_t)(burstBits * nsPerLoadedBit);
+        if (burstStart > nowNs()) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(burstStart - nowNs()));
+        }
+    }
+}
+
+/**
+ * @brief Reads frames from the socket onto the reception queue, like the CAN driver, until the phase ends.
+ * The frames with an ID wider than 29 bits can't go through the socket, so they are queued between reads,
+ * as a faulty driver would.
+ *
+ * @param context The phase.
+ * @param fd The socket.
+ */
+static void drive(SoakContext_t *context, int fd) {
+    std::mt19937 generator(context->config->seed);
+    struct can_frame socketFrame = {};
+    CanFrame_t frame = {};
+
+    while (context->running.load(std::memory_order_relaxed)) {
+        uint64_t wideIds = context->wideIdsSent.load(std::memory_order_acquire);
+        for (; context->wideIdsInjected < wideIds; context->wideIdsInjected++) {
+            frame.id = (CAN_MAX_EXTENDED_ID + 1U) | (generator() & CAN_EFF_MASK);
+            frame.dlc = (uint8_t)(generator() % (CAN_MESSAGE_LEN + 1));
+            deliver(*context, frame);
+        }
+
+        if (read(fd, &socketFrame, sizeof(socketFrame)) != (ssize_t)sizeof(socketFrame)) {
+            continue;
+        }
+
+        frame.id = socketFrame.can_id & ((socketFrame.can_id & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK);
+        frame.dlc = socketFrame.can_dlc;
+        memcpy(frame.data, socketFrame.data, CAN_MESSAGE_LEN);
+        deliver(*context, frame);
+    }
+}
+
+/**
+ * @brief Retrieves a percentile of sorted values.
+ *
+ * @param sorted The values, in ascending order.
+ * @param fraction The percentile, from 0 to 1.
+ * @return double The value, or 0 if there are none.
+ */
+static double percentile(const std::vector<double> &sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    return sorted[std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()))];
+}
+
+/**
+ * @brief Loads the state machine with the frame mix in a state, and measures how it copes.
+ *
+ * The state machine runs on the calling thread at its period. After each cycle, the frames
+ * it popped are matched with their arrival times, since the reception queue is a FIFO.
+ *
+ * @param config The load and frame mix.
+ * @param state The state to soak, STATE_IDLE or STATE_ACTIVE.
+ * @param result Overwritten with the results.
+ * @return true If the phase ran.
+ */
+static bool runPhase(const SoakConfig_t &config, FsmStates_e state, PhaseResult_t &result) {
+    PlcInputs_t inputs = {};
+    MetricsManager metrics;
+    HardwareManager hal = HardwareManager(&metrics);
+    Parameters_t params = {SOAK_MIN_VOLTAGE, SOAK_SETPOINT_C};
+    ControlManager controller(SOAK_SETPOINT_C, {CONTROLLER_DEFAULT_KP, CONTROLLER_DEFAULT_KI, CONTROLLER_DEFAULT_KD},
+                              config.periodMs / 1000.0f);
+    StateManager fsm(params, &hal, &controller, &metrics);
+    std::unique_ptr<SoakContext_t> context(new SoakContext_t());
+    std::vector<double> latencies;
+    CanFrame_t frame = {};
+    int txSocket = -1;
+    int rxSocket = -1;
+
+    result = {};
+    result.state = state == STATE_ACTIVE ? "active" : "idle";
+    context->config = &config;
+    context->hal = &hal;
+
+    if (config.interface != nullptr) {
+        txSocket = openCanSocket(config.interface);
+        rxSocket = openCanSocket(config.interface);
+        if (txSocket < 0 || rxSocket < 0) {
+            std::cerr << "Failed to open " << config.interface << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+
+    /** Bring the state machine to the state before loading it. */
+    if (state == STATE_ACTIVE) {
+        inputs.ignitionClosed = true;
+        inputs.levelSwitchClosed = true;
+        inputs.supplyVoltage = SOAK_SUPPLY_VOLTAGE;
+        inputs.temperature = SOAK_SETPOINT_C + 5.0f;
+    }
+    hal.setInputs(inputs);
+    fsm.initialize();
+    for (int i = 0; i < 10 && fsm.getState() != state; i++) {
+        fsm.handleCurrentState();
+    }
+    result.reachedState = fsm.getState() == state;
+
+    const std::chrono::milliseconds period(config.periodMs);
+    int64_t durationNs = (int64_t)(config.durationS * 1e9);
+    latencies.reserve((size_t)(config.durationS * config.bitrate / SOAK_STANDARD_FRAME_BITS) + 1);
+    double totalCycleNs = 0.0;
+    double maxCycleNs = 0.0;
+    uint64_t cycles = 0;
+    uint64_t handled = 0;
+
+    context->running = true;
+    std::thread driver;
+    if (rxSocket >= 0) {
+        driver = std::thread(drive, context.get(), rxSocket);
+    }
+    std::thread generatorThread(generate, context.get(), txSocket);
+
+    int64_t start = nowNs();
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + period;
+    bool loading = true;
+    int drainCycles = 2;
+    while (loading || drainCycles-- > 0) {
+        int64_t cycleStart = nowNs();
+        fsm.handleCurrentState();
+        int64_t cycleEnd = nowNs();
+
+        totalCycleNs += (double)(cycleEnd - cycleStart);
+        maxCycleNs = std::max(maxCycleNs, (double)(cycleEnd - cycleStart));
+        cycles++;
+
+        /** The frames popped in this cycle are the next ones in arrival order. */
+        uint64_t popped = metrics.getCount(METRIC_CAN_RX_FRAMES);
+        for (; handled < popped; handled++) {
+            int64_t arrival = context->arrivals[handled & (SOAK_ARRIVAL_RING_SIZE - 1)];
+            latencies.push_back((cycleEnd - arrival) / 1000.0);
+        }
+
+        while (hal.popTransmitCanFrame(frame)) {
+        }
+
+        /** Stop loading at the end of the phase, then drain the frames still in flight. */
+        if (loading && cycleEnd - start >= durationNs) {
+            context->running = false;
+            generatorThread.join();
+            if (driver.joinable()) {
+                driver.join();
+            }
+            result.seconds = (nowNs() - start) / 1e9;
+            loading = false;
+        }
+
+        std::this_thread::sleep_until(deadline);
+        deadline += period;
+    }
+
+    if (txSocket >= 0) {
+        close(txSocket);
+    }
+    if (rxSocket >= 0) {
+        close(rxSocket);
+    }
+
+    /** Summarize. */
+    std::sort(latencies.begin(), latencies.end());
+    result.sent = context->sent;
+    result.busRejected = context->busRejected;
+    result.busDrops = config.interface != nullptr ? result.sent - result.busRejected - context->received : 0;
+    result.queueDrops = context->queueDrops;
+    result.handled = handled;
+    result.malformed = metrics.getCount(METRIC_CAN_RX_MALFORMED);
+    result.unknown = metrics.getCount(METRIC_CAN_RX_UNKNOWN);
+    uint64_t queuedValid = context->queued - context->queuedMalformed;
+    result.misclassified = (result.malformed > context->queuedMalformed ? result.malformed - context->queuedMalformed
+                                                                        : context->queuedMalformed - result.malformed) +
+                           (result.unknown > queuedValid ? result.unknown - queuedValid : queuedValid - result.unknown);
+    uint64_t offered = result.sent - result.busRejected;
+    result.dropRate = offered > 0 ? (double)(result.busDrops + result.queueDrops) / offered : 0.0;
+    result.offeredLoadPercent = result.seconds > 0 ? 100.0 * context->sentBits / (config.bitrate * result.seconds) : 0;
+    result.latencyP50Us = percentile(latencies, 0.5);
+    result.latencyP99Us = percentile(latencies, 0.99);
+    result.latencyP999Us = percentile(latencies, 0.999);
+    result.latencyMaxUs = latencies.empty() ? 0.0 : latencies.back();
+    result.cycleMeanUs = cycles > 0 ? totalCycleNs / cycles / 1000.0 : 0.0;
+    result.cycleMaxUs = maxCycleNs / 1000.0;
+
+    return true;
+}
+
+/**
+ * @brief Prints the results of a phase.
+ *
+ * @param result The results.
+ */
+static void printResult(const PhaseResult_t &result) {
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << result.state << ": " << result.sent << " frames in " << result.seconds << " s at "
+              << result.offeredLoadPercent << "% load, " << result.handled << " handled ("
+              << result.malformed << " malformed, " << result.unknown << " unknown)" << std::endl;
+    std::cout << std::setprecision(4) << "  drop rate " << result.dropRate << " (" << result.queueDrops
+              << " queue, " << result.busDrops << " bus, " << result.busRejected << " refused by the socket), "
+              << result.misclassified << " misclassified" << std::endl;
+    std::cout << std::setprecision(1) << "  latency p50 " << result.latencyP50Us << " us, p99 "
+              << result.latencyP99Us << " us, p99.9 " << result.latencyP999Us << " us, max "
+              << result.latencyMaxUs << " us" << std::endl;
+    std::cout << "  cycle mean " << result.cycleMeanUs << " us, max " << result.cycleMaxUs << " us" << std::endl;
+    if (result.reachedState == false) {
+        std::cout << "  The state machine didn't reach the state." << std::endl;
+    }
+}
+
+/**
+ * @brief Writes the configuration and the results of every phase to a JSON file.
+ *
+ * @param path The file.
+ * @param config The load and frame mix.
+ * @param results The results.
+ * @return true If the file was written.
+ */
+static bool writeReport(const char *path, const SoakConfig_t &config, const std::vector<PhaseResult_t> &results) {
+    std::ofstream report(path);
+
+    report << std::fixed << std::setprecision(3);
+    report << "{" << std::endl;
+    report << "  \"transport\": \"" << (config.interface != nullptr ? config.interface : "queue") << "\"," << std::endl;
+    report << "  \"bitrate\": " << config.bitrate << "," << std::endl;
+    report << "  \"load_percent\": " << config.loadPercent << "," << std::endl;
+    report << "  \"burst\": " << config.burst << "," << std::endl;
+    report << "  \"extended_fraction\": " << config.extendedFraction << "," << std::endl;
+    report << "  \"malformed_fraction\": " << config.malformedFraction << "," << std::endl;
+    report << "  \"ids\": \"" << (config.ids == SOAK_IDS_HOT ? "hot" : "uniform") << "\"," << std::endl;
+    report << "  \"period_ms\": " << config.periodMs << "," << std::endl;
+    report << "  \"seed\": " << config.seed << "," << std::endl;
+    report << "  \"states\": [" << std::endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const PhaseResult_t &result = results[i];
+        report << "    {\"state\": \"" << result.state << "\", \"seconds\": " << result.seconds
+               << ", \"offered_load_percent\": " << result.offeredLoadPercent << ", \"sent\": " << result.sent
+               << ", \"handled\": " << result.handled << ", \"malformed\": " << result.malformed
+               << ", \"unknown\": " << result.unknown << ", \"misclassified\": " << result.misclassified
+               << ", \"queue_drops\": " << result.queueDrops << ", \"bus_drops\": " << result.busDrops
+               << ", \"bus_rejected\": " << result.busRejected << ", \"drop_rate\": " << result.dropRate
+               << ", \"latency_p50_us\": " << result.latencyP50Us << ", \"latency_p99_us\": " << result.latencyP99Us
+               << ", \"latency_p999_us\": " << result.latencyP999Us << ", \"latency_max_us\": "
+               << result.latencyMaxUs << ", \"cycle_mean_us\": " << result.cycleMeanUs << ", \"cycle_max_us\": "
+               << result.cycleMaxUs << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    report << "  ]" << std::endl;
+    report << "}" << std::endl;
+
+    return report.good();
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option longOptions[] = {
+        {"bitrate", required_argument, nullptr, 'b'},
+        {"load", required_argument, nullptr, 'l'},
+        {"burst", required_argument, nullptr, 'B'},
+        {"extended", required_argument, nullptr, 'e'},
+        {"malformed", required_argument, nullptr, 'm'},
+        {"ids", required_argument, nullptr, 'i'},
+        {"state", required_argument, nullptr, 'S'},
+        {"duration-s", required_argument, nullptr, 'd'},
+        {"period-ms", required_argument, nullptr, 'P'},
+        {"seed", required_argument, nullptr, 's'},
+        {"vcan", required_argument, nullptr, 'v'},
+        {"report", required_argument, nullptr, 'r'},
+        {"max-drop-rate", required_argument, nullptr, 'D'},
+        {"max-p99-us", required_argument, nullptr, 'L'},
+        {nullptr, 0, nullptr, 0},
+    };
+    SoakConfig_t config = {DEFAULT_BITRATE, DEFAULT_LOAD_PERCENT, DEFAULT_BURST, DEFAULT_EXTENDED_FRACTION,
+                           DEFAULT_MALFORMED_FRACTION, SOAK_IDS_HOT, DEFAULT_DURATION_S, DEFAULT_PERIOD_MS, 1, nullptr};
+    bool soakIdle = true;
+    bool soakActive = true;
+    const char *reportPath = nullptr;
+    double maxDropRate = -1.0;
+    double maxP99Us = -1.0;
+    int option = 0;
+
+    /** Parse the options. */
+    while ((option = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (option) {
+            case 'b':
+                config.bitrate = (uint32_t)strtoul(optarg, nullptr, 0);
+                break;
+            case 'l':
+                config.loadPercent = atof(optarg);
+                break;
+            case 'B':
+                config.burst = (uint32_t)strtoul(optarg, nullptr, 0);
+                break;
+            case 'e':
+                config.extendedFraction = atof(optarg);
+                break;
+            case 'm':
+                config.malformedFraction = atof(optarg);
+                break;
+            case 'i':
+                if (strcmp(optarg, "uniform") == 0) {
+                    config.ids = SOAK_IDS_UNIFORM;
+                } else if (strcmp(optarg, "hot") != 0) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'S':
+                soakIdle = strcmp(optarg, "idle") == 0 || strcmp(optarg, "both") == 0;
+                soakActive = strcmp(optarg, "active") == 0 || strcmp(optarg, "both") == 0;
+                break;
+            case 'd':
+                config.durationS = atof(optarg);
+                break;
+            case 'P':
+                config.periodMs = atoi(optarg);
+                break;
+            case 's':
+                config.seed = (unsigned)strtoul(optarg, nullptr, 0);
+                break;
+            case 'v':
+                config.interface = optarg;
+                break;
+            case 'r':
+                reportPath = optarg;
+                break;
+            case 'D':
+                maxDropRate = atof(optarg);
+                break;
+            case 'L':
+                maxP99Us = atof(optarg);
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (config.bitrate == 0 || config.loadPercent <= 0.0 || config.burst == 0 || config.durationS <= 0.0 ||
+        config.periodMs <= 0 || (soakIdle == false && soakActive == false)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    /** Run the phases. */
+    std::vector<PhaseResult_t> results;
+    PhaseResult_t result = {};
+    if (soakIdle) {
+        if (runPhase(config, STATE_IDLE, result) == false) {
+            return 1;
+        }
+        results.push_back(result);
+        printResult(result);
+    }
+    if (soakActive) {
+        if (runPhase(config, STATE_ACTIVE, result) == false) {
+            return 1;
+        }
+        results.push_back(result);
+        printResult(result);
+    }
+
+    if (reportPath != nullptr && writeReport(reportPath, config, results) == false) {
+        std::cerr << "Failed to write " << reportPath << std::endl;
+        return 1;
+    }
+
+    /** Fail the run if a threshold was crossed, so that it can gate a regression check. */
+    bool passed = true;
+    for (const PhaseResult_t &phase : results) {
+        if (phase.reachedState == false || phase.misclassified > 0 ||
+            (maxDropRate >= 0.0 && phase.dropRate > maxDropRate) ||
+            (maxP99Us >= 0.0 && phase.latencyP99Us > maxP99Us)) {
+            std::cout << phase.state << " failed the thresholds." << std::endl;
+            passed = false;
+        }
+    }
+
+    return passed ? 0 : 2;
+}
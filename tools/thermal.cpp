@@ -0,0 +1,97 @@
+#include "thermal.h"
+
+/**
+ * @brief Constructor.
+ *
+ * @param params The model parameters.
+ * @param temperature The initial temperature of the coolant and the sensor, in degrees.
+ */
+ThermalModel::ThermalModel(ThermalParameters_t params, float temperature)
+    : params(params), temperature(temperature), sensedTemperature(temperature), energyJ(0.0f) {}
+
+/**
+ * @brief Advances the model with an explicit Euler step.
+ * The time step must be well below the sensor's and the loop's time constants.
+ *
+ * @param fanDuty The fan duty cycle, from 0 to 1.
+ * @param pumpDuty The pump duty cycle, from 0 to 1.
+ * @param periodS The time step, in seconds.
+ */
+void ThermalModel::step(float fanDuty, float pumpDuty, float periodS) {
+    float rejectedW = getHeatTransferWPerK(params, fanDuty, pumpDuty) * (temperature - params.ambientC);
+
+    temperature += (params.loadW - rejectedW) / params.capacityJPerK * periodS;
+    sensedTemperature += (temperature - sensedTemperature) * periodS / (params.sensorTauS + periodS);
+    energyJ += getElectricalPowerW(params, fanDuty, pumpDuty) * periodS;
+}
+
+/**
+ * @brief Retrieves the coolant temperature.
+ *
+ * @return float The temperature, in degrees.
+ */
+float ThermalModel::getTemperature() {
+    return temperature;
+}
+
+/**
+ * @brief Retrieves the temperature read by the sensor.
+ *
+ * @return float The temperature, in degrees.
+ */
+float ThermalModel::getSensedTemperature() {
+    return sensedTemperature;
+}
+
+/**
+ * @brief Retrieves the electrical energy used by the pump and the fan since construction.
+ *
+ * @return float The energy, in J.
+ */
+float ThermalModel::getEnergyJ() {
+    return energyJ;
+}
+
+/**
+ * @brief Retrieves the parameters of the nominal coolant loop.
+ *
+ * @return ThermalParameters_t The parameters.
+ */
+ThermalParameters_t ThermalModel::getNominalParameters() {
+    ThermalParameters_t params = {};
+
+    params.capacityJPerK = THERMAL_NOMINAL_CAPACITY_J_PER_K;
+    params.loadW = THERMAL_NOMINAL_LOAD_W;
+    params.ambientC = THERMAL_NOMINAL_AMBIENT_C;
+    params.naturalUaWPerK = THERMAL_NOMINAL_NATURAL_UA_W_PER_K;
+    params.forcedUaWPerK = THERMAL_NOMINAL_FORCED_UA_W_PER_K;
+    params.sensorTauS = THERMAL_NOMINAL_SENSOR_TAU_S;
+    params.fanRatedW = RADIATOR_FAN_RATED_W;
+    params.pumpRatedW = RADIATOR_PUMP_RATED_W;
+
+    return params;
+}
+
+/**
+ * @brief Computes the electrical power of the pump and the fan.
+ *
+ * @param params The model parameters.
+ * @param fanDuty The fan duty cycle, from 0 to 1.
+ * @param pumpDuty The pump duty cycle, from 0 to 1.
+ * @return float The power, in W.
+ */
+float ThermalModel::getElectricalPowerW(const ThermalParameters_t &params, float fanDuty, float pumpDuty) {
+    return RadiatorModel::getElectricalPowerW(params.fanRatedW, params.pumpRatedW, fanDuty, pumpDuty);
+}
+
+/**
+ * @brief Computes the radiator's heat transfer.
+ *
+ * @param params The model parameters.
+ * @param fanDuty The fan duty cycle, from 0 to 1.
+ * @param pumpDuty The pump duty cycle, from 0 to 1.
+ * @return float The heat transfer, in W/K.
+ */
+float ThermalModel::getHeatTransferWPerK(const ThermalParameters_t &params, float fanDuty, float pumpDuty) {
+    return params.naturalUaWPerK + params.forcedUaWPerK * RadiatorModel::getHeatTransfer(fanDuty, pumpDuty);
+}
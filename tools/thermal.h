@@ -0,0 +1,117 @@
+#ifndef THERMAL_H
+#define THERMAL_H
+
+#include "radiator.h"
+
+/** The nominal coolant loop, shared by the tools. */
+#define THERMAL_NOMINAL_CAPACITY_J_PER_K 20000.0f
+#define THERMAL_NOMINAL_LOAD_W 3000.0f
+#define THERMAL_NOMINAL_AMBIENT_C 25.0f
+#define THERMAL_NOMINAL_NATURAL_UA_W_PER_K 10.0f
+#define THERMAL_NOMINAL_FORCED_UA_W_PER_K 250.0f
+#define THERMAL_NOMINAL_SENSOR_TAU_S 2.0f
+
+/**
+ * @brief The parameters of the coolant loop model.
+ */
+typedef struct ThermalParameters_t {
+    /** Heat capacity of the coolant and the cooled equipment, in J/K. */
+    float capacityJPerK;
+    /** Heat dissipated by the cooled equipment, in W. */
+    float loadW;
+    /** Temperature of the air going through the radiator, in degrees. */
+    float ambientC;
+    /** Heat transfer to the ambient air with the pump and the fan off, in W/K. */
+    float naturalUaWPerK;
+    /** Additional heat transfer with the pump and the fan at full duty, in W/K. */
+    float forcedUaWPerK;
+    /** Time constant of the temperature sensor, in seconds. */
+    float sensorTauS;
+    /** Electrical power of the fan at full duty, in W. */
+    float fanRatedW;
+    /** Electrical power of the pump at full duty, in W. */
+    float pumpRatedW;
+} ThermalParameters_t;
+
+/**
+ * @brief A lumped model of the coolant loop: one heat capacity, heated by the load
+ * and cooled through the radiator, read by a lagging temperature sensor.
+ *
+ * The radiator's heat transfer and the pump's and fan's electrical power follow
+ * the RadiatorModel the controller allocates the cooling demand with.
+ */
+class ThermalModel {
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param params The model parameters.
+     * @param temperature The initial temperature of the coolant and the sensor, in degrees.
+     */
+    ThermalModel(ThermalParameters_t params, float temperature);
+
+    /**
+     * @brief Advances the model.
+     *
+     * @param fanDuty The fan duty cycle, from 0 to 1.
+     * @param pumpDuty The pump duty cycle, from 0 to 1.
+     * @param periodS The time step, in seconds.
+     */
+    void step(float fanDuty, float pumpDuty, float periodS);
+
+    /**
+     * @brief Retrieves the coolant temperature.
+     *
+     * @return float The temperature, in degrees.
+     */
+    float getTemperature();
+
+    /**
+     * @brief Retrieves the temperature read by the sensor.
+     *
+     * @return float The temperature, in degrees.
+     */
+    float getSensedTemperature();
+
+    /**
+     * @brief Retrieves the electrical energy used by the pump and the fan since construction.
+     *
+     * @return float The energy, in J.
+     */
+    float getEnergyJ();
+
+    /**
+     * @brief Retrieves the parameters of the nominal coolant loop.
+     *
+     * @return ThermalParameters_t The parameters.
+     */
+    static ThermalParameters_t getNominalParameters();
+
+    /**
+     * @brief Computes the electrical power of the pump and the fan.
+     *
+     * @param params The model parameters.
+     * @param fanDuty The fan duty cycle, from 0 to 1.
+     * @param pumpDuty The pump duty cycle, from 0 to 1.
+     * @return float The power, in W.
+     */
+    static float getElectricalPowerW(const ThermalParameters_t &params, float fanDuty, float pumpDuty);
+
+    /**
+     * @brief Computes the radiator's heat transfer.
+     *
+     * @param params The model parameters.
+     * @param fanDuty The fan duty cycle, from 0 to 1.
+     * @param pumpDuty The pump duty cycle, from 0 to 1.
+     * @return float The heat transfer, in W/K.
+     */
+    static float getHeatTransferWPerK(const ThermalParameters_t &params, float fanDuty, float pumpDuty);
+
+private:
+    ThermalParameters_t params;
+    float temperature;
+    float sensedTemperature;
+    float energyJ;
+};
+
+#endif
@@ -0,0 +1,438 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "fsm.h"
+#include "hal.h"
+#include "controller.h"
+#include "tripwire.h"
+#include "thermal.h"
+#include "pool.h"
+
+/** Default number of random gain candidates, besides the default gains. */
+#define DEFAULT_CANDIDATES 200
+
+/** Default number of random plants each candidate is simulated against. */
+#define DEFAULT_PLANTS 8
+
+/** Default simulation settings. */
+#define DEFAULT_SETPOINT_C 60.0f
+#define DEFAULT_BAND_C 1.0f
+#define DEFAULT_DURATION_S 1200.0f
+#define DEFAULT_PERIOD_MS 10
+
+/** Default number of candidates printed. */
+#define DEFAULT_TOP 10
+
+/** Supply voltage of the simulated PLC, and the minimum the state machine accepts. */
+#define TUNER_SUPPLY_VOLTAGE 24.0f
+#define TUNER_MIN_VOLTAGE 20.0f
+
+/** Ranges the gains are drawn from. The proportional and integral gains are drawn on a log scale. */
+#define TUNER_KP_MIN 0.5f
+#define TUNER_KP_MAX 50.0f
+#define TUNER_KI_MIN 0.01f
+#define TUNER_KI_MAX 5.0f
+#define TUNER_KD_MAX 20.0f
+
+/** Spread of the random plants around the nominal plant, relative, and of the ambient temperature, in degrees. */
+#define TUNER_SPREAD 0.3f
+#define TUNER_AMBIENT_SPREAD_C 10.0f
+
+/** Seconds of settling time that one degree of overshoot is worth, when ranking. */
+#define TUNER_OVERSHOOT_WEIGHT_S_PER_C 10.0f
+
+/**
+ * @brief The settings shared by every simulation.
+ */
+typedef struct TunerConfig_t {
+    /** The temperature setpoint, in degrees. */
+    float setpointC;
+    /** The temperature is settled once it stays this close to the setpoint, in degrees. */
+    float bandC;
+    /** The simulated time, in seconds. */
+    float durationS;
+    /** The period of the state machine, in seconds. */
+    float periodS;
+    /** How the controller splits the cooling demand between the fan and the pump. */
+    AllocationMode_e allocation;
+} TunerConfig_t;
+
+/**
+ * @brief The outcome of one closed-loop simulation.
+ */
+typedef struct SimulationResult_t {
+    /** Time from first reaching the setpoint until the temperature stayed in the band, in seconds. */
+    float settlingS;
+    /** Highest temperature above the setpoint, in degrees. */
+    float overshootC;
+    /** Electrical energy used by the pump and the fan, in J. */
+    float energyJ;
+    /** Whether the temperature was in the band at the end of the simulation. */
+    bool settled;
+} SimulationResult_t;
+
+/**
+ * @brief The results of a candidate, over every plant.
+ */
+typedef struct CandidateSummary_t {
+    /** Index of the candidate. */
+    size_t candidate;
+    /** Number of plants that didn't settle. */
+    size_t unsettled;
+    float meanSettlingS;
+    float worstSettlingS;
+    float worstOvershootC;
+    float meanEnergyJ;
+    /** Ranking cost, lower is better. */
+    float cost;
+} CandidateSummary_t;
+
+/**
+ * @brief Everything a simulation task reads and writes. Set up before the pool starts,
+ * so the tasks themselves don't allocate.
+ */
+typedef struct TunerContext_t {
+    const TunerConfig_t *config;
+    const PidGains_t *candidates;
+    const ThermalParameters_t *plants;
+    size_t plantCount;
+    SimulationResult_t *results;
+    /** One HAL per worker, reused by every simulation on that worker. */
+    HardwareManager *hals;
+    /** Allocations made in state machine cycles, per worker. */
+    uint64_t allocations[POOL_MAX_WORKERS];
+} TunerContext_t;
+
+/**
+ * @brief Prints the command line usage.
+ *
+ * @param program The name of the executable.
+ */
+static void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options]" << std::endl;
+    std::cerr << "  --candidates <N>  Random gain candidates. Default: " << DEFAULT_CANDIDATES << std::endl;
+    std::cerr << "  --plants <N>      Random plants per candidate. Default: " << DEFAULT_PLANTS << std::endl;
+    std::cerr << "  --threads <N>     Worker threads. Default: the number of CPUs." << std::endl;
+    std::cerr << "  --seed <N>        Seed of the candidates and plants. Default: 1" << std::endl;
+    std::cerr << "  --setpoint <C>    Temperature setpoint. Default: " << DEFAULT_SETPOINT_C << std::endl;
+    std::cerr << "  --band <C>        Settling band around the setpoint. Default: " << DEFAULT_BAND_C << std::endl;
+    std::cerr << "  --duration-s <S>  Simulated time. Default: " << DEFAULT_DURATION_S << std::endl;
+    std::cerr << "  --period-ms <MS>  Period of the state machine. Default: " << DEFAULT_PERIOD_MS << std::endl;
+    std::cerr << "  --allocation <MODE> How cooling is split between the fan and the pump: equal or optimal. "
+              << "Default: equal" << std::endl;
+    std::cerr << "  --top <N>         Candidates printed. Default: " << DEFAULT_TOP << std::endl;
+    std::cerr << "  --csv <PATH>      Write the results of every candidate to a CSV file." << std::endl;
+}
+
+/**
+ * @brief Draws a value on a log scale.
+ *
+ * @param generator The random generator.
+ * @param min The lowest value.
+ * @param max The highest value.
+ * @return float The value.
+ */
+static float drawLog(std::mt19937 &generator, float min, float max) {
+    std::uniform_real_distribution<float> distribution(std::log(min), std::log(max));
+    return std::exp(distribution(generator));
+}
+
+/**
+ * @brief Draws a value around a nominal value.
+ *
+ * @param generator The random generator.
+ * @param nominal The nominal value.
+ * @param spread The relative spread around the nominal value.
+ * @return float The value.
+ */
+static float drawAround(std::mt19937 &generator, float nominal, float spread) {
+    std::uniform_real_distribution<float> distribution(1.0f - spread, 1.0f + spread);
+    return nominal * distribution(generator);
+}
+
+/**
+ * @brief Runs one closed-loop simulation of the state machine and the controller against the thermal model.
+ *
+ * The task index selects the candidate and the plant. The simulation starts from a cold plant
+ * at ambient temperature with the ignition on, and uses the true coolant temperature for the results.
+ * Settling is timed from when the setpoint is first reached, since the warm-up only depends on the plant.
+ *
+ * @param index The task index.
+ * @param worker The worker running the task.
+ * @param context The TunerContext_t.
+ */
+static void simulate(size_t index, unsigned worker, void *context) {
+    TunerContext_t *tuner = (TunerContext_t *)context;
+    const TunerConfig_t &config = *tuner->config;
+    const ThermalParameters_t &plant = tuner->plants[index % tuner->plantCount];
+    SimulationResult_t &result = tuner->results[index];
+    HardwareManager &hal = tuner->hals[worker];
+    uint64_t allocations = AllocationTripwire::getCount();
+    long steps = (long)(config.durationS / config.periodS);
+    PlcInputs_t inputs = {};
+    PlcOutputs_t outputs = {};
+    CanFrame_t frame = {};
+
+    Parameters_t params = {TUNER_MIN_VOLTAGE, config.setpointC};
+    ControlManager controller(config.setpointC, tuner->candidates[index / tuner->plantCount], config.periodS,
+                              config.allocation);
+    StateManager fsm(params, &hal, &controller);
+    ThermalModel model(plant, plant.ambientC);
+
+    /** The last simulation on this worker may have left the equipment on. */
+    hal.setOutputs(outputs);
+    fsm.initialize();
+
+    inputs.supplyVoltage = TUNER_SUPPLY_VOLTAGE;
+    inputs.ignitionClosed = true;
+    inputs.levelSwitchClosed = true;
+
+    result = {};
+    float reachedS = -1.0f;
+    float lastOutsideS = 0.0f;
+    for (long i = 0; i < steps; i++) {
+        inputs.temperature = model.getSensedTemperature();
+        hal.setInputs(inputs);
+        fsm.handleCurrentState();
+        hal.retrieveOutputs(outputs);
+
+        /** Stand in for the CAN driver. */
+        while (hal.popTransmitCanFrame(frame)) {}
+
+        model.step(outputs.fanEnable ? outputs.fanPowerPercent / 100.0f : 0.0f,
+                   outputs.pumpEnable ? outputs.pumpPowerPercent / 100.0f : 0.0f, config.periodS);
+
+        float error = model.getTemperature() - config.setpointC;
+        if (error >= 0.0f && reachedS < 0.0f) {
+            reachedS = (i + 1) * config.periodS;
+        }
+        if (error > result.overshootC) {
+            result.overshootC = error;
+        }
+        if (std::fabs(error) > config.bandC) {
+            lastOutsideS = (i + 1) * config.periodS;
+        }
+    }
+
+    result.settled = reachedS >= 0.0f && lastOutsideS < steps * config.periodS;
+    result.settlingS = reachedS >= 0.0f ? std::max(lastOutsideS - reachedS, 0.0f) : config.durationS;
+    result.energyJ = model.getEnergyJ();
+    tuner->allocations[worker] += AllocationTripwire::getCount() - allocations;
+}
+
+/**
+ * @brief Sums up the results of a candidate over every plant.
+ *
+ * @param candidate The candidate.
+ * @param results The results of the candidate, one per plant.
+ * @param plantCount The number of plants.
+ * @param summary Overwritten with the summary.
+ */
+static void summarize(size_t candidate, const SimulationResult_t *results, size_t plantCount,
+                      CandidateSummary_t &summary) {
+    summary = {};
+    summary.candidate = candidate;
+
+    for (size_t i = 0; i < plantCount; i++) {
+        summary.unsettled += results[i].settled ? 0 : 1;
+        summary.meanSettlingS += results[i].settlingS / plantCount;
+        summary.worstSettlingS = std::max(summary.worstSettlingS, results[i].settlingS);
+        summary.worstOvershootC = std::max(summary.worstOvershootC, results[i].overshootC);
+        summary.meanEnergyJ += results[i].energyJ / plantCount;
+    }
+
+    summary.cost = summary.worstSettlingS + TUNER_OVERSHOOT_WEIGHT_S_PER_C * summary.worstOvershootC;
+}
+
+/**
+ * @brief Prints a candidate's summary as a table row.
+ *
+ * @param summary The summary.
+ * @param gains The candidate's gains.
+ */
+static void printSummary(const CandidateSummary_t &summary, const PidGains_t &gains) {
+    std::cout << std::setw(8) << gains.kp << std::setw(8) << gains.ki << std::setw(8) << gains.kd
+              << std::setw(10) << summary.meanSettlingS << std::setw(10) << summary.worstSettlingS
+              << std::setw(10) << summary.worstOvershootC << std::setw(10) << summary.meanEnergyJ / 1000.0f
+              << std::setw(10) << summary.unsettled << std::endl;
+}
+
+/**
+ * @brief Sweeps random PID gains against random plants, and ranks them
+ * by settling time, overshoot and pump/fan energy.
+ */
+int main(int argc, char *argv[]) {
+    static const struct option longOptions[] = {
+        {"candidates", required_argument, nullptr, 'c'},
+        {"plants", required_argument, nullptr, 'p'},
+        {"threads", required_argument, nullptr, 't'},
+        {"seed", required_argument, nullptr, 's'},
+        {"setpoint", required_argument, nullptr, 'S'},
+        {"band", required_argument, nullptr, 'b'},
+        {"duration-s", required_argument, nullptr, 'd'},
+        {"period-ms", required_argument, nullptr, 'P'},
+        {"allocation", required_argument, nullptr, 'a'},
+        {"top", required_argument, nullptr, 'n'},
+        {"csv", required_argument, nullptr, 'o'},
+        {nullptr, 0, nullptr, 0},
+    };
+    long candidateCount = DEFAULT_CANDIDATES;
+    long plantCount = DEFAULT_PLANTS;
+    long threads = std::thread::hardware_concurrency();
+    unsigned seed = 1;
+    int periodMs = DEFAULT_PERIOD_MS;
+    long top = DEFAULT_TOP;
+    const char *csvPath = nullptr;
+    TunerConfig_t config = {DEFAULT_SETPOINT_C, DEFAULT_BAND_C, DEFAULT_DURATION_S, 0.0f, ALLOCATION_EQUAL};
+    int option = 0;
+
+    /** Parse the options. */
+    while ((option = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (option) {
+            case 'c':
+                candidateCount = atol(optarg);
+                break;
+            case 'p':
+                plantCount = atol(optarg);
+                break;
+            case 't':
+                threads = atol(optarg);
+                break;
+            case 's':
+                seed = (unsigned)strtoul(optarg, nullptr, 0);
+                break;
+            case 'S':
+                config.setpointC = atof(optarg);
+                break;
+            case 'b':
+                config.bandC = atof(optarg);
+                break;
+            case 'd':
+                config.durationS = atof(optarg);
+                break;
+            case 'P':
+                periodMs = atoi(optarg);
+                break;
+            case 'a':
+                if (strcmp(optarg, "optimal") == 0) {
+                    config.allocation = ALLOCATION_OPTIMAL;
+                } else if (strcmp(optarg, "equal") != 0) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'n':
+                top = atol(optarg);
+                break;
+            case 'o':
+                csvPath = optarg;
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (candidateCount < 0 || plantCount <= 0 || threads <= 0 || config.bandC <= 0.0f ||
+        config.durationS <= 0.0f || periodMs <= 0 || top < 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    config.periodS = periodMs / 1000.0f;
+
+    /** Draw the candidates. The first one is the default gains, as a baseline. */
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> kdDistribution(0.0f, TUNER_KD_MAX);
+    std::vector<PidGains_t> candidates(candidateCount + 1);
+    candidates[0] = {CONTROLLER_DEFAULT_KP, CONTROLLER_DEFAULT_KI, CONTROLLER_DEFAULT_KD};
+    for (size_t i = 1; i < candidates.size(); i++) {
+        candidates[i].kp = drawLog(generator, TUNER_KP_MIN, TUNER_KP_MAX);
+        candidates[i].ki = drawLog(generator, TUNER_KI_MIN, TUNER_KI_MAX);
+        candidates[i].kd = kdDistribution(generator);
+    }
+
+    /** Draw the plants. Every candidate runs against the same ones. */
+    const ThermalParameters_t nominal = ThermalModel::getNominalParameters();
+    std::uniform_real_distribution<float> ambientDistribution(nominal.ambientC - TUNER_AMBIENT_SPREAD_C,
+                                                              nominal.ambientC + TUNER_AMBIENT_SPREAD_C);
+    std::vector<ThermalParameters_t> plants(plantCount, nominal);
+    for (ThermalParameters_t &plant : plants) {
+        plant.capacityJPerK = drawAround(generator, nominal.capacityJPerK, TUNER_SPREAD);
+        plant.loadW = drawAround(generator, nominal.loadW, TUNER_SPREAD);
+        plant.ambientC = ambientDistribution(generator);
+        plant.naturalUaWPerK = drawAround(generator, nominal.naturalUaWPerK, TUNER_SPREAD);
+        plant.forcedUaWPerK = drawAround(generator, nominal.forcedUaWPerK, TUNER_SPREAD);
+        plant.sensorTauS = drawAround(generator, nominal.sensorTauS, TUNER_SPREAD);
+    }
+
+    /** Allocate everything the simulations use up front. */
+    WorkStealingPool pool((unsigned)threads);
+    std::vector<SimulationResult_t> results(candidates.size() * plants.size());
+    std::vector<HardwareManager> hals;
+    hals.reserve(pool.getWorkerCount());
+    for (unsigned i = 0; i < pool.getWorkerCount(); i++) {
+        hals.emplace_back();
+    }
+    TunerContext_t context = {&config, candidates.data(), plants.data(), plants.size(), results.data(), hals.data(), {}};
+
+    /** Run the simulations. */
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool.run(results.size(), simulate, &context);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t allocations = 0;
+    for (unsigned i = 0; i < pool.getWorkerCount(); i++) {
+        allocations += context.allocations[i];
+    }
+    double steps = (double)results.size() * (long)(config.durationS / config.periodS);
+
+    std::cout << "Ran " << results.size() << " simulations on " << pool.getWorkerCount() << " threads in "
+              << seconds << " s (" << (long)(steps / seconds) << " steps/s, " << pool.getStealCount()
+              << " stolen)." << std::endl;
+    if (AllocationTripwire::isEnabled()) {
+        std::cout << "Allocations in state machine cycles: " << allocations << std::endl;
+    }
+
+    /** Rank the candidates. Plants that never settle rank worst. */
+    std::vector<CandidateSummary_t> summaries(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++) {
+        summarize(i, &results[i * plants.size()], plants.size(), summaries[i]);
+    }
+    CandidateSummary_t baseline = summaries[0];
+    std::sort(summaries.begin(), summaries.end(), [](const CandidateSummary_t &a, const CandidateSummary_t &b) {
+        return a.unsettled != b.unsettled ? a.unsettled < b.unsettled : a.cost < b.cost;
+    });
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::setw(8) << "kp" << std::setw(8) << "ki" << std::setw(8) << "kd" << std::setw(10) << "settle"
+              << std::setw(10) << "worst" << std::setw(10) << "overshoot" << std::setw(10) << "kJ"
+              << std::setw(10) << "unsettled" << std::endl;
+    for (size_t i = 0; i < summaries.size() && i < (size_t)top; i++) {
+        printSummary(summaries[i], candidates[summaries[i].candidate]);
+    }
+    std::cout << "Default gains:" << std::endl;
+    printSummary(baseline, candidates[0]);
+
+    /** Write every candidate. */
+    if (csvPath != nullptr) {
+        std::ofstream csv(csvPath);
+        csv << "kp,ki,kd,mean_settling_s,worst_settling_s,worst_overshoot_c,mean_energy_j,unsettled" << std::endl;
+        for (const CandidateSummary_t &summary : summaries) {
+            const PidGains_t &gains = candidates[summary.candidate];
+            csv << gains.kp << "," << gains.ki << "," << gains.kd << "," << summary.meanSettlingS << ","
+                << summary.worstSettlingS << "," << summary.worstOvershootC << "," << summary.meanEnergyJ << ","
+                << summary.unsettled << std::endl;
+        }
+    }
+
+    return 0;
+}